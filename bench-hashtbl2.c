@@ -0,0 +1,876 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "cache-sharded.h"
+#include "hashtbl2-flat.h"
+#include "hashtbl2-frozen.h"
+#include "hashtbl2-indexmap.h"
+#include "hashtbl2-multimap.h"
+#include "hashtbl2-set.h"
+#include "hashtbl2-sharded.h"
+#include "hashtbl2-snapshot.h"
+#include "hashtbl2-soa.h"
+
+#include "str.h"
+#include "str-list.h"
+#include "vector.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/* Benchmarks for the hashtbl2.h family, run on the word list generated by
+ * make-word-list.py:
+ *
+ *      ./make-word-list.py > wordlist.txt
+ *      make bench-hashtbl2 && ./bench-hashtbl2
+ */
+
+HASHTBL_DEFINE(ChainedDic, chained_dic,
+               HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+               HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_SIZED(Pow2Dic, pow2_dic,
+                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                     HASHTBL_VALUE(int),
+                     HASHTBL_SIZING_POW2)
+
+/* same as ChainedDic, but the keys live in an arena of the table */
+HASHTBL_DEFINE(ArenaDic, arena_dic,
+               HASHTBL_KEY_ARENA(HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal)),
+               HASHTBL_VALUE(int))
+
+/* keys up to HASHTBL_STR_INLINE - 1 bytes are stored in the item */
+HASHTBL_DEFINE(InlineStrDic, inline_str_dic,
+               HASHTBL_KEY_STR(str_hash),
+               HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_FLAT(FlatDic, flat_dic,
+                    HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                    HASHTBL_VALUE(int))
+
+/* one shard is the same as a single global lock */
+HASHTBL_DEFINE_SHARDED(GlobalLockDic, global_lock_dic,
+                       HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                       HASHTBL_VALUE(int),
+                       0)
+
+HASHTBL_DEFINE_SHARDED(ShardedDic, sharded_dic,
+                       HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                       HASHTBL_VALUE(int),
+                       6)
+
+HASHTBL_DEFINE_SNAPSHOT_STR(ChainedDic, chained_dic)
+
+HASHTBL_DEFINE_FROZEN(FrozenDic, frozen_dic, int)
+
+static unsigned
+bench_int_hash(unsigned i)
+{
+    return i * 2654435761u;
+}
+
+static int
+bench_int_equal(unsigned a, unsigned b)
+{
+    return a == b;
+}
+
+HASHTBL_DEFINE(ChainedIntMap, chained_int_map,
+               HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+               HASHTBL_VALUE(unsigned))
+
+HASHTBL_DEFINE_INDEXMAP(IndexIntMap, index_int_map,
+                        HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+                        HASHTBL_VALUE(unsigned))
+
+HASHTBL_DEFINE(CharValueMap, char_value_map,
+               HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+               HASHTBL_VALUE(char))
+
+HASHSET_DEFINE(IntSet, int_set,
+               HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal))
+
+CACHE_DEFINE_LRU(LruCache, lru_cache,
+                 HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                 HASHTBL_VALUE(int))
+
+CACHE_DEFINE_SHARDED(GlobalLockCache, global_lock_cache,
+                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                     HASHTBL_VALUE(int),
+                     0)
+
+CACHE_DEFINE_SHARDED(ShardedCache, sharded_cache,
+                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                     HASHTBL_VALUE(int),
+                     6)
+
+/* posting lists: a table of vectors vs. the multimap */
+VECTOR_DEFINE(PostingVec, posting_vec, unsigned)
+
+static void
+bench_posting_vec_free(PostingVec v)
+{
+    posting_vec_clear(&v);
+}
+
+HASHTBL_DEFINE(VectorPostings, vector_postings,
+               HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+               HASHTBL_VALUE_FULL(PostingVec, PostingVec, /*nop*/, bench_posting_vec_free))
+
+HASHTBL_DEFINE_MULTIMAP(MultiPostings, multi_postings,
+                        HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                        HASHTBL_VALUE(unsigned))
+
+typedef struct {
+    unsigned id;
+    char payload[60];
+} BenchValue64;
+
+typedef struct {
+    unsigned id;
+    char payload[252];
+} BenchValue256;
+
+/* the same lookups for item and structure-of-arrays layouts */
+#define BENCH_DEFINE_VALUE_LOOKUP(TblTypeName, function_prefix) \
+    static inline TblTypeName##_Value * \
+    function_prefix##_bench_lookup_value(TblTypeName *map, unsigned key) \
+    { \
+        TblTypeName##_Item *item = function_prefix##_lookup(map, key); \
+        return item ? &item->value : NULL; \
+    }
+
+HASHTBL_DEFINE(ChainedMap64, chained_map64,
+               HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+               HASHTBL_VALUE(BenchValue64))
+BENCH_DEFINE_VALUE_LOOKUP(ChainedMap64, chained_map64)
+
+HASHTBL_DEFINE(ChainedMap256, chained_map256,
+               HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+               HASHTBL_VALUE(BenchValue256))
+BENCH_DEFINE_VALUE_LOOKUP(ChainedMap256, chained_map256)
+
+HASHTBL_DEFINE_SOA(SoaMap64, soa_map64,
+                   HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+                   HASHTBL_VALUE(BenchValue64))
+
+HASHTBL_DEFINE_SOA(SoaMap256, soa_map256,
+                   HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+                   HASHTBL_VALUE(BenchValue256))
+
+HASHTBL_DEFINE_SIZED(IncrementalIntMap, incremental_int_map,
+                     HASHTBL_KEY(unsigned, bench_int_hash, bench_int_equal),
+                     HASHTBL_VALUE(unsigned),
+                     HASHTBL_SIZING_INCREMENTAL(HASHTBL_SIZING_PRIME, 8))
+
+#define BENCH_ROUNDS 5
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static StrList
+bench_load_words(void)
+{
+    StrList words = NULL;
+
+    FILE *f = fopen("wordlist.txt", "r");
+    if (!f) {
+        perror("wordlist.txt");
+        exit(1);
+    }
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+        str_list_add(&words, buf);
+    }
+
+    free(buf);
+    fclose(f);
+
+    return words;
+}
+
+/* the same words with a prefix that does not occur in the dictionary */
+static StrList
+bench_make_misses(StrList words)
+{
+    StrList misses = NULL;
+    for (size_t i = 0; i < str_list_length(words); ++i) {
+        char *s = str_printf("#%s", words[i]);
+        str_list_emplace_back(&misses, s);
+    }
+    return misses;
+}
+
+static void
+bench_report(const char *name, const char *what, size_t ops, double seconds)
+{
+    printf("%-24s %-12s %8.2f Mops/s\n", name, what, (double)ops / seconds * 1e-6);
+}
+
+#define BENCH_WORDCOUNT(TblTypeName, function_prefix, words, misses) \
+    do { \
+        size_t nwords = str_list_length(words); \
+        double t_count = 0, t_hit = 0, t_miss = 0; \
+        long checksum = 0; \
+        for (int round = 0; round < BENCH_ROUNDS; ++round) { \
+            TblTypeName dic; \
+            function_prefix##_init(&dic); \
+            \
+            double t0 = bench_now(); \
+            for (size_t i = 0; i < nwords; ++i) { \
+                TblTypeName##_Item *item = function_prefix##_lookup(&dic, words[i]); \
+                if (item) { \
+                    item->value++; \
+                } else { \
+                    function_prefix##_set(&dic, words[i], 1); \
+                } \
+            } \
+            double t1 = bench_now(); \
+            for (size_t i = 0; i < nwords; ++i) \
+                checksum += function_prefix##_lookup(&dic, words[i])->value; \
+            double t2 = bench_now(); \
+            for (size_t i = 0; i < nwords; ++i) \
+                checksum += function_prefix##_lookup(&dic, misses[i]) != NULL; \
+            double t3 = bench_now(); \
+            \
+            t_count += t1 - t0; \
+            t_hit += t2 - t1; \
+            t_miss += t3 - t2; \
+            function_prefix##_clear(&dic); \
+        } \
+        bench_report(#TblTypeName, "wordcount", nwords * BENCH_ROUNDS, t_count); \
+        bench_report(#TblTypeName, "lookup hit", nwords * BENCH_ROUNDS, t_hit); \
+        bench_report(#TblTypeName, "lookup miss", nwords * BENCH_ROUNDS, t_miss); \
+        if (checksum == 42) \
+            printf("(unlikely)\n"); \
+    } while (0)
+
+/* worst case latency of a single insert, dominated by table growth */
+#define BENCH_INSERT_LATENCY(TblTypeName, function_prefix, count) \
+    do { \
+        TblTypeName map; \
+        function_prefix##_init(&map); \
+        \
+        double worst = 0; \
+        double t_start = bench_now(); \
+        for (unsigned i = 0; i < (count); ++i) { \
+            double t0 = bench_now(); \
+            function_prefix##_set(&map, i, i); \
+            double t1 = bench_now(); \
+            if (t1 - t0 > worst) \
+                worst = t1 - t0; \
+        } \
+        double t_total = bench_now() - t_start; \
+        \
+        bench_report(#TblTypeName, "insert", (count), t_total); \
+        printf("%-24s %-12s %8.3f ms\n", #TblTypeName, "worst insert", worst * 1e3); \
+        function_prefix##_clear(&map); \
+    } while (0)
+
+/* random lookups into a table much larger than the cache, one by one and batched */
+#define BENCH_BATCH_LOOKUP(TblTypeName, function_prefix, count, batch) \
+    do { \
+        TblTypeName map; \
+        function_prefix##_init_reserve(&map, (count)); \
+        for (unsigned i = 0; i < (count); ++i) \
+            function_prefix##_set(&map, i * 2, i); \
+        \
+        unsigned *keys = (unsigned *)malloc((count) * sizeof(unsigned)); \
+        unsigned x = 2463534242u; \
+        for (unsigned i = 0; i < (count); ++i) { \
+            x ^= x << 13; \
+            x ^= x >> 17; \
+            x ^= x << 5; \
+            keys[i] = x % ((count) * 2); \
+        } \
+        \
+        unsigned long checksum = 0; \
+        double t0 = bench_now(); \
+        for (unsigned i = 0; i < (count); ++i) { \
+            TblTypeName##_Item *item = function_prefix##_lookup(&map, keys[i]); \
+            checksum += item ? item->value : 0; \
+        } \
+        double t1 = bench_now(); \
+        TblTypeName##_Item *items[batch]; \
+        for (unsigned i = 0; i < (count); i += (batch)) { \
+            unsigned n = (count) - i < (batch) ? (count) - i : (batch); \
+            function_prefix##_lookup_many(&map, &keys[i], n, items); \
+            for (unsigned j = 0; j < n; ++j) \
+                checksum -= items[j] ? items[j]->value : 0; \
+        } \
+        double t2 = bench_now(); \
+        \
+        bench_report(#TblTypeName, "lookup", (count), t1 - t0); \
+        bench_report(#TblTypeName, "lookup_many", (count), t2 - t1); \
+        if (checksum != 0) \
+            printf("lookup_many returned different results!\n"); \
+        \
+        free(keys); \
+        function_prefix##_clear(&map); \
+    } while (0)
+
+/* random hits and misses on a table with large values, where the layout
+   decides how many cache lines a chain walk touches */
+#define BENCH_LARGE_VALUES(TblTypeName, function_prefix, lookup_value, count) \
+    do { \
+        TblTypeName map; \
+        function_prefix##_init(&map); \
+        for (unsigned i = 0; i < (count); ++i) { \
+            TblTypeName##_Value v; \
+            memset(&v, 0, sizeof(v)); \
+            v.id = i; \
+            function_prefix##_set(&map, i * 2, v); \
+        } \
+        \
+        unsigned *keys = (unsigned *)malloc((count) * sizeof(unsigned)); \
+        unsigned x = 2463534242u; \
+        for (unsigned i = 0; i < (count); ++i) { \
+            x ^= x << 13; \
+            x ^= x >> 17; \
+            x ^= x << 5; \
+            keys[i] = x % (count) * 2; \
+        } \
+        \
+        unsigned long checksum = 0; \
+        double t0 = bench_now(); \
+        for (unsigned i = 0; i < (count); ++i) { \
+            TblTypeName##_Value *v = lookup_value(&map, keys[i]); \
+            checksum += v ? v->id : 0; \
+        } \
+        double t1 = bench_now(); \
+        for (unsigned i = 0; i < (count); ++i) \
+            checksum += lookup_value(&map, keys[i] + 1) != NULL; \
+        double t2 = bench_now(); \
+        \
+        bench_report(#TblTypeName, "lookup hit", (count), t1 - t0); \
+        bench_report(#TblTypeName, "lookup miss", (count), t2 - t1); \
+        if (checksum == 42) \
+            printf("(unlikely)\n"); \
+        \
+        free(keys); \
+        function_prefix##_clear(&map); \
+    } while (0)
+
+/* iterating after most of the items have been removed again */
+#define BENCH_ITERATE_AFTER_CHURN(TblTypeName, function_prefix, count) \
+    do { \
+        TblTypeName map; \
+        function_prefix##_init(&map); \
+        for (unsigned i = 0; i < (count); ++i) \
+            function_prefix##_set(&map, i, i); \
+        double t0 = bench_now(); \
+        for (unsigned i = 0; i < (count); ++i) { \
+            if (i % 16) \
+                function_prefix##_remove(&map, i); \
+        } \
+        double t1 = bench_now(); \
+        \
+        unsigned long checksum = 0; \
+        for (int round = 0; round < BENCH_ROUNDS; ++round) { \
+            TblTypeName##_Iterator it; \
+            function_prefix##_iterator_init(&map, &it); \
+            while (!function_prefix##_iterator_at_end(&it)) { \
+                checksum += function_prefix##_iterator_item(&it)->value; \
+                function_prefix##_iterator_next(&it); \
+            } \
+        } \
+        double t2 = bench_now(); \
+        \
+        bench_report(#TblTypeName, "remove", (count) - (count) / 16, t1 - t0); \
+        bench_report(#TblTypeName, "iterate", (size_t)function_prefix##_size(&map) * BENCH_ROUNDS, t2 - t1); \
+        if (checksum == 42) \
+            printf("(unlikely)\n"); \
+        function_prefix##_clear(&map); \
+    } while (0)
+
+/* loading a table from arrays, one insert at a time and in bulk */
+#define BENCH_BUILD(TblTypeName, function_prefix, count) \
+    do { \
+        unsigned *keys = (unsigned *)malloc((count) * sizeof(unsigned)); \
+        for (unsigned i = 0; i < (count); ++i) \
+            keys[i] = i * 7; \
+        \
+        TblTypeName map; \
+        function_prefix##_init(&map); \
+        double t0 = bench_now(); \
+        for (unsigned i = 0; i < (count); ++i) \
+            function_prefix##_set(&map, keys[i], keys[i]); \
+        double t1 = bench_now(); \
+        function_prefix##_clear(&map); \
+        \
+        function_prefix##_init(&map); \
+        double t2 = bench_now(); \
+        function_prefix##_build_from(&map, keys, keys, (count)); \
+        double t3 = bench_now(); \
+        function_prefix##_clear(&map); \
+        \
+        bench_report(#TblTypeName, "set loop", (count), t1 - t0); \
+        bench_report(#TblTypeName, "build_from", (count), t3 - t2); \
+        free(keys); \
+    } while (0)
+
+/* a read-through cache of `capacity` words in front of the word list */
+#define BENCH_CACHE(TypeName, function_prefix, words, capacity) \
+    do { \
+        size_t nwords = str_list_length(words); \
+        TypeName cache; \
+        function_prefix##_init(&cache, (capacity)); \
+        \
+        double t0 = bench_now(); \
+        for (int round = 0; round < BENCH_ROUNDS; ++round) { \
+            for (size_t i = 0; i < nwords; ++i) { \
+                if (!function_prefix##_get(&cache, words[i])) \
+                    function_prefix##_put(&cache, words[i], (int)i, 1); \
+            } \
+        } \
+        double t1 = bench_now(); \
+        \
+        char what[32]; \
+        snprintf(what, sizeof(what), "cache %u", (unsigned)(capacity)); \
+        bench_report(#TypeName, what, nwords * BENCH_ROUNDS, t1 - t0); \
+        printf("%-24s %-12s %8.3f\n", #TypeName, "hit ratio", \
+               cache_counters_hit_ratio(function_prefix##_counters(&cache))); \
+        function_prefix##_clear(&cache); \
+    } while (0)
+
+/* the same for the concurrent caches, which copy values out */
+#define BENCH_SHARDED_CACHE(TypeName, function_prefix, words, capacity) \
+    do { \
+        size_t nwords = str_list_length(words); \
+        TypeName cache; \
+        function_prefix##_init(&cache, (capacity)); \
+        \
+        double t0 = bench_now(); \
+        for (int round = 0; round < BENCH_ROUNDS; ++round) { \
+            for (size_t i = 0; i < nwords; ++i) { \
+                if (!function_prefix##_get(&cache, words[i], NULL)) \
+                    function_prefix##_put(&cache, words[i], (int)i); \
+            } \
+        } \
+        double t1 = bench_now(); \
+        \
+        char what[32]; \
+        snprintf(what, sizeof(what), "cache %u", (unsigned)(capacity)); \
+        bench_report(#TypeName, what, nwords * BENCH_ROUNDS, t1 - t0); \
+        printf("%-24s %-12s %8.3f\n", #TypeName, "hit ratio", \
+               cache_counters_hit_ratio(function_prefix##_counters(&cache))); \
+        function_prefix##_clear(&cache); \
+    } while (0)
+
+/* the wordcount loop with a single hash and probe per word */
+#define BENCH_WORDCOUNT_SINGLE_PROBE(TblTypeName, function_prefix, words) \
+    do { \
+        size_t nwords = str_list_length(words); \
+        double t_count = 0; \
+        long checksum = 0; \
+        for (int round = 0; round < BENCH_ROUNDS; ++round) { \
+            TblTypeName dic; \
+            function_prefix##_init(&dic); \
+            \
+            double t0 = bench_now(); \
+            for (size_t i = 0; i < nwords; ++i) \
+                function_prefix##_lookup_or_insert_zero(&dic, words[i], NULL)->value++; \
+            double t1 = bench_now(); \
+            \
+            t_count += t1 - t0; \
+            checksum += function_prefix##_size(&dic); \
+            function_prefix##_clear(&dic); \
+        } \
+        bench_report(#TblTypeName, "wordcount 1x", nwords * BENCH_ROUNDS, t_count); \
+        if (checksum == 42) \
+            printf("(unlikely)\n"); \
+    } while (0)
+
+static void
+bench_increment(int *value, void *ctx)
+{
+    (void)ctx;
+    (*value)++;
+}
+
+/* hashing throughput over the words, and over URL-length keys */
+static void
+bench_hash(StrList words)
+{
+    size_t nwords = str_list_length(words);
+    StrList urls = NULL;
+    for (size_t i = 0; i < nwords; ++i)
+        str_list_emplace_back(&urls, str_printf("https://example.com/some/longer/path/%s?query=%zu", words[i], i));
+
+    int *lengths = (int *)malloc(nwords * sizeof(int));
+    StrList lists[] = { words, urls };
+    const char *names[] = { "words", "urls" };
+    unsigned checksum = 0;
+
+    for (int l = 0; l < 2; ++l) {
+        size_t bytes = 0;
+        for (size_t i = 0; i < nwords; ++i) {
+            lengths[i] = str_length(lists[l][i]);
+            bytes += (size_t)lengths[i];
+        }
+
+        double t0 = bench_now();
+        for (int round = 0; round < BENCH_ROUNDS; ++round)
+            for (size_t i = 0; i < nwords; ++i)
+                checksum += str_hash(lists[l][i]);
+        double t1 = bench_now();
+        for (int round = 0; round < BENCH_ROUNDS; ++round)
+            for (size_t i = 0; i < nwords; ++i)
+                checksum += str_hash_buf(lists[l][i], lengths[i]);
+        double t2 = bench_now();
+
+        printf("%-24s %-12s %8.2f MB/s\n", "str_hash", names[l], (double)bytes * BENCH_ROUNDS / (t1 - t0) * 1e-6);
+        printf("%-24s %-12s %8.2f MB/s\n", "str_hash_buf", names[l], (double)bytes * BENCH_ROUNDS / (t2 - t1) * 1e-6);
+    }
+
+    if (checksum == 42)
+        printf("(unlikely)\n");
+
+    free(lengths);
+    str_list_clear(&urls);
+}
+
+#define BENCH_MAX_THREADS 8
+
+typedef struct {
+    void *dic;
+    StrList words;
+    size_t begin;
+    size_t end;
+} BenchWorker;
+
+/* wordcount with the word list split between 1, 2, 4 and 8 threads. This
+ * only shows scaling on a machine with at least as many cores as threads. */
+#define BENCH_DEFINE_THREADED_WORDCOUNT(TblTypeName, function_prefix) \
+    static void * \
+    function_prefix##_bench_worker(void *arg) \
+    { \
+        BenchWorker *w = (BenchWorker *)arg; \
+        for (size_t i = w->begin; i < w->end; ++i) \
+            function_prefix##_lookup_or_insert((TblTypeName *)w->dic, w->words[i], 0, bench_increment, NULL); \
+        return NULL; \
+    } \
+    \
+    static void \
+    function_prefix##_bench_threaded(StrList words) \
+    { \
+        size_t nwords = str_list_length(words); \
+        for (int nthreads = 1; nthreads <= BENCH_MAX_THREADS; nthreads *= 2) { \
+            double t_total = 0; \
+            for (int round = 0; round < BENCH_ROUNDS; ++round) { \
+                TblTypeName dic; \
+                function_prefix##_init(&dic); \
+                \
+                pthread_t threads[BENCH_MAX_THREADS]; \
+                BenchWorker workers[BENCH_MAX_THREADS]; \
+                double t0 = bench_now(); \
+                for (int t = 0; t < nthreads; ++t) { \
+                    workers[t].dic = &dic; \
+                    workers[t].words = words; \
+                    workers[t].begin = nwords * (size_t)t / (size_t)nthreads; \
+                    workers[t].end = nwords * (size_t)(t + 1) / (size_t)nthreads; \
+                    pthread_create(&threads[t], NULL, function_prefix##_bench_worker, &workers[t]); \
+                } \
+                for (int t = 0; t < nthreads; ++t) \
+                    pthread_join(threads[t], NULL); \
+                t_total += bench_now() - t0; \
+                \
+                function_prefix##_clear(&dic); \
+            } \
+            char what[32]; \
+            snprintf(what, sizeof(what), "%d threads", nthreads); \
+            bench_report(#TblTypeName, what, nwords * BENCH_ROUNDS, t_total); \
+        } \
+    }
+
+BENCH_DEFINE_THREADED_WORDCOUNT(GlobalLockDic, global_lock_dic)
+BENCH_DEFINE_THREADED_WORDCOUNT(ShardedDic, sharded_dic)
+
+/* a read-through cache of 10000 words, shared by 1, 2, 4 and 8 threads which
+ * each go through the whole word list from a different starting point */
+#define BENCH_DEFINE_THREADED_CACHE(TypeName, function_prefix) \
+    static void * \
+    function_prefix##_bench_worker(void *arg) \
+    { \
+        BenchWorker *w = (BenchWorker *)arg; \
+        size_t nwords = str_list_length(w->words); \
+        for (size_t i = 0; i < nwords; ++i) { \
+            const char *word = w->words[(w->begin + i) % nwords]; \
+            if (!function_prefix##_get((TypeName *)w->dic, word, NULL)) \
+                function_prefix##_put((TypeName *)w->dic, word, 1); \
+        } \
+        return NULL; \
+    } \
+    \
+    static void \
+    function_prefix##_bench_threaded(StrList words) \
+    { \
+        size_t nwords = str_list_length(words); \
+        for (int nthreads = 1; nthreads <= BENCH_MAX_THREADS; nthreads *= 2) { \
+            TypeName cache; \
+            function_prefix##_init(&cache, 10000); \
+            \
+            pthread_t threads[BENCH_MAX_THREADS]; \
+            BenchWorker workers[BENCH_MAX_THREADS]; \
+            double t0 = bench_now(); \
+            for (int t = 0; t < nthreads; ++t) { \
+                workers[t].dic = &cache; \
+                workers[t].words = words; \
+                workers[t].begin = nwords * (size_t)t / (size_t)nthreads; \
+                workers[t].end = nwords; \
+                pthread_create(&threads[t], NULL, function_prefix##_bench_worker, &workers[t]); \
+            } \
+            for (int t = 0; t < nthreads; ++t) \
+                pthread_join(threads[t], NULL); \
+            double t1 = bench_now(); \
+            \
+            char what[32]; \
+            snprintf(what, sizeof(what), "%d threads", nthreads); \
+            bench_report(#TypeName, what, nwords * (size_t)nthreads, t1 - t0); \
+            function_prefix##_clear(&cache); \
+        } \
+    }
+
+BENCH_DEFINE_THREADED_CACHE(GlobalLockCache, global_lock_cache)
+BENCH_DEFINE_THREADED_CACHE(ShardedCache, sharded_cache)
+
+/* intersecting a small and a large set, as a set and as a table with unused values */
+static void
+bench_set(void)
+{
+    unsigned large_count = 4000000u, small_count = 400000u;
+
+    CharValueMap large_map, small_map, out_map;
+    IntSet large_set, small_set, out_set;
+    char_value_map_init(&large_map);
+    char_value_map_init(&small_map);
+    char_value_map_init(&out_map);
+    int_set_init(&large_set);
+    int_set_init(&small_set);
+    int_set_init(&out_set);
+
+    for (unsigned i = 0; i < large_count; ++i) {
+        char_value_map_set(&large_map, i * 3, 1);
+        int_set_add(&large_set, i * 3);
+    }
+    for (unsigned i = 0; i < small_count; ++i) {
+        char_value_map_set(&small_map, i * 2, 1);
+        int_set_add(&small_set, i * 2);
+    }
+
+    double t0 = bench_now();
+    CharValueMap_Iterator it;
+    char_value_map_iterator_init(&small_map, &it);
+    while (!char_value_map_iterator_at_end(&it)) {
+        CharValueMap_Item *item = char_value_map_iterator_item(&it);
+        if (char_value_map_lookup_with_hash(&large_map, item->hash, item->key))
+            char_value_map_set(&out_map, item->key, 1);
+        char_value_map_iterator_next(&it);
+    }
+    double t1 = bench_now();
+    int_set_intersect(&out_set, &large_set, &small_set);
+    double t2 = bench_now();
+
+    bench_report("CharValueMap", "intersect", small_count, t1 - t0);
+    bench_report("IntSet", "intersect", small_count, t2 - t1);
+    printf("%-24s %-12s %8zu B\n", "CharValueMap", "item size", sizeof(CharValueMap_Item));
+    printf("%-24s %-12s %8zu B\n", "IntSet", "item size", sizeof(IntSet_Item));
+    if (char_value_map_size(&out_map) != int_set_size(&out_set))
+        printf("set intersections differ!\n");
+
+    int_set_clear(&out_set);
+    int_set_clear(&small_set);
+    int_set_clear(&large_set);
+    char_value_map_clear(&out_map);
+    char_value_map_clear(&small_map);
+    char_value_map_clear(&large_map);
+}
+
+/* building an inverted index from word to line numbers, then reading all of it back */
+static void
+bench_postings(StrList words)
+{
+    size_t nwords = str_list_length(words);
+    size_t sum_vec = 0, sum_multi = 0;
+
+    double t0 = bench_now();
+    VectorPostings vp;
+    vector_postings_init(&vp);
+    for (size_t i = 0; i < nwords; ++i) {
+        VectorPostings_Item *item = vector_postings_lookup_or_insert_zero(&vp, words[i], NULL);
+        posting_vec_push_back(&item->value, (unsigned)i);
+    }
+    double t1 = bench_now();
+    for (size_t i = 0; i < nwords; ++i) {
+        PostingVec v = vector_postings_lookup(&vp, words[i])->value;
+        for (size_t j = 0; j < posting_vec_length(v); ++j)
+            sum_vec += v[j];
+    }
+    double t2 = bench_now();
+
+    MultiPostings mp;
+    multi_postings_init(&mp);
+    for (size_t i = 0; i < nwords; ++i)
+        multi_postings_append(&mp, words[i], (unsigned)i);
+    double t3 = bench_now();
+    for (size_t i = 0; i < nwords; ++i) {
+        MultiPostings_Range r;
+        multi_postings_equal_range(&mp, words[i], &r);
+        unsigned *ids, len;
+        while ((ids = multi_postings_range_run(&r, &len)))
+            for (unsigned j = 0; j < len; ++j)
+                sum_multi += ids[j];
+    }
+    double t4 = bench_now();
+
+    bench_report("VectorPostings", "append", nwords, t1 - t0);
+    bench_report("MultiPostings", "append", nwords, t3 - t2);
+    bench_report("VectorPostings", "scan", nwords, t2 - t1);
+    bench_report("MultiPostings", "scan", nwords, t4 - t3);
+    if (sum_vec != sum_multi)
+        printf("posting lists differ!\n");
+
+    multi_postings_clear(&mp);
+    vector_postings_clear(&vp);
+}
+
+/* building the dictionary vs. mapping a saved snapshot of it */
+static void
+bench_snapshot(StrList words)
+{
+    size_t nwords = str_list_length(words);
+
+    double t0 = bench_now();
+    ChainedDic dic;
+    chained_dic_init(&dic);
+    for (size_t i = 0; i < nwords; ++i)
+        chained_dic_set(&dic, words[i], (int)i);
+    double t1 = bench_now();
+
+    char path[] = "/tmp/bench-hashtbl2-snapshot-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || !chained_dic_save(&dic, fd)) {
+        perror(path);
+        exit(1);
+    }
+    close(fd);
+    chained_dic_clear(&dic);
+
+    double t2 = bench_now();
+    ChainedDic_Snapshot snap;
+    if (!chained_dic_map(&snap, path)) {
+        perror(path);
+        exit(1);
+    }
+    double t3 = bench_now();
+
+    unsigned found = 0;
+    for (size_t i = 0; i < nwords; ++i)
+        found += chained_dic_snapshot_contains(&snap, words[i]) ? 1u : 0u;
+    double t4 = bench_now();
+
+    printf("%-24s %-12s %8.3f ms\n", "ChainedDic", "rebuild", (t1 - t0) * 1e3);
+    printf("%-24s %-12s %8.3f ms\n", "ChainedDic_Snapshot", "map", (t3 - t2) * 1e3);
+    bench_report("ChainedDic_Snapshot", "lookup", nwords, t4 - t3);
+    if (found != nwords)
+        printf("snapshot lookups failed\n");
+
+    chained_dic_unmap(&snap);
+    unlink(path);
+}
+
+/* lookups in a dictionary frozen into a minimal perfect hash */
+static void
+bench_frozen(StrList words, StrList misses)
+{
+    size_t nwords = str_list_length(words);
+
+    double t0 = bench_now();
+    FrozenDic fd;
+    if (!frozen_dic_build_from_str_list(&fd, words)) {
+        perror("frozen_dic_build_from_str_list");
+        exit(1);
+    }
+    double t1 = bench_now();
+
+    unsigned found = 0;
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+        for (size_t i = 0; i < nwords; ++i)
+            found += frozen_dic_contains(&fd, words[i]) ? 1u : 0u;
+    double t2 = bench_now();
+
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+        for (size_t i = 0; i < nwords; ++i)
+            found += frozen_dic_contains(&fd, misses[i]) ? 1u : 0u;
+    double t3 = bench_now();
+
+    printf("%-24s %-12s %8.3f ms\n", "FrozenDic", "build", (t1 - t0) * 1e3);
+    bench_report("FrozenDic", "hits", nwords * BENCH_ROUNDS, t2 - t1);
+    bench_report("FrozenDic", "misses", nwords * BENCH_ROUNDS, t3 - t2);
+    if (found != nwords * BENCH_ROUNDS)
+        printf("frozen lookups failed\n");
+
+    frozen_dic_clear(&fd);
+}
+
+int main(void)
+{
+    StrList words = bench_load_words();
+    StrList misses = bench_make_misses(words);
+
+    bench_hash(words);
+
+    BENCH_WORDCOUNT(ChainedDic, chained_dic, words, misses);
+    BENCH_WORDCOUNT(Pow2Dic, pow2_dic, words, misses);
+    BENCH_WORDCOUNT_SINGLE_PROBE(ChainedDic, chained_dic, words);
+    BENCH_WORDCOUNT_SINGLE_PROBE(Pow2Dic, pow2_dic, words);
+    BENCH_WORDCOUNT(ArenaDic, arena_dic, words, misses);
+    BENCH_WORDCOUNT_SINGLE_PROBE(ArenaDic, arena_dic, words);
+    BENCH_WORDCOUNT(InlineStrDic, inline_str_dic, words, misses);
+    BENCH_WORDCOUNT_SINGLE_PROBE(InlineStrDic, inline_str_dic, words);
+    BENCH_WORDCOUNT(FlatDic, flat_dic, words, misses);
+
+    BENCH_INSERT_LATENCY(ChainedIntMap, chained_int_map, 4000000u);
+    BENCH_INSERT_LATENCY(IncrementalIntMap, incremental_int_map, 4000000u);
+
+    BENCH_BATCH_LOOKUP(ChainedIntMap, chained_int_map, 4000000u, 128);
+
+    BENCH_BUILD(ChainedIntMap, chained_int_map, 4000000u);
+
+    BENCH_ITERATE_AFTER_CHURN(ChainedIntMap, chained_int_map, 4000000u);
+    BENCH_ITERATE_AFTER_CHURN(IndexIntMap, index_int_map, 4000000u);
+
+    BENCH_LARGE_VALUES(ChainedMap64, chained_map64, chained_map64_bench_lookup_value, 1000000u);
+    BENCH_LARGE_VALUES(SoaMap64, soa_map64, soa_map64_lookup, 1000000u);
+    BENCH_LARGE_VALUES(ChainedMap256, chained_map256, chained_map256_bench_lookup_value, 1000000u);
+    BENCH_LARGE_VALUES(SoaMap256, soa_map256, soa_map256_lookup, 1000000u);
+
+    bench_set();
+
+    bench_postings(words);
+
+    BENCH_CACHE(LruCache, lru_cache, words, 1000u);
+    BENCH_SHARDED_CACHE(GlobalLockCache, global_lock_cache, words, 1000u);
+    BENCH_CACHE(LruCache, lru_cache, words, 10000u);
+    BENCH_SHARDED_CACHE(GlobalLockCache, global_lock_cache, words, 10000u);
+
+    bench_snapshot(words);
+    bench_frozen(words, misses);
+
+    global_lock_dic_bench_threaded(words);
+    sharded_dic_bench_threaded(words);
+    global_lock_cache_bench_threaded(words);
+    sharded_cache_bench_threaded(words);
+
+    str_list_clear(&misses);
+    str_list_clear(&words);
+}
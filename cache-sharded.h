@@ -0,0 +1,516 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "cache.h"
+
+#include <pthread.h>
+
+/* Sharded S3-FIFO cache for concurrent use, built from hashtbl2.h tables
+ *
+ * How-To:
+ *      // Define type and functions, with 2^6 = 64 shards
+ *      CACHE_DEFINE_SHARDED(WordCache, word_cache,
+ *                           HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+ *                           HASHTBL_VALUE(int),
+ *                           6)
+ *
+ *      WordCache wc;
+ *      word_cache_init(&wc, 100000);
+ *
+ *      // from any number of threads
+ *      int v;
+ *      if (!word_cache_get(&wc, word, &v)) {
+ *          v = compute(word);
+ *          word_cache_put(&wc, word, v);
+ *      }
+ *
+ *      word_cache_clear(&wc);
+ *
+ * The keys are split into 2^shard_bits shards by the high bits of their
+ * hash, like in hashtbl2-sharded.h. Each shard is a hashtbl2 table sized
+ * once for its share of the capacity, and two rings of item indices which
+ * implement S3-FIFO eviction:
+ *
+ *      - new keys enter the small queue, which holds about 10% of the
+ *        entries. Keys which weren't hit by the time they leave it are
+ *        evicted, so a one-off scan only flushes the small queue.
+ *      - keys which were hit move on to the main queue, which works like
+ *        CLOCK: a key which was hit since it was last looked at goes
+ *        around again, otherwise it is evicted.
+ *      - the hashes of keys evicted from the small queue are remembered in
+ *        a direct-mapped ghost array. A key which comes back while it is
+ *        still there goes straight to the main queue.
+ *
+ * A hit only bumps a small counter in the item, so lookups just take the
+ * shard's lock for reading and run in parallel. Inserts take it for writing.
+ * Like in hashtbl2-sharded.h, no item pointers are handed out: values are
+ * copied out by plain assignment, so for value types which own memory the
+ * copy is only valid until the entry is evicted.
+ *
+ * Reference Docs:
+ *
+ *      CACHE_DEFINE_SHARDED(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, shard_bits)
+ *          Defines types and functions for a cache with 2^shard_bits shards
+ *          (0 <= shard_bits <= 16). The specs are the same as for
+ *          HASHTBL_DEFINE. Each shard's table is a TypeName_Table defined
+ *          with function prefix function_prefix_table, see hashtbl2.h.
+ *          Can't be used with HASHTBL_KEY_ARENA, whose arena would keep
+ *          growing with the keys of evicted entries.
+ *
+ *      int
+ *      function_prefix_init(TypeName *cache, size_t capacity)
+ *          Initializes the cache for about `capacity` entries, rounded up to
+ *          a multiple of the shard count, and allocates all its memory up
+ *          front. Returns 0 if that failed, the cache must still be cleared.
+ *
+ *      void
+ *      function_prefix_clear(TypeName *cache)
+ *          Frees all memory and destroys the locks. Must not be called
+ *          concurrently with other functions. Call function_prefix_init()
+ *          again to reuse the cache.
+ *
+ *      void
+ *      function_prefix_set_evict_func(TypeName *cache,
+ *                                     void (*evict_func)(ConstKeyType key, ValueType *value, void *ctx),
+ *                                     void *ctx)
+ *          Sets a function which is called for every entry evicted to make
+ *          room, before the key and value are freed. It runs with the shard
+ *          locked and must not call back into the cache. Must be set before
+ *          the cache is shared between threads.
+ *
+ *      int
+ *      function_prefix_get(TypeName *cache, ConstKeyType key, ValueType *out_value)
+ *          Returns nonzero if the key was found and counts a hit or a miss.
+ *          If out_value is not NULL, the value is copied there.
+ *
+ *      int
+ *      function_prefix_contains(TypeName *cache, ConstKeyType key)
+ *          Like function_prefix_get(), but doesn't count as an access.
+ *
+ *      int
+ *      function_prefix_put(TypeName *cache, ConstKeyType key, ConstValueType value)
+ *          Stores the value, replacing the value already stored for the key,
+ *          and evicts an entry if the shard is full. Returns 0 on failure.
+ *
+ *      int
+ *      function_prefix_remove(TypeName *cache, ConstKeyType key)
+ *          Removes the entry for the key, returns 1 if there was one. The
+ *          value is freed right away, the table item when its turn for
+ *          eviction comes.
+ *
+ *      unsigned
+ *      function_prefix_size(TypeName *cache)
+ *          Number of entries. Only a snapshot if other threads modify the cache.
+ *
+ *      CacheCounters
+ *      function_prefix_counters(TypeName *cache)
+ *      void
+ *      function_prefix_reset_counters(TypeName *cache)
+ *          Hits and misses of function_prefix_get(), and the number of
+ *          evicted entries, summed over all shards.
+ *
+ *      int
+ *      function_prefix_check_internal_sanity(TypeName *cache)
+ *          Must not be called concurrently with other functions.
+ */
+
+/* a fixed size ring of item indices */
+typedef struct {
+    unsigned *slots;
+    unsigned size;
+    unsigned head;
+    unsigned count;
+} CacheRing;
+
+static inline int
+_cache_ring_init(CacheRing *r, unsigned size, void *(*reallocarray_func)(void *, size_t, size_t))
+{
+    r->slots = (unsigned *)reallocarray_func(NULL, size, sizeof(unsigned));
+    r->size = size;
+    r->head = 0;
+    r->count = 0;
+    return r->slots != NULL;
+}
+
+static inline void
+_cache_ring_push(CacheRing *r, unsigned i)
+{
+    unsigned pos = r->head + r->count;
+    r->slots[pos < r->size ? pos : pos - r->size] = i;
+    r->count++;
+}
+
+static inline unsigned
+_cache_ring_pop(CacheRing *r)
+{
+    unsigned i = r->slots[r->head];
+    r->head = r->head + 1 < r->size ? r->head + 1 : 0;
+    r->count--;
+    return i;
+}
+
+static inline unsigned
+_cache_ring_at(CacheRing *r, unsigned n)
+{
+    unsigned pos = r->head + n;
+    return r->slots[pos < r->size ? pos : pos - r->size];
+}
+
+/* cap of the per-entry hit counter: how many more rounds an entry can stay in
+ * the main queue without being hit again */
+#ifndef CACHE_S3FIFO_MAX_FREQ
+#   define CACHE_S3FIFO_MAX_FREQ 3
+#endif
+
+#define CACHE_DEFINE_SHARDED(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, shard_bits) \
+    CACHE__EXPAND_DEFINE_SHARDED(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, shard_bits)
+
+#define CACHE__EXPAND_DEFINE_SHARDED(...) \
+    CACHE__INTERNAL_DEFINE_SHARDED(__VA_ARGS__)
+
+#define CACHE__INTERNAL_DEFINE_SHARDED(TypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, shard_bits) \
+    \
+    typedef struct { \
+        ValueType value; \
+        unsigned char freq; /* hits since last looked at by the eviction, capped */ \
+        unsigned char dead; /* removed, the value is already freed */ \
+    } TypeName##_Entry; \
+    \
+    HASHTBL__INTERNAL_DEFINE(TypeName##_Table, function_prefix##_table, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, \
+                             TypeName##_Entry, TypeName##_Entry, /*nop*/, (void), _hashtbl_prime_bucket_count, _hashtbl_prime_index_for_hash, 0, \
+                             reallocarray, free) \
+    \
+    typedef ConstKeyType    TypeName##_ConstKey; \
+    typedef ValueType       TypeName##_Value; \
+    typedef ConstValueType  TypeName##_ConstValue; \
+    typedef struct { \
+        pthread_rwlock_t lock; \
+        TypeName##_Table tbl; \
+        unsigned capacity; \
+        unsigned small_capacity; \
+        unsigned dead_count; \
+        CacheRing small; \
+        CacheRing main; \
+        unsigned *ghost; /* capacity hashes, stored as hash | 1 so that 0 means empty */ \
+        CacheCounters counters; \
+        char padding[64]; /* keep the locks of neighbouring shards off the same cache line */ \
+    } TypeName##_ShardSlot; \
+    typedef struct { \
+        uint64_t hash_seed; /* selects the shard, for seeded keys */ \
+        void (*evict_func)(TypeName##_ConstKey key, TypeName##_Value *value, void *ctx); \
+        void *evict_ctx; \
+        TypeName##_ShardSlot shards[1u << (shard_bits)]; \
+    } TypeName; \
+    \
+    static inline unsigned \
+    function_prefix##_shard_for_hash(unsigned hash) \
+    { \
+        return ((hash & 0xffffffffu) >> 16) >> (16 - (shard_bits)); \
+    } \
+    \
+    /* the hash value for use within the shard, which may have been reseeded */ \
+    static inline unsigned \
+    function_prefix##_internal_shard_hash(TypeName *cache, TypeName##_ShardSlot *shard, unsigned hash, TypeName##_ConstKey key) \
+    { \
+        if (shard->tbl.hash_seed == cache->hash_seed) \
+            return hash; \
+        return function_prefix##_table_hash(&shard->tbl, key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_init(TypeName *cache, size_t capacity) \
+    { \
+        size_t per_shard = (capacity + (1u << (shard_bits)) - 1) >> (shard_bits); \
+        unsigned n = per_shard < 1 ? 1 : per_shard > 0x7fffffffu ? 0x7fffffffu : (unsigned)per_shard; \
+        int ok = 1; \
+        \
+        cache->evict_func = NULL; \
+        cache->evict_ctx = NULL; \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            TypeName##_ShardSlot *shard = &cache->shards[i]; \
+            pthread_rwlock_init(&shard->lock, NULL); \
+            function_prefix##_table_init_reserve(&shard->tbl, n); \
+            function_prefix##_table_reseed(&shard->tbl, cache->shards[0].tbl.hash_seed); \
+            shard->capacity = n; \
+            shard->small_capacity = n / 10 ? n / 10 : 1; \
+            shard->dead_count = 0; \
+            ok &= _cache_ring_init(&shard->small, n, reallocarray); \
+            ok &= _cache_ring_init(&shard->main, n, reallocarray); \
+            shard->ghost = (unsigned *)reallocarray(NULL, n, sizeof(unsigned)); \
+            if (shard->ghost) \
+                memset(shard->ghost, 0, n * sizeof(unsigned)); \
+            ok &= shard->ghost != NULL && shard->tbl.item_storage != NULL; \
+            memset(&shard->counters, 0, sizeof(shard->counters)); \
+        } \
+        cache->hash_seed = cache->shards[0].tbl.hash_seed; \
+        return ok; \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TypeName *cache) \
+    { \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            TypeName##_ShardSlot *shard = &cache->shards[i]; \
+            TypeName##_Table_Iterator it; \
+            function_prefix##_table_iterator_init(&shard->tbl, &it); \
+            while (!function_prefix##_table_iterator_at_end(&it)) { \
+                TypeName##_Table_Item *item = function_prefix##_table_iterator_item(&it); \
+                if (!item->value.dead) \
+                    value_free_func(item->value.value); \
+                function_prefix##_table_iterator_next(&it); \
+            } \
+            \
+            function_prefix##_table_clear(&shard->tbl); \
+            free(shard->small.slots); \
+            free(shard->main.slots); \
+            free(shard->ghost); \
+            pthread_rwlock_destroy(&shard->lock); \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_set_evict_func(TypeName *cache, void (*evict_func)(TypeName##_ConstKey key, TypeName##_Value *value, void *ctx), void *ctx) \
+    { \
+        cache->evict_func = evict_func; \
+        cache->evict_ctx = ctx; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TypeName *cache) \
+    { \
+        unsigned count = 0; \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            pthread_rwlock_rdlock(&cache->shards[i].lock); \
+            count += function_prefix##_table_size(&cache->shards[i].tbl) - cache->shards[i].dead_count; \
+            pthread_rwlock_unlock(&cache->shards[i].lock); \
+        } \
+        return count; \
+    } \
+    \
+    static inline CacheCounters \
+    function_prefix##_counters(TypeName *cache) \
+    { \
+        CacheCounters sum = {0, 0, 0}; \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            sum.hits += __atomic_load_n(&cache->shards[i].counters.hits, __ATOMIC_RELAXED); \
+            sum.misses += __atomic_load_n(&cache->shards[i].counters.misses, __ATOMIC_RELAXED); \
+            sum.evictions += __atomic_load_n(&cache->shards[i].counters.evictions, __ATOMIC_RELAXED); \
+        } \
+        return sum; \
+    } \
+    \
+    static inline void \
+    function_prefix##_reset_counters(TypeName *cache) \
+    { \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            __atomic_store_n(&cache->shards[i].counters.hits, 0, __ATOMIC_RELAXED); \
+            __atomic_store_n(&cache->shards[i].counters.misses, 0, __ATOMIC_RELAXED); \
+            __atomic_store_n(&cache->shards[i].counters.evictions, 0, __ATOMIC_RELAXED); \
+        } \
+    } \
+    \
+    static inline int \
+    function_prefix##_get(TypeName *cache, TypeName##_ConstKey key, TypeName##_Value *out_value) \
+    { \
+        unsigned hash = function_prefix##_table_hash_with_seed(cache->hash_seed, key); \
+        TypeName##_ShardSlot *shard = &cache->shards[function_prefix##_shard_for_hash(hash)]; \
+        int found = 0; \
+        \
+        pthread_rwlock_rdlock(&shard->lock); \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup_with_hash(&shard->tbl, function_prefix##_internal_shard_hash(cache, shard, hash, key), key); \
+        if (item && !item->value.dead) { \
+            if (out_value) \
+                *out_value = item->value.value; \
+            /* racing readers may lose an increment, it's only a hint */ \
+            unsigned char freq = __atomic_load_n(&item->value.freq, __ATOMIC_RELAXED); \
+            if (freq < CACHE_S3FIFO_MAX_FREQ) \
+                __atomic_store_n(&item->value.freq, (unsigned char)(freq + 1), __ATOMIC_RELAXED); \
+            found = 1; \
+        } \
+        pthread_rwlock_unlock(&shard->lock); \
+        \
+        __atomic_fetch_add(found ? &shard->counters.hits : &shard->counters.misses, 1, __ATOMIC_RELAXED); \
+        return found; \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TypeName *cache, TypeName##_ConstKey key) \
+    { \
+        unsigned hash = function_prefix##_table_hash_with_seed(cache->hash_seed, key); \
+        TypeName##_ShardSlot *shard = &cache->shards[function_prefix##_shard_for_hash(hash)]; \
+        \
+        pthread_rwlock_rdlock(&shard->lock); \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup_with_hash(&shard->tbl, function_prefix##_internal_shard_hash(cache, shard, hash, key), key); \
+        int found = item && !item->value.dead; \
+        pthread_rwlock_unlock(&shard->lock); \
+        \
+        return found; \
+    } \
+    \
+    /* removes the item from the table, which frees the key */ \
+    static inline void \
+    function_prefix##_internal_drop(TypeName *cache, TypeName##_ShardSlot *shard, TypeName##_Table_Item *item) \
+    { \
+        if (item->value.dead) { \
+            shard->dead_count--; \
+        } else { \
+            if (cache->evict_func) \
+                cache->evict_func(key_own(VIEW, ~, item->key, ~), &item->value.value, cache->evict_ctx); \
+            value_free_func(item->value.value); \
+            __atomic_fetch_add(&shard->counters.evictions, 1, __ATOMIC_RELAXED); \
+        } \
+        function_prefix##_table_remove(&shard->tbl, key_own(VIEW, ~, item->key, ~)); \
+    } \
+    \
+    /* evicts one entry, the shard must not be empty */ \
+    static inline void \
+    function_prefix##_internal_evict(TypeName *cache, TypeName##_ShardSlot *shard) \
+    { \
+        for (;;) { \
+            if (shard->small.count >= shard->small_capacity || !shard->main.count) { \
+                unsigned i = _cache_ring_pop(&shard->small); \
+                TypeName##_Table_Item *item = &shard->tbl.item_storage[i]; \
+                if (item->value.freq && !item->value.dead) { \
+                    item->value.freq = 0; \
+                    _cache_ring_push(&shard->main, i); \
+                    continue; \
+                } \
+                \
+                if (!item->value.dead) \
+                    shard->ghost[item->hash % shard->capacity] = item->hash | 1u; \
+                function_prefix##_internal_drop(cache, shard, item); \
+                return; \
+            } else { \
+                unsigned i = _cache_ring_pop(&shard->main); \
+                TypeName##_Table_Item *item = &shard->tbl.item_storage[i]; \
+                if (item->value.freq && !item->value.dead) { \
+                    item->value.freq--; \
+                    _cache_ring_push(&shard->main, i); \
+                    continue; \
+                } \
+                \
+                function_prefix##_internal_drop(cache, shard, item); \
+                return; \
+            } \
+        } \
+    } \
+    \
+    static inline int \
+    function_prefix##_put(TypeName *cache, TypeName##_ConstKey key, TypeName##_ConstValue value) \
+    { \
+        unsigned hash = function_prefix##_table_hash_with_seed(cache->hash_seed, key); \
+        TypeName##_ShardSlot *shard = &cache->shards[function_prefix##_shard_for_hash(hash)]; \
+        \
+        pthread_rwlock_wrlock(&shard->lock); \
+        hash = function_prefix##_internal_shard_hash(cache, shard, hash, key); \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup_with_hash(&shard->tbl, hash, key); \
+        if (item) { \
+            if (item->value.dead) { \
+                /* comes back to life in the queue position of the removed entry */ \
+                item->value.dead = 0; \
+                item->value.freq = 0; \
+                shard->dead_count--; \
+            } else { \
+                value_free_func(item->value.value); \
+            } \
+            item->value.value = value_dup_func(value); \
+            pthread_rwlock_unlock(&shard->lock); \
+            return 1; \
+        } \
+        \
+        /* look at the ghosts first, the eviction may overwrite them */ \
+        int seen_before = shard->ghost[hash % shard->capacity] == (hash | 1u); \
+        if (function_prefix##_table_size(&shard->tbl) >= shard->capacity) \
+            function_prefix##_internal_evict(cache, shard); \
+        \
+        /* never grows the table, it was reserved for the capacity */ \
+        int inserted; \
+        item = function_prefix##_table_lookup_or_insert_zero_with_hash(&shard->tbl, hash, key, &inserted); \
+        if (!item) { \
+            pthread_rwlock_unlock(&shard->lock); \
+            return 0; \
+        } \
+        \
+        item->value.value = value_dup_func(value); \
+        unsigned i = (unsigned)(item - shard->tbl.item_storage); \
+        if (seen_before) \
+            _cache_ring_push(&shard->main, i); \
+        else \
+            _cache_ring_push(&shard->small, i); \
+        pthread_rwlock_unlock(&shard->lock); \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_remove(TypeName *cache, TypeName##_ConstKey key) \
+    { \
+        unsigned hash = function_prefix##_table_hash_with_seed(cache->hash_seed, key); \
+        TypeName##_ShardSlot *shard = &cache->shards[function_prefix##_shard_for_hash(hash)]; \
+        int found = 0; \
+        \
+        pthread_rwlock_wrlock(&shard->lock); \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup_with_hash(&shard->tbl, function_prefix##_internal_shard_hash(cache, shard, hash, key), key); \
+        if (item && !item->value.dead) { \
+            value_free_func(item->value.value); \
+            item->value.dead = 1; \
+            shard->dead_count++; \
+            found = 1; \
+        } \
+        pthread_rwlock_unlock(&shard->lock); \
+        \
+        return found; \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity(TypeName *cache) \
+    { \
+        for (unsigned s = 0; s < (1u << (shard_bits)); ++s) { \
+            TypeName##_ShardSlot *shard = &cache->shards[s]; \
+            if (!function_prefix##_table_check_internal_sanity(&shard->tbl)) \
+                return 0; \
+            \
+            unsigned size = function_prefix##_table_size(&shard->tbl); \
+            if (size > shard->capacity || shard->small.count + shard->main.count != size) \
+                return 0; \
+            \
+            unsigned dead = 0; \
+            CacheRing *rings[2] = { &shard->small, &shard->main }; \
+            for (unsigned r = 0; r < 2; ++r) { \
+                for (unsigned n = 0; n < rings[r]->count; ++n) { \
+                    unsigned i = _cache_ring_at(rings[r], n); \
+                    if (i >= shard->tbl.item_storage_used || shard->tbl.item_storage[i].next == (unsigned)-2) \
+                        return 0; \
+                    if (shard->tbl.item_storage[i].value.freq > CACHE_S3FIFO_MAX_FREQ) \
+                        return 0; \
+                    if (function_prefix##_table_lookup(&shard->tbl, key_own(VIEW, ~, shard->tbl.item_storage[i].key, ~)) != &shard->tbl.item_storage[i]) \
+                        return 0; \
+                    dead += shard->tbl.item_storage[i].value.dead; \
+                } \
+            } \
+            \
+            if (dead != shard->dead_count) \
+                return 0; \
+        } \
+        \
+        return 1; \
+    } \
+    \
+
@@ -0,0 +1,456 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+#include "intrusive-list.h"
+
+/* Bounded LRU cache, built from hashtbl2.h and intrusive-list.h
+ *
+ * How-To:
+ *      CACHE_DEFINE_LRU(PageCache, page_cache,
+ *                       HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+ *                       HASHTBL_VALUE_FULL(char *, const char *, str_dup, free))
+ *
+ *      PageCache pc;
+ *      page_cache_init(&pc, 64 << 20);     // at most 64 MiB of pages
+ *
+ *      char **page = page_cache_get(&pc, url);
+ *      if (!page) {
+ *          char *fetched = fetch(url);
+ *          page_cache_put(&pc, url, fetched, strlen(fetched));
+ *          free(fetched);
+ *      }
+ *
+ *      page_cache_clear(&pc);
+ *
+ * The entries live in slabs owned by the cache, so their addresses don't
+ * change, and are linked into a list from most to least recently used. A
+ * hashtbl2.h table maps the keys to the entries. Each entry has a cost,
+ * e.g. its size in bytes or just 1 for a cache bounded by entry count, and
+ * the least recently used entries are evicted when the total cost would
+ * exceed the capacity. Evicted entries and their table items are reused by
+ * the next insert, so once the cache is full, get and put don't allocate
+ * anything except what the key and value dup functions do.
+ *
+ * Limits:
+ *      - not thread safe, see cache-sharded.h for a concurrent cache
+ *      - can't be used with HASHTBL_KEY_STR or HASHTBL_KEY_ARENA, the
+ *        entries refer to the key stored in the table
+ *
+ * Reference Docs:
+ *
+ *      CACHE_DEFINE_LRU(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC)
+ *      CACHE_DEFINE_LRU_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_fun, free_fun)
+ *          Defines the cache type and functions, see HASHTBL_DEFINE for the
+ *          specs. Also defines the TypeName_Table hash table with prefix
+ *          function_prefix_table and the TypeName_List entry list with
+ *          prefix function_prefix_list (see intrusive-list.h), which can be
+ *          used to walk `cache->lru` from the most recently used entry.
+ *          The TypeName_Entry struct contains `key`, `value` and `cost`.
+ *
+ *      void
+ *      function_prefix_init(TypeName *cache, size_t capacity)
+ *          Initializes an empty cache holding entries of up to `capacity`
+ *          total cost.
+ *
+ *      void
+ *      function_prefix_clear(TypeName *cache)
+ *          Frees all entries without calling the eviction callback and
+ *          releases all memory. The capacity, the callback and the
+ *          counters stay, so the cache can be used again right away.
+ *
+ *      void
+ *      function_prefix_set_evict_func(TypeName *cache,
+ *                                     void (*evict_func)(ConstKeyType key, ValueType *value, void *ctx),
+ *                                     void *ctx)
+ *          Sets a function which is called for every entry evicted to make
+ *          room, before the key and value are freed. Not called for
+ *          function_prefix_remove() and function_prefix_clear().
+ *
+ *      void
+ *      function_prefix_set_capacity(TypeName *cache, size_t capacity)
+ *          Changes the capacity, evicting entries if it shrinks.
+ *
+ *      ValueType *
+ *      function_prefix_get(TypeName *cache, ConstKeyType key)
+ *          Returns the value for the key and marks it as most recently used,
+ *          or returns NULL. Counts a hit or a miss. The pointer stays valid
+ *          until the entry is evicted, replaced or removed.
+ *
+ *      ValueType *
+ *      function_prefix_peek(TypeName *cache, ConstKeyType key)
+ *          Like function_prefix_get(), but neither changes the recency order
+ *          nor the counters.
+ *
+ *      int
+ *      function_prefix_contains(TypeName *cache, ConstKeyType key)
+ *
+ *      int
+ *      function_prefix_put(TypeName *cache, ConstKeyType key, ConstValueType value, size_t cost)
+ *          Stores the value as the most recently used entry, replacing the
+ *          value already stored for the key, and evicts least recently used
+ *          entries until the total cost fits the capacity again. Returns 0
+ *          if memory ran out or the cost alone exceeds the capacity; an
+ *          older value for the key is removed in that case.
+ *
+ *      int
+ *      function_prefix_remove(TypeName *cache, ConstKeyType key)
+ *          Removes the entry for the key, returns 1 if there was one.
+ *
+ *      unsigned
+ *      function_prefix_size(TypeName *cache)
+ *      size_t
+ *      function_prefix_cost(TypeName *cache)
+ *      size_t
+ *      function_prefix_capacity(TypeName *cache)
+ *          Number of entries, their total cost and the capacity.
+ *
+ *      CacheCounters
+ *      function_prefix_counters(TypeName *cache)
+ *      void
+ *      function_prefix_reset_counters(TypeName *cache)
+ *          Hits and misses of function_prefix_get(), and the number of
+ *          evicted entries.
+ *
+ *      int
+ *      function_prefix_check_internal_sanity(TypeName *cache)
+ */
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} CacheCounters;
+
+/* fraction of function_prefix_get() calls that were hits */
+static inline double
+cache_counters_hit_ratio(CacheCounters c)
+{
+    return c.hits + c.misses ? (double)c.hits / (double)(c.hits + c.misses) : 0.0;
+}
+
+#define CACHE_DEFINE_LRU(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
+    CACHE__EXPAND_DEFINE_LRU(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+
+#define CACHE_DEFINE_LRU_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
+    CACHE__EXPAND_DEFINE_LRU(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+
+#define CACHE__EXPAND_DEFINE_LRU(...) \
+    CACHE__INTERNAL_DEFINE_LRU(__VA_ARGS__)
+
+#define CACHE__INTERNAL_DEFINE_LRU(TypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+    \
+    typedef struct TypeName##_Entry TypeName##_Entry; \
+    \
+    HASHTBL__INTERNAL_DEFINE(TypeName##_Table, function_prefix##_table, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, \
+                             TypeName##_Entry *, TypeName##_Entry *, /*nop*/, (void), _hashtbl_prime_bucket_count, _hashtbl_prime_index_for_hash, 0, \
+                             reallocarray, free) \
+    \
+    typedef ConstKeyType    TypeName##_ConstKey; \
+    typedef ValueType       TypeName##_Value; \
+    typedef ConstValueType  TypeName##_ConstValue; \
+    struct TypeName##_Entry { \
+        list_link link; /* link.next chains the free entries */ \
+        TypeName##_ConstKey key; /* owned by the table item */ \
+        TypeName##_Value value; \
+        size_t cost; \
+    }; \
+    \
+    DEFINE_INTRUSIVE_LIST(TypeName##_Entry, link, TypeName##_List, function_prefix##_list) \
+    \
+    typedef struct { \
+        TypeName##_Table table; \
+        TypeName##_List lru; /* most recently used first */ \
+        list_link *free_entries; \
+        TypeName##_Entry **slabs; \
+        unsigned slab_count; \
+        unsigned entries_allocated; \
+        size_t capacity; \
+        size_t cost; \
+        CacheCounters counters; \
+        void (*evict_func)(TypeName##_ConstKey key, TypeName##_Value *value, void *ctx); \
+        void *evict_ctx; \
+    } TypeName; \
+    \
+    static inline void \
+    function_prefix##_init(TypeName *cache, size_t capacity) \
+    { \
+        function_prefix##_table_init(&cache->table); \
+        function_prefix##_list_init(&cache->lru); \
+        cache->free_entries = NULL; \
+        cache->slabs = NULL; \
+        cache->slab_count = 0; \
+        cache->entries_allocated = 0; \
+        cache->capacity = capacity; \
+        cache->cost = 0; \
+        memset(&cache->counters, 0, sizeof(cache->counters)); \
+        cache->evict_func = NULL; \
+        cache->evict_ctx = NULL; \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TypeName *cache) \
+    { \
+        TypeName##_Entry *e = NULL; \
+        while (function_prefix##_list_iter(&cache->lru, &e)) \
+            value_free_func(e->value); \
+        \
+        for (unsigned i = 0; i < cache->slab_count; ++i) \
+            free(cache->slabs[i]); \
+        free(cache->slabs); \
+        function_prefix##_table_clear(&cache->table); \
+        \
+        size_t capacity = cache->capacity; \
+        CacheCounters counters = cache->counters; \
+        void (*evict_func)(TypeName##_ConstKey, TypeName##_Value *, void *) = cache->evict_func; \
+        void *evict_ctx = cache->evict_ctx; \
+        function_prefix##_init(cache, capacity); \
+        cache->counters = counters; \
+        cache->evict_func = evict_func; \
+        cache->evict_ctx = evict_ctx; \
+    } \
+    \
+    static inline void \
+    function_prefix##_set_evict_func(TypeName *cache, void (*evict_func)(TypeName##_ConstKey key, TypeName##_Value *value, void *ctx), void *ctx) \
+    { \
+        cache->evict_func = evict_func; \
+        cache->evict_ctx = ctx; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TypeName *cache) \
+    { \
+        return function_prefix##_table_size(&cache->table); \
+    } \
+    \
+    static inline size_t \
+    function_prefix##_cost(TypeName *cache) \
+    { \
+        return cache->cost; \
+    } \
+    \
+    static inline size_t \
+    function_prefix##_capacity(TypeName *cache) \
+    { \
+        return cache->capacity; \
+    } \
+    \
+    static inline CacheCounters \
+    function_prefix##_counters(TypeName *cache) \
+    { \
+        return cache->counters; \
+    } \
+    \
+    static inline void \
+    function_prefix##_reset_counters(TypeName *cache) \
+    { \
+        memset(&cache->counters, 0, sizeof(cache->counters)); \
+    } \
+    \
+    static inline TypeName##_Entry * \
+    function_prefix##_internal_alloc_entry(TypeName *cache) \
+    { \
+        if (!cache->free_entries) { \
+            /* slabs grow with the cache, so there are only logarithmically many */ \
+            unsigned n = cache->entries_allocated < 16 ? 16 : cache->entries_allocated; \
+            if (n > (unsigned)-1 - cache->entries_allocated) \
+                return NULL; \
+            \
+            TypeName##_Entry **slabs = (TypeName##_Entry **)reallocarray(cache->slabs, cache->slab_count + 1, sizeof(TypeName##_Entry *)); \
+            if (!slabs) \
+                return NULL; \
+            cache->slabs = slabs; \
+            \
+            TypeName##_Entry *slab = (TypeName##_Entry *)reallocarray(NULL, n, sizeof(TypeName##_Entry)); \
+            if (!slab) \
+                return NULL; \
+            cache->slabs[cache->slab_count++] = slab; \
+            cache->entries_allocated += n; \
+            \
+            for (unsigned i = n; i-- > 0; ) { \
+                slab[i].link.next = cache->free_entries; \
+                cache->free_entries = &slab[i].link; \
+            } \
+        } \
+        \
+        TypeName##_Entry *e = (TypeName##_Entry *)((char *)cache->free_entries - offsetof(TypeName##_Entry, link)); \
+        cache->free_entries = e->link.next; \
+        return e; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_free_entry(TypeName *cache, TypeName##_Entry *e) \
+    { \
+        e->link.next = cache->free_entries; \
+        cache->free_entries = &e->link; \
+    } \
+    \
+    /* unlinks the entry and frees its value, the key has to be removed from the table afterwards */ \
+    static inline void \
+    function_prefix##_internal_drop(TypeName *cache, TypeName##_Entry *e) \
+    { \
+        function_prefix##_list_remove(e); \
+        cache->cost -= e->cost; \
+        value_free_func(e->value); \
+        function_prefix##_internal_free_entry(cache, e); \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_evict_until(TypeName *cache, size_t max_cost) \
+    { \
+        while (cache->cost > max_cost) { \
+            TypeName##_Entry *e = function_prefix##_list_last(&cache->lru); \
+            if (cache->evict_func) \
+                cache->evict_func(e->key, &e->value, cache->evict_ctx); \
+            \
+            TypeName##_ConstKey key = e->key; \
+            function_prefix##_internal_drop(cache, e); \
+            function_prefix##_table_remove(&cache->table, key); \
+            cache->counters.evictions++; \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_set_capacity(TypeName *cache, size_t capacity) \
+    { \
+        cache->capacity = capacity; \
+        function_prefix##_internal_evict_until(cache, capacity); \
+    } \
+    \
+    static inline TypeName##_Value * \
+    function_prefix##_peek(TypeName *cache, TypeName##_ConstKey key) \
+    { \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup(&cache->table, key); \
+        return item ? &item->value->value : NULL; \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TypeName *cache, TypeName##_ConstKey key) \
+    { \
+        return function_prefix##_table_contains(&cache->table, key); \
+    } \
+    \
+    static inline TypeName##_Value * \
+    function_prefix##_get(TypeName *cache, TypeName##_ConstKey key) \
+    { \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup(&cache->table, key); \
+        if (!item) { \
+            cache->counters.misses++; \
+            return NULL; \
+        } \
+        \
+        TypeName##_Entry *e = item->value; \
+        if (cache->lru.link.next != &e->link) { \
+            function_prefix##_list_remove(e); \
+            function_prefix##_list_insert_front(&cache->lru, e); \
+        } \
+        cache->counters.hits++; \
+        return &e->value; \
+    } \
+    \
+    static inline int \
+    function_prefix##_remove(TypeName *cache, TypeName##_ConstKey key) \
+    { \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup(&cache->table, key); \
+        if (!item) \
+            return 0; \
+        \
+        function_prefix##_internal_drop(cache, item->value); \
+        function_prefix##_table_remove(&cache->table, key); \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_put(TypeName *cache, TypeName##_ConstKey key, TypeName##_ConstValue value, size_t cost) \
+    { \
+        if (cost > cache->capacity) { \
+            function_prefix##_remove(cache, key); \
+            return 0; \
+        } \
+        \
+        TypeName##_Table_Item *item = function_prefix##_table_lookup(&cache->table, key); \
+        if (item) { \
+            TypeName##_Entry *e = item->value; \
+            value_free_func(e->value); \
+            e->value = value_dup_func(value); \
+            cache->cost = cache->cost - e->cost + cost; \
+            e->cost = cost; \
+            function_prefix##_list_remove(e); \
+            function_prefix##_list_insert_front(&cache->lru, e); \
+            \
+            /* never reaches e, its cost alone fits */ \
+            function_prefix##_internal_evict_until(cache, cache->capacity); \
+            return 1; \
+        } \
+        \
+        /* evict first, so the new entry can reuse the memory */ \
+        function_prefix##_internal_evict_until(cache, cache->capacity - cost); \
+        \
+        TypeName##_Entry *e = function_prefix##_internal_alloc_entry(cache); \
+        if (!e) \
+            return 0; \
+        \
+        int inserted; \
+        item = function_prefix##_table_lookup_or_insert_zero(&cache->table, key, &inserted); \
+        if (!item) { \
+            function_prefix##_internal_free_entry(cache, e); \
+            return 0; \
+        } \
+        \
+        item->value = e; \
+        e->key = item->key; \
+        e->value = value_dup_func(value); \
+        e->cost = cost; \
+        cache->cost += cost; \
+        function_prefix##_list_insert_front(&cache->lru, e); \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity(TypeName *cache) \
+    { \
+        if (!function_prefix##_table_check_internal_sanity(&cache->table)) \
+            return 0; \
+        \
+        unsigned count = 0; \
+        size_t cost = 0; \
+        TypeName##_Entry *e = NULL; \
+        while (function_prefix##_list_iter(&cache->lru, &e)) { \
+            TypeName##_Table_Item *item = function_prefix##_table_lookup(&cache->table, e->key); \
+            if (!item || item->value != e) \
+                return 0; \
+            if (++count > function_prefix##_table_size(&cache->table)) \
+                return 0; \
+            cost += e->cost; \
+        } \
+        \
+        unsigned free_count = 0; \
+        for (list_link *l = cache->free_entries; l; l = l->next) \
+            if (++free_count > cache->entries_allocated) \
+                return 0; \
+        \
+        return count == function_prefix##_table_size(&cache->table) \
+            && count + free_count == cache->entries_allocated \
+            && cost == cache->cost \
+            && cost <= cache->capacity; \
+    } \
+    \
+
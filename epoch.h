@@ -0,0 +1,247 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+
+/* Epoch based memory reclamation
+ *
+ * Lets lock-free readers access shared data while writers replace it,
+ * deferring the free() of unlinked memory until no reader can hold a pointer
+ * to it any more.
+ *
+ * How-To:
+ *      typedef struct Config {
+ *          EpochRetired retired; // must be the first member
+ *          ...
+ *      } Config;
+ *
+ *      static void free_config(EpochRetired *r) { free((Config *)r); }
+ *
+ *      EpochDomain domain;
+ *      epoch_init(&domain);
+ *
+ *      // every reader thread
+ *      EpochThread self;
+ *      epoch_thread_register(&domain, &self);
+ *      epoch_read_lock(&domain, &self);
+ *      Config *c = __atomic_load_n(&current_config, __ATOMIC_ACQUIRE);
+ *      ... use c ...
+ *      epoch_read_unlock(&domain, &self);
+ *      epoch_thread_unregister(&domain, &self);
+ *
+ *      // writer
+ *      Config *old = current_config;
+ *      __atomic_store_n(&current_config, new_config, __ATOMIC_RELEASE);
+ *      epoch_retire(&domain, &old->retired, free_config);
+ *      epoch_collect(&domain);
+ *
+ * Readers only ever write their own EpochThread, which sits on a cache line
+ * of its own, and read the global epoch counter, which changes once per
+ * epoch_collect(). Read sections can't be nested.
+ *
+ * Reference Docs:
+ *
+ *      void
+ *      epoch_init(EpochDomain *d)
+ *      void
+ *      epoch_clear(EpochDomain *d)
+ *          epoch_clear() frees all retired memory immediately, so there must
+ *          not be any active readers.
+ *
+ *      void
+ *      epoch_thread_register(EpochDomain *d, EpochThread *t)
+ *      void
+ *      epoch_thread_unregister(EpochDomain *d, EpochThread *t)
+ *          Every reader thread needs its own EpochThread, registered before
+ *          its first read section. It must stay valid until it is unregistered.
+ *
+ *      void
+ *      epoch_read_lock(EpochDomain *d, EpochThread *t)
+ *      void
+ *      epoch_read_unlock(EpochDomain *d, EpochThread *t)
+ *          Begins/ends a read section. Memory retired after the read section
+ *          began is not freed before it ends.
+ *
+ *      void
+ *      epoch_retire(EpochDomain *d, EpochRetired *entry, void (*free_func)(EpochRetired *entry))
+ *          Schedules `entry` to be freed with free_func() once no reader can
+ *          see it any more. The memory must already be unreachable for new
+ *          readers.
+ *
+ *      unsigned
+ *      epoch_collect(EpochDomain *d)
+ *          Advances the epoch and frees everything no reader can see any more.
+ *          Never blocks on readers. Returns the number of entries still pending.
+ *
+ *      void
+ *      epoch_barrier(EpochDomain *d)
+ *          Waits until all retired memory has been freed. Must not be called
+ *          from within a read section.
+ */
+
+#ifdef __GNUC__
+#   define EPOCH__CACHELINE_ALIGNED __attribute__((aligned(64)))
+#else
+#   define EPOCH__CACHELINE_ALIGNED
+#endif
+
+typedef struct EpochRetired {
+    struct EpochRetired *next;
+    unsigned long epoch;
+    void (*free_func)(struct EpochRetired *entry);
+} EpochRetired;
+
+typedef struct EpochThread {
+    unsigned long epoch EPOCH__CACHELINE_ALIGNED; // 0 when outside of a read section
+    struct EpochThread *next;
+} EpochThread;
+
+typedef struct {
+    unsigned long global_epoch;
+    pthread_mutex_t lock;
+    EpochThread *threads;
+    EpochRetired *retired;
+} EpochDomain;
+
+static inline void
+epoch_init(EpochDomain *d)
+{
+    d->global_epoch = 1;
+    pthread_mutex_init(&d->lock, NULL);
+    d->threads = NULL;
+    d->retired = NULL;
+}
+
+static inline void
+epoch_clear(EpochDomain *d)
+{
+    EpochRetired *r = d->retired;
+    while (r) {
+        EpochRetired *next = r->next;
+        r->free_func(r);
+        r = next;
+    }
+
+    pthread_mutex_destroy(&d->lock);
+    epoch_init(d);
+}
+
+static inline void
+epoch_thread_register(EpochDomain *d, EpochThread *t)
+{
+    t->epoch = 0;
+
+    pthread_mutex_lock(&d->lock);
+    t->next = d->threads;
+    d->threads = t;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static inline void
+epoch_thread_unregister(EpochDomain *d, EpochThread *t)
+{
+    pthread_mutex_lock(&d->lock);
+    for (EpochThread **link = &d->threads; *link; link = &(*link)->next) {
+        if (*link == t) {
+            *link = t->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+static inline void
+epoch_read_lock(EpochDomain *d, EpochThread *t)
+{
+    __atomic_store_n(&t->epoch, __atomic_load_n(&d->global_epoch, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+    // the epoch must be visible to writers before we load any shared pointer
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void
+epoch_read_unlock(EpochDomain *d, EpochThread *t)
+{
+    (void)d;
+    __atomic_store_n(&t->epoch, 0, __ATOMIC_RELEASE);
+}
+
+static inline void
+epoch_retire(EpochDomain *d, EpochRetired *entry, void (*free_func)(EpochRetired *entry))
+{
+    entry->free_func = free_func;
+
+    pthread_mutex_lock(&d->lock);
+    entry->epoch = __atomic_load_n(&d->global_epoch, __ATOMIC_RELAXED);
+    entry->next = d->retired;
+    d->retired = entry;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static inline unsigned
+epoch_collect(EpochDomain *d)
+{
+    EpochRetired *reclaim = NULL;
+    unsigned pending = 0;
+
+    pthread_mutex_lock(&d->lock);
+
+    // readers which enter from now on can't see anything retired so far
+    unsigned long oldest = __atomic_add_fetch(&d->global_epoch, 1, __ATOMIC_SEQ_CST);
+
+    for (EpochThread *t = d->threads; t; t = t->next) {
+        unsigned long e = __atomic_load_n(&t->epoch, __ATOMIC_SEQ_CST);
+        if (e && e < oldest)
+            oldest = e;
+    }
+
+    EpochRetired **link = &d->retired;
+    while (*link) {
+        EpochRetired *r = *link;
+        if (r->epoch < oldest) {
+            *link = r->next;
+            r->next = reclaim;
+            reclaim = r;
+        } else {
+            link = &r->next;
+            ++pending;
+        }
+    }
+
+    pthread_mutex_unlock(&d->lock);
+
+    while (reclaim) {
+        EpochRetired *next = reclaim->next;
+        reclaim->free_func(reclaim);
+        reclaim = next;
+    }
+
+    return pending;
+}
+
+static inline void
+epoch_barrier(EpochDomain *d)
+{
+    while (epoch_collect(d))
+        sched_yield();
+}
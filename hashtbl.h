@@ -23,6 +23,40 @@
 #include <stddef.h>
 #include <string.h>
 
+/* HASHTBL_DEFINE_4() takes a bucket sizing policy as its last argument:
+ *
+ *      HASHTBL_SIZING_PRIME
+ *          The default. Prime bucket counts, the index is computed with a modulo.
+ *      HASHTBL_SIZING_POW2
+ *          Power-of-two bucket counts, the index is taken from the high bits
+ *          of a multiplicative (Fibonacci) hash. Avoids the integer division.
+ */
+#define HASHTBL_SIZING_PRIME \
+    _hashtbl_prime_bucket_count, _hashtbl_prime_index_for_hash
+
+#define HASHTBL_SIZING_POW2 \
+    _hashtbl_pow2_bucket_count, _hashtbl_pow2_index_for_hash
+
+/* function_prefix_stats(TblTypeName tbl, HashtblStats *out) reports the
+ * structure of a table: load factor, chain lengths and memory use. Items are
+ * allocated one by one, so there never is a free list. */
+#define HASHTBL_STATS_HISTOGRAM 16
+
+typedef struct {
+    unsigned element_count;
+    unsigned bucket_count;
+    double load_factor;         /* elements per bucket */
+    unsigned longest_chain;
+    unsigned empty_buckets;
+    double empty_bucket_ratio;
+    /* number of buckets with a chain of length i, the last entry also
+     * counts all longer chains */
+    unsigned chain_histogram[HASHTBL_STATS_HISTOGRAM];
+    unsigned freelist_length;
+    size_t bucket_bytes;
+    size_t item_bytes;
+} HashtblStats;
+
 #define HASHTBL_DEFINE(TblTypeName, function_prefix, KeyType, ValueType, key_hash_func, key_equal_func) \
     HASHTBL_DEFINE_2(TblTypeName, function_prefix, KeyType, KeyType, /* nop */,(void), ValueType, ValueType, /* nop */, (void), key_hash_func, key_equal_func)
 
@@ -30,6 +64,16 @@
     HASHTBL_DEFINE_3(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, ValueType, ConstValueType, value_dup_func, value_free_func, key_hash_func, key_equal_func, realloc, free)
 
 #define HASHTBL_DEFINE_3(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, ValueType, ConstValueType, value_dup_func, value_free_func, key_hash_func, key_equal_func, realloc, free) \
+    HASHTBL_DEFINE_4(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, ValueType, ConstValueType, value_dup_func, value_free_func, key_hash_func, key_equal_func, realloc, free, HASHTBL_SIZING_PRIME)
+
+#define HASHTBL_DEFINE_4(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, ValueType, ConstValueType, value_dup_func, value_free_func, key_hash_func, key_equal_func, realloc, free, SIZING_SPEC) \
+    HASHTBL__EXPAND_DEFINE(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, ValueType, ConstValueType, value_dup_func, value_free_func, key_hash_func, key_equal_func, realloc, free, SIZING_SPEC)
+
+/* expands the sizing spec into its arguments before they are counted */
+#define HASHTBL__EXPAND_DEFINE(...) \
+    HASHTBL__INTERNAL_DEFINE(__VA_ARGS__)
+
+#define HASHTBL__INTERNAL_DEFINE(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, ValueType, ConstValueType, value_dup_func, value_free_func, key_hash_func, key_equal_func, realloc, free, bucket_count_func, index_for_hash_func) \
     \
     typedef KeyType         TblTypeName##_Key; \
     typedef ConstKeyType    TblTypeName##_ConstKey; \
@@ -51,11 +95,11 @@
     function_prefix##_create(void) \
     { \
         /* FIXME! check overflow */ \
-        TblTypeName rv = (TblTypeName)realloc(NULL, sizeof(*rv) + sizeof(rv->items[0]) * _hashtbl_size_map[0]); \
+        TblTypeName rv = (TblTypeName)realloc(NULL, sizeof(*rv) + sizeof(rv->items[0]) * bucket_count_func(0)); \
         if (rv) { \
             rv->element_count = 0; \
             rv->table_size = 0; \
-            for (size_t i = 0; i < _hashtbl_size_map[rv->table_size]; ++i) \
+            for (size_t i = 0; i < bucket_count_func(rv->table_size); ++i) \
                 rv->items[i] = NULL; \
         } \
         return rv; \
@@ -64,7 +108,7 @@
     static inline void \
     function_prefix##_free(TblTypeName tbl) \
     { \
-        for (size_t i = 0; i < _hashtbl_size_map[tbl->table_size]; ++i) { \
+        for (size_t i = 0; i < bucket_count_func(tbl->table_size); ++i) { \
             TblTypeName##_Item *tmp = tbl->items[i]; \
             TblTypeName##_Item *next = NULL; \
             while (tmp) { \
@@ -80,7 +124,7 @@
     static inline size_t \
     function_prefix##_index_for_hash(TblTypeName tbl, unsigned hash) \
     { \
-        return ((size_t)hash * 11) % _hashtbl_size_map[tbl->table_size]; \
+        return index_for_hash_func(hash, tbl->table_size); \
     } \
     \
     static inline TblTypeName##_Item ** \
@@ -118,7 +162,7 @@
     static inline void \
     function_prefix##_reposition_items(TblTypeName tbl, size_t old_table_size) \
     { \
-        for (size_t i = 0; i < _hashtbl_size_map[old_table_size]; ++i) { \
+        for (size_t i = 0; i < bucket_count_func(old_table_size); ++i) { \
             TblTypeName##_Item *tmp = tbl->items[i]; \
             TblTypeName##_Item *next = NULL; \
             tbl->items[i] = NULL; \
@@ -138,18 +182,18 @@
     function_prefix##_auto_grow(TblTypeName *ptbl) \
     { \
         size_t target_table_size = (*ptbl)->table_size; \
-        while (target_table_size < sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0])  \
-                &&  (*ptbl)->element_count > _hashtbl_size_map[target_table_size] - _hashtbl_size_map[target_table_size]/4) \
+        while (target_table_size < HASHTBL__SIZE_STEPS  \
+                &&  (*ptbl)->element_count > bucket_count_func(target_table_size) - bucket_count_func(target_table_size)/4) \
             target_table_size++; \
         \
         if (target_table_size != (*ptbl)->table_size) { \
             size_t old_table_size = (*ptbl)->table_size; \
             /* FIXME: handle overflow */ \
-            TblTypeName tmp = (TblTypeName)realloc(*ptbl, sizeof(**ptbl) + sizeof(TblTypeName##_Item) * _hashtbl_size_map[target_table_size]); \
+            TblTypeName tmp = (TblTypeName)realloc(*ptbl, sizeof(**ptbl) + sizeof(TblTypeName##_Item) * bucket_count_func(target_table_size)); \
             if (tmp) { \
                 *ptbl = tmp; \
                 (*ptbl)->table_size = target_table_size; \
-                for (size_t i = _hashtbl_size_map[old_table_size]; i < _hashtbl_size_map[target_table_size]; ++i) \
+                for (size_t i = bucket_count_func(old_table_size); i < bucket_count_func(target_table_size); ++i) \
                     (*ptbl)->items[i] = NULL; \
                 \
                 function_prefix##_reposition_items(*ptbl, old_table_size); \
@@ -161,7 +205,7 @@
     function_prefix##_auto_shrink(TblTypeName *ptbl) \
     { \
         size_t target_table_size = (*ptbl)->table_size; \
-        while (target_table_size > 0 && (*ptbl)->element_count < _hashtbl_size_map[target_table_size]/4) \
+        while (target_table_size > 0 && (*ptbl)->element_count < bucket_count_func(target_table_size)/4) \
             target_table_size--; \
         \
         if (target_table_size != (*ptbl)->table_size) { \
@@ -169,7 +213,7 @@
             (*ptbl)->table_size = target_table_size; \
             function_prefix##_reposition_items(*ptbl, old_table_size); \
             /* FIXME: handle overflow */ \
-            TblTypeName tmp = (TblTypeName)realloc(*ptbl, sizeof(**ptbl) + sizeof(TblTypeName##_Item) * _hashtbl_size_map[target_table_size]); \
+            TblTypeName tmp = (TblTypeName)realloc(*ptbl, sizeof(**ptbl) + sizeof(TblTypeName##_Item) * bucket_count_func(target_table_size)); \
             if (tmp) \
                 *ptbl = tmp; \
         } \
@@ -259,11 +303,39 @@
         } \
     } \
     \
+    static inline void \
+    function_prefix##_stats(TblTypeName tbl, HashtblStats *out) \
+    { \
+        memset(out, 0, sizeof(*out)); \
+        out->element_count = (unsigned)tbl->element_count; \
+        out->bucket_count = (unsigned)bucket_count_func(tbl->table_size); \
+        \
+        for (size_t i = 0; i < bucket_count_func(tbl->table_size); ++i) { \
+            unsigned length = 0; \
+            for (TblTypeName##_Item *item = tbl->items[i]; item; item = item->next) \
+                length++; \
+            \
+            if (!length) \
+                out->empty_buckets++; \
+            if (length > out->longest_chain) \
+                out->longest_chain = length; \
+            out->chain_histogram[length < HASHTBL_STATS_HISTOGRAM ? length : HASHTBL_STATS_HISTOGRAM - 1]++; \
+        } \
+        \
+        out->bucket_bytes = sizeof(*tbl) + bucket_count_func(tbl->table_size) * sizeof(tbl->items[0]); \
+        out->item_bytes = tbl->element_count * sizeof(TblTypeName##_Item); \
+        \
+        if (out->bucket_count) { \
+            out->load_factor = (double)out->element_count / out->bucket_count; \
+            out->empty_bucket_ratio = (double)out->empty_buckets / out->bucket_count; \
+        } \
+    } \
+    \
     static inline int \
     function_prefix##_check_internal_sanity(TblTypeName tbl) \
     { \
         size_t elcount = 0; \
-        for (size_t i = 0; i < _hashtbl_size_map[tbl->table_size]; ++i) { \
+        for (size_t i = 0; i < bucket_count_func(tbl->table_size); ++i) { \
             TblTypeName##_Item *item = tbl->items[i]; \
             while (item) { \
                 elcount++; \
@@ -278,11 +350,11 @@
         if (elcount != tbl->element_count) \
             return 0; \
         \
-        if (_hashtbl_size_map[tbl->table_size] - _hashtbl_size_map[tbl->table_size]/4 < elcount \
-                && tbl->table_size < sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0]) - 1) \
+        if (bucket_count_func(tbl->table_size) - bucket_count_func(tbl->table_size)/4 < elcount \
+                && tbl->table_size < HASHTBL__SIZE_STEPS - 1) \
             return 0; \
         \
-        if (_hashtbl_size_map[tbl->table_size]/4 > elcount && tbl->table_size != 0) \
+        if (bucket_count_func(tbl->table_size)/4 > elcount && tbl->table_size != 0) \
             return 0; \
         \
         return 1; \
@@ -319,3 +391,30 @@ static const size_t _hashtbl_size_map[] = {
     805306457,
     1610612741
 };
+
+#define HASHTBL__SIZE_STEPS (sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0]))
+
+static inline size_t
+_hashtbl_prime_bucket_count(size_t size_idx)
+{
+    return _hashtbl_size_map[size_idx];
+}
+
+static inline size_t
+_hashtbl_prime_index_for_hash(unsigned hash, size_t size_idx)
+{
+    return ((size_t)hash * 11) % _hashtbl_size_map[size_idx];
+}
+
+/* same number of steps as the prime ladder: 64 ... 2^31 buckets */
+static inline size_t
+_hashtbl_pow2_bucket_count(size_t size_idx)
+{
+    return (size_t)64 << size_idx;
+}
+
+static inline size_t
+_hashtbl_pow2_index_for_hash(unsigned hash, size_t size_idx)
+{
+    return ((hash * 2654435769u) & 0xffffffffu) >> (26 - size_idx);
+}
@@ -0,0 +1,491 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define HASHTBL_FLAT__HAVE_SSE2 1
+#endif
+
+/* Open-addressing variant of the hashtbl2.h hash map
+ *
+ * The interface is the same as for HASHTBL_DEFINE, so an existing table can
+ * be switched over by replacing HASHTBL_DEFINE with HASHTBL_DEFINE_FLAT:
+ *
+ *      HASHTBL_DEFINE_FLAT(MyTable, my_table,
+ *                          HASHTBL_KEY(const char *, str_hash, str_equal),
+ *                          HASHTBL_VALUE(int))
+ *
+ * Items live directly in the slot array. Next to it, there is one control
+ * byte per slot which is either EMPTY, DELETED or holds 7 bits of the
+ * (mixed) hash value. Lookups scan the control bytes of 16 slots at once
+ * (using SSE2 if available), so most misses are resolved without touching
+ * the item or key memory at all.
+ *
+ * Limits:
+ *      - only supports up to 2^31 slots
+ *      - item pointers are potentially invalid after adding more elements
+ *      - will never shrink when removing elements
+ *      - not safe against algorithmic complexity attacks
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_FLAT(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC)
+ *      HASHTBL_DEFINE_FLAT_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_fun, free_fun)
+ *          Like HASHTBL_DEFINE and HASHTBL_DEFINE_FULL from hashtbl2.h.
+ *
+ *      The following functions from hashtbl2.h are available with the same
+ *      semantics:
+ *
+ *          init, init_reserve, clear, size, hash, hash_with_seed,
+ *          lookup, lookup_with_hash, contains, set, set_zero,
+ *          lookup_or_insert_zero, lookup_or_insert_zero_with_hash, remove,
+ *          iterator_init, iterator_at_end, iterator_item, iterator_next,
+ *          iterator_delete, check_internal_sanity
+ *
+ *      The TypeName_Item struct contains `hash`, `key` and `value` members.
+ *      Keys are always copied with the dup function of the KEY_SPEC, so
+ *      HASHTBL_KEY_ARENA is not supported, and neither are alternative key
+ *      types.
+ */
+
+#define HASHTBL_FLAT_GROUP_SIZE 16u
+
+#define HASHTBL_FLAT__EMPTY   ((unsigned char)0x80)
+#define HASHTBL_FLAT__DELETED ((unsigned char)0xFE)
+
+/* returns a bit mask of all slots in the group which have the given control byte */
+static inline unsigned
+_hashtbl_flat_group_match(const unsigned char *group, unsigned char ctrl)
+{
+#ifdef HASHTBL_FLAT__HAVE_SSE2
+    __m128i g = _mm_loadu_si128((const __m128i *)(const void *)group);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)ctrl)));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < HASHTBL_FLAT_GROUP_SIZE; ++i) {
+        if (group[i] == ctrl)
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+/* returns a bit mask of all slots in the group which are EMPTY or DELETED */
+static inline unsigned
+_hashtbl_flat_group_match_free(const unsigned char *group)
+{
+#ifdef HASHTBL_FLAT__HAVE_SSE2
+    return (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(const void *)group));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < HASHTBL_FLAT_GROUP_SIZE; ++i) {
+        if (group[i] & 0x80)
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+static inline unsigned
+_hashtbl_flat_lowest_bit(unsigned mask)
+{
+#ifdef __GNUC__
+    return (unsigned)__builtin_ctz(mask);
+#else
+    unsigned i = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static inline unsigned char
+_hashtbl_flat_ctrl_for_hash(unsigned hash)
+{
+    return (unsigned char)(_hashtbl_mix(hash) >> 25);
+}
+
+#define HASHTBL_DEFINE_FLAT(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
+    HASHTBL__INTERNAL_DEFINE_FLAT(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+
+#define HASHTBL_DEFINE_FLAT_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
+    HASHTBL__INTERNAL_DEFINE_FLAT(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+
+#define HASHTBL__INTERNAL_DEFINE_FLAT(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+    \
+    typedef KeyType         TblTypeName##_Key; \
+    typedef ConstKeyType    TblTypeName##_ConstKey; \
+    typedef ValueType       TblTypeName##_Value; \
+    typedef ConstValueType  TblTypeName##_ConstValue; \
+    typedef struct TblTypeName##_Item { \
+        unsigned hash; \
+        TblTypeName##_Key   key; \
+        TblTypeName##_Value value; \
+    } TblTypeName##_Item; \
+    typedef struct { \
+        unsigned element_count; \
+        unsigned deleted_count; \
+        unsigned capacity; \
+        unsigned char *ctrl; \
+        TblTypeName##_Item *item_storage; \
+        uint64_t hash_seed; \
+    } TblTypeName; \
+    \
+    static inline void \
+    function_prefix##_init(TblTypeName *tbl) \
+    { \
+        tbl->hash_seed = key_hash_call(HASHTBL__USES_SEED, 0, 0) ? _hashtbl_random_seed(tbl) : 0; \
+        tbl->element_count = 0; \
+        tbl->deleted_count = 0; \
+        tbl->capacity = 0; \
+        tbl->ctrl = NULL; \
+        tbl->item_storage = NULL; \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TblTypeName *tbl) \
+    { \
+        for (unsigned i = 0; i < tbl->capacity; ++i) { \
+            if (tbl->ctrl[i] & 0x80) \
+                continue; \
+            \
+            key_free_func(tbl->item_storage[i].key); \
+            value_free_func(tbl->item_storage[i].value); \
+        } \
+        \
+        free(tbl->item_storage); \
+        free(tbl->ctrl); \
+        function_prefix##_init(tbl); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TblTypeName *tbl) \
+    { \
+        return tbl->element_count; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_hash_with_seed(uint64_t seed, TblTypeName##_ConstKey key) \
+    { \
+        return key_hash_call(key_hash_func, key, seed); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_hash(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_hash_with_seed(tbl->hash_seed, key); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_group_for_hash(TblTypeName *tbl, unsigned hash) \
+    { \
+        return _hashtbl_mix(hash) & (tbl->capacity / HASHTBL_FLAT_GROUP_SIZE - 1); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_find(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        if (!tbl->capacity) \
+            return (unsigned)-1; \
+        \
+        unsigned group_mask = tbl->capacity / HASHTBL_FLAT_GROUP_SIZE - 1; \
+        unsigned char ctrl = _hashtbl_flat_ctrl_for_hash(hash); \
+        unsigned group_i = function_prefix##_internal_group_for_hash(tbl, hash); \
+        for (unsigned step = 1; step <= group_mask + 1; ++step) { \
+            const unsigned char *group = &tbl->ctrl[group_i * HASHTBL_FLAT_GROUP_SIZE]; \
+            unsigned match = _hashtbl_flat_group_match(group, ctrl); \
+            while (match) { \
+                unsigned item_i = group_i * HASHTBL_FLAT_GROUP_SIZE + _hashtbl_flat_lowest_bit(match); \
+                if (tbl->item_storage[item_i].hash == hash && key_equal_func(tbl->item_storage[item_i].key, key)) \
+                    return item_i; \
+                \
+                match &= match - 1; \
+            } \
+            \
+            if (_hashtbl_flat_group_match(group, HASHTBL_FLAT__EMPTY)) \
+                return (unsigned)-1; \
+            \
+            group_i = (group_i + step) & group_mask; \
+        } \
+        \
+        return (unsigned)-1; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_find_free(TblTypeName *tbl, unsigned hash) \
+    { \
+        unsigned group_mask = tbl->capacity / HASHTBL_FLAT_GROUP_SIZE - 1; \
+        unsigned group_i = function_prefix##_internal_group_for_hash(tbl, hash); \
+        for (unsigned step = 1; step <= group_mask + 1; ++step) { \
+            unsigned match = _hashtbl_flat_group_match_free(&tbl->ctrl[group_i * HASHTBL_FLAT_GROUP_SIZE]); \
+            if (match) \
+                return group_i * HASHTBL_FLAT_GROUP_SIZE + _hashtbl_flat_lowest_bit(match); \
+            \
+            group_i = (group_i + step) & group_mask; \
+        } \
+        \
+        return (unsigned)-1; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        unsigned item_i = function_prefix##_internal_find(tbl, hash, key); \
+        return item_i != (unsigned)-1 ? &tbl->item_storage[item_i] : NULL; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup_with_hash(tbl, function_prefix##_hash(tbl, key), key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup(tbl, key) != NULL; \
+    } \
+    \
+    static inline int \
+    function_prefix##_internal_rehash(TblTypeName *tbl, unsigned num_items) \
+    { \
+        unsigned new_capacity = HASHTBL_FLAT_GROUP_SIZE; \
+        while (num_items > new_capacity - new_capacity/8) { \
+            if (new_capacity >= 0x80000000u) \
+                return 0; \
+            new_capacity *= 2; \
+        } \
+        \
+        unsigned char *new_ctrl = (unsigned char *)reallocarray(NULL, new_capacity, 1); \
+        TblTypeName##_Item *new_items = (TblTypeName##_Item *)reallocarray(NULL, new_capacity, sizeof(TblTypeName##_Item)); \
+        if (!new_ctrl || !new_items) { \
+            free(new_ctrl); \
+            free(new_items); \
+            return 0; \
+        } \
+        memset(new_ctrl, HASHTBL_FLAT__EMPTY, new_capacity); \
+        \
+        TblTypeName old = *tbl; \
+        tbl->capacity = new_capacity; \
+        tbl->ctrl = new_ctrl; \
+        tbl->item_storage = new_items; \
+        tbl->deleted_count = 0; \
+        \
+        for (unsigned i = 0; i < old.capacity; ++i) { \
+            if (old.ctrl[i] & 0x80) \
+                continue; \
+            \
+            unsigned item_i = function_prefix##_internal_find_free(tbl, old.item_storage[i].hash); \
+            tbl->ctrl[item_i] = old.ctrl[i]; \
+            memcpy(&tbl->item_storage[item_i], &old.item_storage[i], sizeof(TblTypeName##_Item)); \
+        } \
+        \
+        free(old.ctrl); \
+        free(old.item_storage); \
+        return 1; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_or_insert_zero_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key, int *inserted) \
+    { \
+        if (inserted) \
+            *inserted = 0; \
+        \
+        TblTypeName##_Item *item = function_prefix##_lookup_with_hash(tbl, hash, key); \
+        if (item) \
+            return item; \
+        \
+        unsigned item_i = tbl->capacity ? function_prefix##_internal_find_free(tbl, hash) : (unsigned)-1; \
+        if (item_i == (unsigned)-1 \
+                || (tbl->ctrl[item_i] == HASHTBL_FLAT__EMPTY \
+                    && tbl->element_count + tbl->deleted_count + 1 > tbl->capacity - tbl->capacity/8)) { \
+            /* clean out the tombstones at the same size only if there are enough \
+               of them, otherwise a table near full load would be rebuilt for \
+               every few inserts */ \
+            unsigned num_items = tbl->deleted_count >= tbl->capacity/16 \
+                    ? tbl->capacity - tbl->capacity/8 \
+                    : tbl->capacity; \
+            if (function_prefix##_internal_rehash(tbl, num_items)) \
+                item_i = function_prefix##_internal_find_free(tbl, hash); \
+            else if (item_i == (unsigned)-1) \
+                return NULL; \
+        } \
+        \
+        if (tbl->ctrl[item_i] == HASHTBL_FLAT__DELETED) \
+            tbl->deleted_count--; \
+        tbl->ctrl[item_i] = _hashtbl_flat_ctrl_for_hash(hash); \
+        tbl->item_storage[item_i].hash = hash; \
+        tbl->item_storage[item_i].key = key_dup_func(key); \
+        memset(&tbl->item_storage[item_i].value, 0, sizeof tbl->item_storage[item_i].value); \
+        tbl->element_count++; \
+        if (inserted) \
+            *inserted = 1; \
+        return &tbl->item_storage[item_i]; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_or_insert_zero(TblTypeName *tbl, TblTypeName##_ConstKey key, int *inserted) \
+    { \
+        return function_prefix##_lookup_or_insert_zero_with_hash(tbl, function_prefix##_hash(tbl, key), key, inserted); \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set_zero(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        int inserted; \
+        TblTypeName##_Item *item = function_prefix##_lookup_or_insert_zero(tbl, key, &inserted); \
+        if (item && !inserted) { \
+            value_free_func((item)->value); \
+            memset(&item->value, 0, sizeof(item->value)); \
+        } \
+        return item; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set(TblTypeName *ptbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        TblTypeName##_Item *item = function_prefix##_set_zero(ptbl, key); \
+        if (item) { \
+            item->value = value_dup_func(value); \
+        } \
+        return item; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_dealloc_item(TblTypeName *tbl, unsigned item_i) \
+    { \
+        key_free_func(tbl->item_storage[item_i].key); \
+        value_free_func(tbl->item_storage[item_i].value); \
+        \
+        /* If the group still has an empty slot, it has never been full and \
+           no probe sequence can have skipped over it: no tombstone needed */ \
+        unsigned group_i = item_i / HASHTBL_FLAT_GROUP_SIZE; \
+        if (_hashtbl_flat_group_match(&tbl->ctrl[group_i * HASHTBL_FLAT_GROUP_SIZE], HASHTBL_FLAT__EMPTY)) { \
+            tbl->ctrl[item_i] = HASHTBL_FLAT__EMPTY; \
+        } else { \
+            tbl->ctrl[item_i] = HASHTBL_FLAT__DELETED; \
+            tbl->deleted_count++; \
+        } \
+        tbl->element_count--; \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        unsigned item_i = function_prefix##_internal_find(tbl, function_prefix##_hash(tbl, key), key); \
+        if (item_i != (unsigned)-1) \
+            function_prefix##_internal_dealloc_item(tbl, item_i); \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity(TblTypeName *tbl) \
+    { \
+        unsigned elcount = 0; \
+        unsigned delcount = 0; \
+        for (unsigned i = 0; i < tbl->capacity; ++i) { \
+            if (tbl->ctrl[i] == HASHTBL_FLAT__DELETED) { \
+                delcount++; \
+                continue; \
+            } else if (tbl->ctrl[i] & 0x80) { \
+                if (tbl->ctrl[i] != HASHTBL_FLAT__EMPTY) \
+                    return 0; \
+                continue; \
+            } \
+            \
+            elcount++; \
+            if (tbl->ctrl[i] != _hashtbl_flat_ctrl_for_hash(tbl->item_storage[i].hash)) \
+                return 0; \
+            \
+            /* must be reachable from its home group without crossing an empty slot */ \
+            unsigned group_mask = tbl->capacity / HASHTBL_FLAT_GROUP_SIZE - 1; \
+            unsigned group_i = function_prefix##_internal_group_for_hash(tbl, tbl->item_storage[i].hash); \
+            unsigned step = 1; \
+            while (group_i != i / HASHTBL_FLAT_GROUP_SIZE) { \
+                if (step > group_mask + 1 || _hashtbl_flat_group_match(&tbl->ctrl[group_i * HASHTBL_FLAT_GROUP_SIZE], HASHTBL_FLAT__EMPTY)) \
+                    return 0; \
+                group_i = (group_i + step) & group_mask; \
+                step++; \
+            } \
+        } \
+        \
+        if (elcount != tbl->element_count || delcount != tbl->deleted_count) \
+            return 0; \
+        \
+        if (elcount + delcount > tbl->capacity - tbl->capacity/8) \
+            return 0; \
+        \
+        return 1; \
+    } \
+    \
+    typedef struct { \
+        TblTypeName *tbl; \
+        unsigned i; \
+    } TblTypeName##_Iterator; \
+    \
+    static inline void \
+    function_prefix##_iterator_init(TblTypeName *tbl, TblTypeName##_Iterator *it) { \
+        it->tbl = tbl; \
+        it->i = 0; \
+        \
+        while (it->i < it->tbl->capacity && (it->tbl->ctrl[it->i] & 0x80)) \
+            it->i++; \
+    } \
+    \
+    static inline int \
+    function_prefix##_iterator_at_end(TblTypeName##_Iterator *it) { \
+        return it->i >= it->tbl->capacity; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_iterator_item(TblTypeName##_Iterator *it) { \
+        return &it->tbl->item_storage[it->i]; \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_next(TblTypeName##_Iterator *it) { \
+        while (it->i < it->tbl->capacity) { \
+            it->i++; \
+            \
+            if (it->i < it->tbl->capacity && !(it->tbl->ctrl[it->i] & 0x80)) \
+                return; \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_delete(TblTypeName##_Iterator *it) { \
+        if (it->i >= it->tbl->capacity || (it->tbl->ctrl[it->i] & 0x80)) \
+            return; /*FIXME: complain about misuse */\
+        \
+        function_prefix##_internal_dealloc_item(it->tbl, it->i); \
+    } \
+    \
+    static inline void \
+    function_prefix##_init_reserve(TblTypeName *tbl, unsigned num_items) \
+    { \
+        function_prefix##_init(tbl); \
+        function_prefix##_internal_rehash(tbl, num_items); \
+    } \
+    \
+
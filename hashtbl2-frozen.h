@@ -0,0 +1,691 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+#include "str-list.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Immutable string dictionaries with a minimal perfect hash
+ *
+ * How-To:
+ *      HASHTBL_DEFINE_FROZEN(FrozenWords, frozen_words, int)
+ *
+ *      FrozenWords fw;
+ *      frozen_words_build_from_str_list(&fw, words);  // or _build(), or
+ *                                                     // _build_from_table()
+ *      if (frozen_words_contains(&fw, "word"))
+ *          ...
+ *
+ *      // save it once, map it at startup
+ *      frozen_words_save(&fw, fd);
+ *      frozen_words_clear(&fw);
+ *      frozen_words_map(&fw, "words.frozen");
+ *
+ * The keys are numbered 0..size-1 by a minimal perfect hash function in the
+ * style of PTHash: every key hashes to one of size/6 buckets (deliberately
+ * skewed, some buckets get many more keys than others), and each bucket stores
+ * a 16 bit "pilot" which was chosen at build time so that the keys of all
+ * buckets end up in distinct slots. The slot table is 1% larger than the
+ * key count, the few keys which land in the spare slots are redirected by a
+ * small remap array. Together that is about 3 bits of index per key. A lookup
+ * hashes the key once and then compares it with the single key stored in its
+ * slot - there are no chains and no probing.
+ *
+ * Keys, values and the index are stored in one contiguous block which is also
+ * the file format, so a mapped dictionary is used in place. Values are copied
+ * bytewise and must not contain pointers. The file uses the native byte order.
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_FROZEN(TypeName, function_prefix, ValueType)
+ *          Defines a frozen dictionary from strings to ValueType.
+ *
+ *      HASHTBL_DEFINE_FROZEN_FROM_TABLE(TypeName, function_prefix, TblTypeName, tbl_function_prefix)
+ *          Defines function_prefix_build_from_table() for a hashtbl2.h table
+ *          with string keys and values that can be assigned to ValueType.
+ *
+ *      int
+ *      function_prefix_build(TypeName *f, const char *const *keys, const ValueType *values, unsigned count)
+ *          Builds the dictionary from `count` keys and their values. If a key
+ *          occurs more than once, the first occurrence wins. `values` may be
+ *          NULL, all values are zero then. Returns 0 and sets errno on failure.
+ *
+ *      int
+ *      function_prefix_build_from_str_list(TypeName *f, StrList list)
+ *          Like above, with all values zero.
+ *
+ *      int
+ *      function_prefix_build_from_table(TypeName *f, TblTypeName *tbl)
+ *          Like above, with the keys and values of the table.
+ *
+ *      int
+ *      function_prefix_save(const TypeName *f, int fd)
+ *          Returns 0 and sets errno on failure.
+ *
+ *      int
+ *      function_prefix_map(TypeName *f, const char *path)
+ *          Maps a saved dictionary read-only. Returns 0 and sets errno on
+ *          failure (EINVAL if the file is not a frozen dictionary with this
+ *          ValueType, or is corrupt). Checks the remap array and the key
+ *          offsets once, so lookups can't read outside of the file.
+ *
+ *      void
+ *      function_prefix_clear(TypeName *f)
+ *          Frees or unmaps the dictionary.
+ *
+ *      unsigned
+ *      function_prefix_size(const TypeName *f)
+ *
+ *      unsigned
+ *      function_prefix_index(const TypeName *f, const char *key)
+ *      unsigned
+ *      function_prefix_index_buf(const TypeName *f, const char *key, int len)
+ *          The number of the key in 0..size-1, or (unsigned)-1 if it is not
+ *          in the dictionary.
+ *
+ *      const ValueType *
+ *      function_prefix_lookup(const TypeName *f, const char *key)
+ *      const ValueType *
+ *      function_prefix_lookup_buf(const TypeName *f, const char *key, int len)
+ *      int
+ *      function_prefix_contains(const TypeName *f, const char *key)
+ *
+ *      const char *
+ *      function_prefix_key_at(const TypeName *f, unsigned index)
+ *      const ValueType *
+ *      function_prefix_value_at(const TypeName *f, unsigned index)
+ */
+
+#define HASHTBL__FROZEN_VERSION 1
+#define HASHTBL__FROZEN_BUCKET_SIZE 6
+#define HASHTBL__FROZEN_MAX_SEEDS 16
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t value_size;
+    uint32_t key_count;
+    uint32_t slot_count;
+    uint32_t bucket_count;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t strings_size;
+} HashtblFrozenHeader;
+
+typedef struct {
+    void *base;
+    size_t size;
+    int mapped;
+    const HashtblFrozenHeader *header;
+    const uint16_t *pilots;
+    const uint32_t *remap;
+    const uint32_t *key_offsets; // key_count + 1 entries, the keys are NUL-terminated
+    const char *values;
+    const char *strings;
+} HashtblFrozen;
+
+static inline uint64_t
+_hashtbl_frozen_align(uint64_t off, uint64_t alignment)
+{
+    return (off + alignment - 1) & ~(alignment - 1);
+}
+
+/* offsets of pilots, remap, key offsets, values and strings; returns the total size */
+static inline uint64_t
+_hashtbl_frozen_layout(const HashtblFrozenHeader *h, uint64_t offsets[5])
+{
+    uint64_t off = sizeof(HashtblFrozenHeader);
+    offsets[0] = off;
+    off = _hashtbl_frozen_align(off + (uint64_t)h->bucket_count * sizeof(uint16_t), 4);
+    offsets[1] = off;
+    off += (uint64_t)(h->slot_count - h->key_count) * sizeof(uint32_t);
+    offsets[2] = off;
+    off = _hashtbl_frozen_align(off + ((uint64_t)h->key_count + 1) * sizeof(uint32_t), 16);
+    offsets[3] = off;
+    off += (uint64_t)h->key_count * h->value_size;
+    offsets[4] = off;
+    return off + h->strings_size;
+}
+
+static inline void
+_hashtbl_frozen_attach(HashtblFrozen *f, void *base, size_t size, int mapped)
+{
+    uint64_t offsets[5];
+    f->base = base;
+    f->size = size;
+    f->mapped = mapped;
+    f->header = (const HashtblFrozenHeader *)base;
+    _hashtbl_frozen_layout(f->header, offsets);
+    f->pilots = (const uint16_t *)(const void *)((const char *)base + offsets[0]);
+    f->remap = (const uint32_t *)(const void *)((const char *)base + offsets[1]);
+    f->key_offsets = (const uint32_t *)(const void *)((const char *)base + offsets[2]);
+    f->values = (const char *)base + offsets[3];
+    f->strings = (const char *)base + offsets[4];
+}
+
+/* 60% of the keys go to the first 30% of the buckets: these large buckets are
+ * placed while the table is still empty, which leaves small buckets for the
+ * crowded end */
+static inline uint32_t
+_hashtbl_frozen_bucket(uint64_t h, uint64_t seed, uint32_t bucket_count)
+{
+    uint64_t x = _str_hash_mix(h ^ seed, 0x9e3779b97f4a7c15ull);
+    uint32_t dense = bucket_count / 10 * 3 + bucket_count % 10 * 3 / 10;
+    if ((uint32_t)x < 0x9999999au)
+        return (uint32_t)(((x >> 32) * dense) >> 32);
+    return dense + (uint32_t)(((x >> 32) * (bucket_count - dense)) >> 32);
+}
+
+static inline uint32_t
+_hashtbl_frozen_slot(uint64_t h, uint64_t seed, unsigned pilot, uint32_t slot_count)
+{
+    uint64_t x = _str_hash_mix(h ^ seed ^ ((uint64_t)pilot * 0xc2b2ae3d27d4eb4full), 0xd6e8feb86659fd93ull);
+    return (uint32_t)(((x >> 32) * slot_count) >> 32);
+}
+
+static inline unsigned
+_hashtbl_frozen_index_buf(const HashtblFrozen *f, const char *key, int len)
+{
+    const HashtblFrozenHeader *h = f->header;
+    if (!h || !h->key_count)
+        return (unsigned)-1;
+
+    uint64_t hash = str_hash64_buf(key, len);
+    uint32_t b = _hashtbl_frozen_bucket(hash, h->seed, h->bucket_count);
+    uint32_t slot = _hashtbl_frozen_slot(hash, h->seed, f->pilots[b], h->slot_count);
+    if (slot >= h->key_count)
+        slot = f->remap[slot - h->key_count];
+
+    uint32_t begin = f->key_offsets[slot];
+    uint32_t key_len = f->key_offsets[slot + 1] - begin - 1;
+    if (key_len != (uint32_t)len || (key_len && memcmp(f->strings + begin, key, key_len)))
+        return (unsigned)-1;
+
+    return slot;
+}
+
+typedef struct {
+    uint64_t hash;
+    unsigned key;
+} HashtblFrozenEntry;
+
+static inline int
+_hashtbl_frozen_compare_entries(const void *pa, const void *pb)
+{
+    const HashtblFrozenEntry *a = (const HashtblFrozenEntry *)pa;
+    const HashtblFrozenEntry *b = (const HashtblFrozenEntry *)pb;
+    if (a->hash != b->hash)
+        return a->hash < b->hash ? -1 : 1;
+    return a->key < b->key ? -1 : a->key > b->key;
+}
+
+/* Searches pilots for all buckets. entries[] must be sorted by bucket, with
+ * bucket_start[b]..bucket_start[b+1] the keys of bucket b. Returns 0 if some
+ * bucket needed a pilot larger than 16 bits. */
+static inline int
+_hashtbl_frozen_find_pilots(const HashtblFrozenEntry *entries, const uint32_t *bucket_start,
+                            const uint32_t *order, uint32_t bucket_count, uint64_t seed,
+                            uint32_t slot_count, uint16_t *pilots, uint32_t *slot_of_entry,
+                            unsigned char *taken)
+{
+    memset(taken, 0, slot_count);
+
+    for (uint32_t o = 0; o < bucket_count; ++o) {
+        uint32_t b = order[o];
+        uint32_t begin = bucket_start[b], end = bucket_start[b + 1];
+        if (begin == end) {
+            pilots[b] = 0;
+            continue;
+        }
+
+        unsigned pilot = 0;
+        for (;; ++pilot) {
+            if (pilot > 0xffff)
+                return 0;
+
+            uint32_t i;
+            for (i = begin; i < end; ++i) {
+                uint32_t slot = _hashtbl_frozen_slot(entries[i].hash, seed, pilot, slot_count);
+                if (taken[slot])
+                    break;
+                taken[slot] = 1;
+                slot_of_entry[i] = slot;
+            }
+            if (i == end)
+                break;
+
+            // undo the partial placement
+            while (i-- > begin)
+                taken[slot_of_entry[i]] = 0;
+        }
+
+        pilots[b] = (uint16_t)pilot;
+    }
+
+    return 1;
+}
+
+static inline int
+_hashtbl_frozen_build(HashtblFrozen *f, const char *const *keys, const void *values,
+                      size_t value_size, unsigned count)
+{
+    memset(f, 0, sizeof(*f));
+
+    // hash every key once, sorting by hash finds the duplicates
+    HashtblFrozenEntry *entries = (HashtblFrozenEntry *)reallocarray(NULL, count ? count : 1, sizeof(HashtblFrozenEntry));
+    if (!entries)
+        return 0;
+
+    for (unsigned i = 0; i < count; ++i) {
+        entries[i].hash = str_hash64_buf(keys[i], str_length(keys[i]));
+        entries[i].key = i;
+    }
+    qsort(entries, count, sizeof(HashtblFrozenEntry), _hashtbl_frozen_compare_entries);
+
+    uint32_t n = 0;
+    uint64_t strings_size = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        if (n && entries[n - 1].hash == entries[i].hash) {
+            if (str_equal(keys[entries[n - 1].key], keys[entries[i].key]))
+                continue;
+
+            // two keys with the same 64 bit hash can never be separated
+            free(entries);
+            errno = EINVAL;
+            return 0;
+        }
+        strings_size += (uint64_t)str_length(keys[entries[i].key]) + 1;
+        entries[n++] = entries[i];
+    }
+
+    if (strings_size > 0xffffffffu) {
+        free(entries);
+        errno = EOVERFLOW;
+        return 0;
+    }
+
+    HashtblFrozenHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "HTBLFRZN", 8);
+    header.version = HASHTBL__FROZEN_VERSION;
+    header.value_size = (uint32_t)value_size;
+    header.key_count = n;
+    header.slot_count = n ? n + n / 100 + 1 : 0;
+    header.bucket_count = n / HASHTBL__FROZEN_BUCKET_SIZE + 1;
+    header.strings_size = strings_size;
+
+    uint32_t nb = header.bucket_count;
+    uint32_t *bucket_start = (uint32_t *)calloc((size_t)nb + 1, sizeof(uint32_t));
+    uint32_t *order = (uint32_t *)reallocarray(NULL, nb, sizeof(uint32_t));
+    uint32_t *slot_of_entry = (uint32_t *)reallocarray(NULL, n ? n : 1, sizeof(uint32_t));
+    unsigned char *taken = (unsigned char *)malloc(header.slot_count ? header.slot_count : 1);
+    HashtblFrozenEntry *sorted = (HashtblFrozenEntry *)reallocarray(NULL, n ? n : 1, sizeof(HashtblFrozenEntry));
+    uint16_t *pilots = (uint16_t *)reallocarray(NULL, nb, sizeof(uint16_t));
+    int ok = bucket_start && order && slot_of_entry && taken && sorted && pilots;
+    if (!ok)
+        errno = ENOMEM;
+
+    int found = 0;
+    for (uint64_t seed = 0; ok && n && seed < HASHTBL__FROZEN_MAX_SEEDS && !found; ++seed) {
+        header.seed = seed * 0x9e3779b97f4a7c15ull;
+
+        // counting sort of the keys by bucket
+        memset(bucket_start, 0, ((size_t)nb + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < n; ++i)
+            ++bucket_start[_hashtbl_frozen_bucket(entries[i].hash, header.seed, nb) + 1];
+        uint32_t max_bucket_size = 0;
+        for (uint32_t b = 0; b < nb; ++b) {
+            if (bucket_start[b + 1] > max_bucket_size)
+                max_bucket_size = bucket_start[b + 1];
+            bucket_start[b + 1] += bucket_start[b];
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t b = _hashtbl_frozen_bucket(entries[i].hash, header.seed, nb);
+            sorted[bucket_start[b]++] = entries[i];
+        }
+        for (uint32_t b = nb; b > 0; --b)
+            bucket_start[b] = bucket_start[b - 1];
+        bucket_start[0] = 0;
+
+        // the largest buckets are the hardest to place, so they go first
+        uint32_t *size_start = (uint32_t *)calloc((size_t)max_bucket_size + 2, sizeof(uint32_t));
+        if (!size_start) {
+            ok = 0;
+            errno = ENOMEM;
+            break;
+        }
+        for (uint32_t b = 0; b < nb; ++b)
+            ++size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b]) + 1];
+        for (uint32_t s = 0; s <= max_bucket_size; ++s)
+            size_start[s + 1] += size_start[s];
+        for (uint32_t b = 0; b < nb; ++b)
+            order[size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+        free(size_start);
+
+        found = _hashtbl_frozen_find_pilots(sorted, bucket_start, order, nb, header.seed,
+                                            header.slot_count, pilots, slot_of_entry, taken);
+    }
+
+    if (ok && n && !found) {
+        ok = 0;
+        errno = EINVAL;
+    }
+
+    char *base = NULL;
+    uint64_t offsets[5];
+    uint64_t size = _hashtbl_frozen_layout(&header, offsets);
+    if (ok) {
+        base = (char *)calloc(1, (size_t)size);
+        if (!base) {
+            ok = 0;
+            errno = ENOMEM;
+        }
+    }
+
+    if (ok) {
+        memcpy(base, &header, sizeof(header));
+        if (n)
+            memcpy(base + offsets[0], pilots, (size_t)nb * sizeof(uint16_t));
+
+        // keys in the spare slots move to the free slots below n
+        uint32_t *remap = (uint32_t *)(void *)(base + offsets[1]);
+        uint32_t free_slot = 0;
+        for (uint32_t s = n; s < header.slot_count; ++s) {
+            if (!taken[s])
+                continue;
+            while (taken[free_slot])
+                ++free_slot;
+            taken[free_slot] = 1;
+            remap[s - n] = free_slot;
+        }
+
+        // key number of every final slot
+        uint32_t *key_at = (uint32_t *)reallocarray(NULL, n ? n : 1, sizeof(uint32_t));
+        if (!key_at) {
+            ok = 0;
+            errno = ENOMEM;
+        } else {
+            for (uint32_t i = 0; i < n; ++i) {
+                uint32_t slot = slot_of_entry[i];
+                if (slot >= n)
+                    slot = remap[slot - n];
+                key_at[slot] = sorted[i].key;
+            }
+
+            uint32_t *key_offsets = (uint32_t *)(void *)(base + offsets[2]);
+            char *strings = base + offsets[4];
+            uint32_t off = 0;
+            for (uint32_t slot = 0; slot < n; ++slot) {
+                const char *key = keys[key_at[slot]];
+                uint32_t len = (uint32_t)str_length(key);
+                key_offsets[slot] = off;
+                if (len)
+                    memcpy(strings + off, key, len);
+                off += len + 1;
+
+                if (values)
+                    memcpy(base + offsets[3] + (size_t)slot * value_size,
+                           (const char *)values + (size_t)key_at[slot] * value_size, value_size);
+            }
+            key_offsets[n] = off;
+
+            free(key_at);
+        }
+    }
+
+    free(entries);
+    free(bucket_start);
+    free(order);
+    free(slot_of_entry);
+    free(taken);
+    free(sorted);
+    free(pilots);
+
+    if (!ok) {
+        free(base);
+        return 0;
+    }
+
+    _hashtbl_frozen_attach(f, base, (size_t)size, 0);
+    return 1;
+}
+
+static inline int
+_hashtbl_frozen_save(const HashtblFrozen *f, int fd)
+{
+    size_t done = 0;
+    while (done < f->size) {
+        ssize_t r = write(fd, (const char *)f->base + done, f->size - done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return 0;
+        done += (size_t)r;
+    }
+    return 1;
+}
+
+/* makes sure that lookups stay within the file: spare slots are redirected
+ * to real ones, and every key is a NUL-terminated string within the blob */
+static inline int
+_hashtbl_frozen_check(const HashtblFrozen *f)
+{
+    const HashtblFrozenHeader *h = f->header;
+    for (uint32_t i = 0; i < h->slot_count - h->key_count; ++i) {
+        if (f->remap[i] >= h->key_count)
+            return 0;
+    }
+
+    for (uint32_t i = 0; i < h->key_count; ++i) {
+        if (f->key_offsets[i + 1] <= f->key_offsets[i]
+                || f->key_offsets[i + 1] > h->strings_size
+                || f->strings[f->key_offsets[i + 1] - 1] != '\0')
+            return 0;
+    }
+
+    return f->key_offsets[h->key_count] == h->strings_size;
+}
+
+static inline int
+_hashtbl_frozen_map(HashtblFrozen *f, const char *path, size_t value_size)
+{
+    memset(f, 0, sizeof(*f));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(HashtblFrozenHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return 0;
+    }
+
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return 0;
+
+    const HashtblFrozenHeader *h = (const HashtblFrozenHeader *)base;
+    uint64_t offsets[5];
+    if (memcmp(h->magic, "HTBLFRZN", 8)
+            || h->version != HASHTBL__FROZEN_VERSION
+            || h->value_size != value_size
+            || h->slot_count < h->key_count
+            || h->bucket_count != h->key_count / HASHTBL__FROZEN_BUCKET_SIZE + 1
+            || _hashtbl_frozen_layout(h, offsets) != size) {
+        munmap(base, size);
+        errno = EINVAL;
+        return 0;
+    }
+
+    _hashtbl_frozen_attach(f, base, size, 1);
+    if (!_hashtbl_frozen_check(f)) {
+        munmap(base, size);
+        memset(f, 0, sizeof(*f));
+        errno = EINVAL;
+        return 0;
+    }
+
+    return 1;
+}
+
+static inline void
+_hashtbl_frozen_clear(HashtblFrozen *f)
+{
+    if (f->mapped)
+        munmap(f->base, f->size);
+    else
+        free(f->base);
+    memset(f, 0, sizeof(*f));
+}
+
+#define HASHTBL_DEFINE_FROZEN(TypeName, function_prefix, ValueType) \
+    \
+    typedef ValueType TypeName##_Value; \
+    typedef struct { \
+        HashtblFrozen frozen; \
+    } TypeName; \
+    \
+    static inline int \
+    function_prefix##_build(TypeName *f, const char *const *keys, const TypeName##_Value *values, unsigned count) \
+    { \
+        return _hashtbl_frozen_build(&f->frozen, keys, values, sizeof(TypeName##_Value), count); \
+    } \
+    \
+    static inline int \
+    function_prefix##_build_from_str_list(TypeName *f, StrList list) \
+    { \
+        return _hashtbl_frozen_build(&f->frozen, (const char *const *)list, NULL, sizeof(TypeName##_Value), \
+                                     (unsigned)str_list_length(list)); \
+    } \
+    \
+    static inline int \
+    function_prefix##_save(const TypeName *f, int fd) \
+    { \
+        return _hashtbl_frozen_save(&f->frozen, fd); \
+    } \
+    \
+    static inline int \
+    function_prefix##_map(TypeName *f, const char *path) \
+    { \
+        return _hashtbl_frozen_map(&f->frozen, path, sizeof(TypeName##_Value)); \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TypeName *f) \
+    { \
+        _hashtbl_frozen_clear(&f->frozen); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(const TypeName *f) \
+    { \
+        return f->frozen.header ? f->frozen.header->key_count : 0; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_index_buf(const TypeName *f, const char *key, int len) \
+    { \
+        return _hashtbl_frozen_index_buf(&f->frozen, key, len); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_index(const TypeName *f, const char *key) \
+    { \
+        return _hashtbl_frozen_index_buf(&f->frozen, key, str_length(key)); \
+    } \
+    \
+    static inline const char * \
+    function_prefix##_key_at(const TypeName *f, unsigned index) \
+    { \
+        return f->frozen.strings + f->frozen.key_offsets[index]; \
+    } \
+    \
+    static inline const TypeName##_Value * \
+    function_prefix##_value_at(const TypeName *f, unsigned index) \
+    { \
+        return (const TypeName##_Value *)(const void *)f->frozen.values + index; \
+    } \
+    \
+    static inline const TypeName##_Value * \
+    function_prefix##_lookup_buf(const TypeName *f, const char *key, int len) \
+    { \
+        unsigned index = function_prefix##_index_buf(f, key, len); \
+        return index == (unsigned)-1 ? NULL : function_prefix##_value_at(f, index); \
+    } \
+    \
+    static inline const TypeName##_Value * \
+    function_prefix##_lookup(const TypeName *f, const char *key) \
+    { \
+        return function_prefix##_lookup_buf(f, key, str_length(key)); \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(const TypeName *f, const char *key) \
+    { \
+        return function_prefix##_index(f, key) != (unsigned)-1; \
+    } \
+    \
+
+#define HASHTBL_DEFINE_FROZEN_FROM_TABLE(TypeName, function_prefix, TblTypeName, tbl_function_prefix) \
+    \
+    static inline int \
+    function_prefix##_build_from_table(TypeName *f, TblTypeName *tbl) \
+    { \
+        unsigned count = tbl_function_prefix##_size(tbl); \
+        const char **keys = (const char **)reallocarray(NULL, count ? count : 1, sizeof(const char *)); \
+        TypeName##_Value *values = (TypeName##_Value *)reallocarray(NULL, count ? count : 1, sizeof(TypeName##_Value)); \
+        if (!keys || !values) { \
+            free(keys); \
+            free(values); \
+            errno = ENOMEM; \
+            return 0; \
+        } \
+        \
+        unsigned n = 0; \
+        for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
+            if (tbl->item_storage[i].next == (unsigned)-2) \
+                continue; \
+            keys[n] = tbl->item_storage[i].key; \
+            values[n] = tbl->item_storage[i].value; \
+            ++n; \
+        } \
+        \
+        int ok = function_prefix##_build(f, keys, values, n); \
+        free(keys); \
+        free(values); \
+        return ok; \
+    } \
+    \
+
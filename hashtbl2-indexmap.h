@@ -0,0 +1,442 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+/* Insertion-ordered variant of the hashtbl2.h hash map
+ *
+ *      HASHTBL_DEFINE_INDEXMAP(MyTable, my_table,
+ *                              HASHTBL_KEY(const char *, str_hash, str_equal),
+ *                              HASHTBL_VALUE(int))
+ *
+ * Items are chained from a prime sized bucket array like in hashtbl2.h,
+ * but the item array never has holes: the items are exactly
+ * tbl->items[0 .. size-1], in insertion order. Removing an item moves the
+ * last item into its place ("swap-remove") and fixes the one chain link
+ * pointing to it, so removal stays O(1) and iterating costs the same no
+ * matter how many items have been removed before. Without removals,
+ * iteration order is insertion order.
+ *
+ * Limits:
+ *      - only supports up to 2^32-2 items
+ *      - item pointers are potentially invalid after adding or removing elements
+ *      - removal changes the position of the last item
+ *      - will never shrink when removing elements
+ *      - not safe against algorithmic complexity attacks
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_INDEXMAP(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC)
+ *      HASHTBL_DEFINE_INDEXMAP_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_fun, free_fun)
+ *          Like HASHTBL_DEFINE and HASHTBL_DEFINE_FULL from hashtbl2.h.
+ *
+ *      function_prefix_init, function_prefix_init_reserve, function_prefix_clear,
+ *      function_prefix_size, function_prefix_hash, function_prefix_lookup,
+ *      function_prefix_lookup_with_hash, function_prefix_contains,
+ *      function_prefix_lookup_or_insert_zero, function_prefix_set_zero,
+ *      function_prefix_set, function_prefix_remove,
+ *      function_prefix_check_internal_sanity
+ *          Like in hashtbl2.h. The TypeName_Item struct contains `hash`,
+ *          `next`, `key` and `value` members.
+ *
+ *      unsigned
+ *      function_prefix_index(TypeName *tbl, ConstKeyType key)
+ *      unsigned
+ *      function_prefix_index_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key)
+ *          Returns the position of the given key, or (unsigned)-1.
+ *
+ *      TypeName_Item *
+ *      function_prefix_item_at(TypeName *tbl, unsigned index)
+ *          The item at the given position, which must be less than
+ *          function_prefix_size(). Iterating over all positions visits the
+ *          items in insertion order, unless items have been removed.
+ *
+ *      void
+ *      function_prefix_remove_at(TypeName *tbl, unsigned index)
+ *          Removes the item at the given position, and moves the last item
+ *          to this position.
+ *
+ *      TypeName_Iterator
+ *      function_prefix_iterator_init, function_prefix_iterator_at_end,
+ *      function_prefix_iterator_item, function_prefix_iterator_next,
+ *      function_prefix_iterator_delete
+ *          Like in hashtbl2.h. Deleting the current item moves the last
+ *          one into its place, which the iterator visits next.
+ */
+
+#define HASHTBL_DEFINE_INDEXMAP(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
+    HASHTBL__EXPAND_DEFINE_INDEXMAP(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+
+#define HASHTBL_DEFINE_INDEXMAP_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
+    HASHTBL__EXPAND_DEFINE_INDEXMAP(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+
+#define HASHTBL__EXPAND_DEFINE_INDEXMAP(...) \
+    HASHTBL__INTERNAL_DEFINE_INDEXMAP(__VA_ARGS__)
+
+/* The dense item array with prime sized bucket chains shared by
+ * hashtbl2-indexmap.h and hashtbl2-set.h. Expects TblTypeName##_Item (with
+ * `hash`, `next` and `key` members), TblTypeName##_ConstKey and
+ * function_prefix##_internal_free_item(TblTypeName##_Item *) to be defined
+ * already, and defines the table type, init, init_reserve, clear, size,
+ * hash, lookup, lookup_with_hash, contains, item_at, check_internal_sanity
+ * and the iterator. New items are appended with internal_push(), which
+ * leaves the key (and value) to the caller. */
+#define HASHTBL__INTERNAL_DEFINE_DENSE(TblTypeName, function_prefix, key_hash_func, key_equal_func, key_hash_call, reallocarray, free) \
+    \
+    typedef struct { \
+        unsigned element_count; \
+        unsigned items_allocated; \
+        unsigned table_size_idx; \
+        unsigned *hashtbl; \
+        TblTypeName##_Item *items; \
+        uint64_t hash_seed; \
+    } TblTypeName; \
+    \
+    static inline void \
+    function_prefix##_init(TblTypeName *tbl) \
+    { \
+        tbl->element_count = 0; \
+        tbl->items_allocated = 0; \
+        tbl->table_size_idx = 0; \
+        tbl->hashtbl = NULL; \
+        tbl->items = NULL; \
+        tbl->hash_seed = key_hash_call(HASHTBL__USES_SEED, 0, 0) ? _hashtbl_random_seed(tbl) : 0; \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TblTypeName *tbl) \
+    { \
+        for (unsigned i = 0; i < tbl->element_count; ++i) \
+            function_prefix##_internal_free_item(&tbl->items[i]); \
+        \
+        free(tbl->hashtbl); \
+        free(tbl->items); \
+        function_prefix##_init(tbl); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TblTypeName *tbl) \
+    { \
+        return tbl->element_count; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_hash(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return key_hash_call(key_hash_func, key, tbl->hash_seed); \
+    } \
+    \
+    static inline unsigned * \
+    function_prefix##_internal_bucket_for_hash(TblTypeName *tbl, unsigned hash) \
+    { \
+        return &tbl->hashtbl[_hashtbl_prime_index_for_hash(hash, tbl->table_size_idx)]; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_find(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        if (!tbl->hashtbl) \
+            return (unsigned)-1; \
+        \
+        unsigned item_i = *function_prefix##_internal_bucket_for_hash(tbl, hash); \
+        while (item_i != (unsigned)-1) { \
+            if (tbl->items[item_i].hash == hash && key_equal_func(tbl->items[item_i].key, key)) \
+                return item_i; \
+            \
+            item_i = tbl->items[item_i].next; \
+        } \
+        \
+        return (unsigned)-1; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_item_at(TblTypeName *tbl, unsigned index) \
+    { \
+        return &tbl->items[index]; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        unsigned item_i = function_prefix##_internal_find(tbl, hash, key); \
+        return item_i != (unsigned)-1 ? &tbl->items[item_i] : NULL; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup_with_hash(tbl, function_prefix##_hash(tbl, key), key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_internal_find(tbl, function_prefix##_hash(tbl, key), key) != (unsigned)-1; \
+    } \
+    \
+    /* makes room for num_items, rebuilding the buckets if they'd get too full */ \
+    static inline int \
+    function_prefix##_internal_reserve(TblTypeName *tbl, unsigned num_items) \
+    { \
+        if (num_items > tbl->items_allocated) { \
+            unsigned new_allocated = tbl->items_allocated ? tbl->items_allocated : 8; \
+            while (new_allocated < num_items) \
+                new_allocated = new_allocated <= 0x7fffffffu ? new_allocated * 2 : 0xfffffffeu; \
+            \
+            TblTypeName##_Item *items = (TblTypeName##_Item *)reallocarray(tbl->items, new_allocated, sizeof(TblTypeName##_Item)); \
+            if (!items) \
+                return 0; \
+            \
+            tbl->items = items; \
+            tbl->items_allocated = new_allocated; \
+        } \
+        \
+        unsigned size_idx = 0; \
+        while (size_idx + 1 < HASHTBL__SIZE_STEPS \
+                && num_items > _hashtbl_prime_bucket_count(size_idx) - _hashtbl_prime_bucket_count(size_idx)/4) \
+            size_idx++; \
+        \
+        if (tbl->hashtbl && size_idx <= tbl->table_size_idx) \
+            return 1; \
+        \
+        unsigned bucket_count = _hashtbl_prime_bucket_count(size_idx); \
+        unsigned *hashtbl = (unsigned *)reallocarray(NULL, bucket_count, sizeof(unsigned)); \
+        if (!hashtbl) \
+            return 0; \
+        \
+        free(tbl->hashtbl); \
+        tbl->hashtbl = hashtbl; \
+        tbl->table_size_idx = size_idx; \
+        \
+        memset(hashtbl, 0xff, bucket_count * sizeof(unsigned)); \
+        for (unsigned i = tbl->element_count; i-- > 0; ) { \
+            unsigned *bucket = function_prefix##_internal_bucket_for_hash(tbl, tbl->items[i].hash); \
+            tbl->items[i].next = *bucket; \
+            *bucket = i; \
+        } \
+        \
+        return 1; \
+    } \
+    \
+    /* appends an item with the given hash to its chain and returns its index, \
+       or (unsigned)-1 if memory ran out. The key is up to the caller. */ \
+    static inline unsigned \
+    function_prefix##_internal_push(TblTypeName *tbl, unsigned hash) \
+    { \
+        if (tbl->element_count == (unsigned)-2 \
+                || !function_prefix##_internal_reserve(tbl, tbl->element_count + 1)) \
+            return (unsigned)-1; \
+        \
+        unsigned item_i = tbl->element_count++; \
+        unsigned *bucket = function_prefix##_internal_bucket_for_hash(tbl, hash); \
+        tbl->items[item_i].hash = hash; \
+        tbl->items[item_i].next = *bucket; \
+        *bucket = item_i; \
+        return item_i; \
+    } \
+    \
+    /* the link which points to the given item */ \
+    static inline unsigned * \
+    function_prefix##_internal_link_to(TblTypeName *tbl, unsigned item_i) \
+    { \
+        unsigned *p = function_prefix##_internal_bucket_for_hash(tbl, tbl->items[item_i].hash); \
+        while (*p != item_i) \
+            p = &tbl->items[*p].next; \
+        return p; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_remove_at(TblTypeName *tbl, unsigned index) \
+    { \
+        *function_prefix##_internal_link_to(tbl, index) = tbl->items[index].next; \
+        function_prefix##_internal_free_item(&tbl->items[index]); \
+        \
+        unsigned last = --tbl->element_count; \
+        if (index != last) { \
+            *function_prefix##_internal_link_to(tbl, last) = index; \
+            tbl->items[index] = tbl->items[last]; \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_init_reserve(TblTypeName *tbl, unsigned num_items) \
+    { \
+        function_prefix##_init(tbl); \
+        function_prefix##_internal_reserve(tbl, num_items); \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity(TblTypeName *tbl) \
+    { \
+        if (tbl->element_count > tbl->items_allocated) \
+            return 0; \
+        \
+        if (!tbl->hashtbl) \
+            return tbl->element_count == 0; \
+        \
+        unsigned chained = 0; \
+        unsigned bucket_count = _hashtbl_prime_bucket_count(tbl->table_size_idx); \
+        for (unsigned b = 0; b < bucket_count; ++b) { \
+            for (unsigned i = tbl->hashtbl[b]; i != (unsigned)-1; i = tbl->items[i].next) { \
+                if (i >= tbl->element_count || ++chained > tbl->element_count) \
+                    return 0; \
+                if (_hashtbl_prime_index_for_hash(tbl->items[i].hash, tbl->table_size_idx) != b) \
+                    return 0; \
+            } \
+        } \
+        \
+        return chained == tbl->element_count; \
+    } \
+    \
+    typedef struct { \
+        TblTypeName *tbl; \
+        unsigned i; \
+        int deleted; \
+    } TblTypeName##_Iterator; \
+    \
+    static inline void \
+    function_prefix##_iterator_init(TblTypeName *tbl, TblTypeName##_Iterator *it) { \
+        it->tbl = tbl; \
+        it->i = 0; \
+        it->deleted = 0; \
+    } \
+    \
+    static inline int \
+    function_prefix##_iterator_at_end(TblTypeName##_Iterator *it) { \
+        return it->i >= it->tbl->element_count; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_iterator_item(TblTypeName##_Iterator *it) { \
+        return &it->tbl->items[it->i]; \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_next(TblTypeName##_Iterator *it) { \
+        /* after a delete, the current position already holds the next item */ \
+        if (it->deleted) \
+            it->deleted = 0; \
+        else if (it->i < it->tbl->element_count) \
+            it->i++; \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_delete(TblTypeName##_Iterator *it) { \
+        if (it->deleted || it->i >= it->tbl->element_count) \
+            return; \
+        \
+        function_prefix##_internal_remove_at(it->tbl, it->i); \
+        it->deleted = 1; \
+    } \
+
+#define HASHTBL__INTERNAL_DEFINE_INDEXMAP(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+    \
+    typedef KeyType         TblTypeName##_Key; \
+    typedef ConstKeyType    TblTypeName##_ConstKey; \
+    typedef ValueType       TblTypeName##_Value; \
+    typedef ConstValueType  TblTypeName##_ConstValue; \
+    typedef struct TblTypeName##_Item { \
+        unsigned hash; \
+        unsigned next; \
+        TblTypeName##_Key   key; \
+        TblTypeName##_Value value; \
+    } TblTypeName##_Item; \
+    \
+    static inline void \
+    function_prefix##_internal_free_item(TblTypeName##_Item *item) \
+    { \
+        key_free_func(item->key); \
+        value_free_func(item->value); \
+    } \
+    \
+    HASHTBL__INTERNAL_DEFINE_DENSE(TblTypeName, function_prefix, key_hash_func, key_equal_func, key_hash_call, reallocarray, free) \
+    \
+    static inline unsigned \
+    function_prefix##_index_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_internal_find(tbl, hash, key); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_index(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_internal_find(tbl, function_prefix##_hash(tbl, key), key); \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_or_insert_zero(TblTypeName *tbl, TblTypeName##_ConstKey key, int *inserted) \
+    { \
+        if (inserted) \
+            *inserted = 0; \
+        \
+        unsigned hash = function_prefix##_hash(tbl, key); \
+        TblTypeName##_Item *item = function_prefix##_lookup_with_hash(tbl, hash, key); \
+        if (item) \
+            return item; \
+        \
+        unsigned item_i = function_prefix##_internal_push(tbl, hash); \
+        if (item_i == (unsigned)-1) \
+            return NULL; \
+        \
+        item = &tbl->items[item_i]; \
+        item->key = key_dup_func(key); \
+        memset(&item->value, 0, sizeof(item->value)); \
+        \
+        if (inserted) \
+            *inserted = 1; \
+        return item; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set_zero(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        int inserted; \
+        TblTypeName##_Item *item = function_prefix##_lookup_or_insert_zero(tbl, key, &inserted); \
+        if (item && !inserted) { \
+            value_free_func(item->value); \
+            memset(&item->value, 0, sizeof(item->value)); \
+        } \
+        return item; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        TblTypeName##_Item *item = function_prefix##_set_zero(tbl, key); \
+        if (item) \
+            item->value = value_dup_func(value); \
+        return item; \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove_at(TblTypeName *tbl, unsigned index) \
+    { \
+        function_prefix##_internal_remove_at(tbl, index); \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        unsigned index = function_prefix##_index(tbl, key); \
+        if (index != (unsigned)-1) \
+            function_prefix##_internal_remove_at(tbl, index); \
+    } \
+
@@ -0,0 +1,475 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+/* Multimap on top of hashtbl2.h
+ *
+ *      HASHTBL_DEFINE_MULTIMAP(Postings, postings,
+ *                              HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+ *                              HASHTBL_VALUE(unsigned))
+ *
+ *      postings_append(&index, "fox", doc_id);
+ *
+ *      Postings_Range r;
+ *      postings_equal_range(&index, "fox", &r);
+ *      unsigned *ids, n;
+ *      while ((ids = postings_range_run(&r, &n)))
+ *          for (unsigned i = 0; i < n; ++i)
+ *              visit(ids[i]);
+ *
+ * Every key maps to any number of values, in the order they were appended.
+ * The keys live in a hashtbl2.h table whose values are TypeName_Run
+ * descriptors (value count, first and last chunk and where the values of
+ * the first chunk are). The values themselves are stored in chunks carved
+ * from one array shared by all keys, so there is no allocation per key.
+ * A key starts with a chunk for one value; when it is full, the values
+ * move on to a chunk twice as large, like in a growing vector, so keys with
+ * few values stay small and the values of a key are contiguous. Only keys
+ * with more than HASHTBL_MULTIMAP_MAX_CHUNK values get a chain of chunks of
+ * that size. Chunks which are given up are kept on a free list per chunk
+ * size for reuse.
+ *
+ * Limits:
+ *      - only supports up to 2^32-2 chunks
+ *      - value pointers are potentially invalid after appending values
+ *      - up to half of the value slots of a key may be unused, or
+ *        HASHTBL_MULTIMAP_MAX_CHUNK - 1 for keys with a chain of chunks
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_MULTIMAP(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC)
+ *      HASHTBL_DEFINE_MULTIMAP_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_fun, free_fun)
+ *          Defines the multimap type and functions, see HASHTBL_DEFINE for
+ *          the specs. The key table is `tbl->keys` of type TypeName_Keys,
+ *          with functions prefixed function_prefix_keys, e.g. for
+ *          iterating over all distinct keys.
+ *
+ *      void
+ *      function_prefix_init(TypeName *tbl)
+ *      void
+ *      function_prefix_clear(TypeName *tbl)
+ *          Like in hashtbl2.h.
+ *
+ *      int
+ *      function_prefix_append(TypeName *tbl, ConstKeyType key, ConstValueType value)
+ *          Adds a value for the key, after all existing ones. Returns 0 if
+ *          memory ran out.
+ *
+ *      unsigned
+ *      function_prefix_count(TypeName *tbl, ConstKeyType key)
+ *          Number of values for the key, without looking at them.
+ *
+ *      unsigned
+ *      function_prefix_key_count(TypeName *tbl)
+ *      size_t
+ *      function_prefix_value_count(TypeName *tbl)
+ *          Number of distinct keys and of all values.
+ *
+ *      int
+ *      function_prefix_contains(TypeName *tbl, ConstKeyType key)
+ *
+ *      unsigned
+ *      function_prefix_remove(TypeName *tbl, ConstKeyType key)
+ *          Removes the key with all its values, returns how many there were.
+ *
+ *      void
+ *      function_prefix_equal_range(TypeName *tbl, ConstKeyType key, TypeName_Range *range)
+ *      int
+ *      function_prefix_range_at_end(TypeName_Range *range)
+ *      ValueType *
+ *      function_prefix_range_value(TypeName_Range *range)
+ *      void
+ *      function_prefix_range_next(TypeName_Range *range)
+ *          Iterates over the values of a key, one at a time. The range is
+ *          empty if the key isn't there.
+ *
+ *      ValueType *
+ *      function_prefix_range_run(TypeName_Range *range, unsigned *len)
+ *          Returns the values from the current position to the end of its
+ *          chunk and stores their number in `len` (at most
+ *          HASHTBL_MULTIMAP_MAX_CHUNK), then moves the range past them.
+ *          Returns NULL at the end of the range.
+ *
+ *      int
+ *      function_prefix_check_internal_sanity(TypeName *tbl)
+ */
+
+/* log2 of the largest chunk, larger chunks make long runs faster to scan
+ * but may leave more value slots unused at the end of a chain */
+#ifndef HASHTBL_MULTIMAP_MAX_CHUNK_BITS
+#   define HASHTBL_MULTIMAP_MAX_CHUNK_BITS 10
+#endif
+
+#define HASHTBL_MULTIMAP_MAX_CHUNK (1u << HASHTBL_MULTIMAP_MAX_CHUNK_BITS)
+
+#define HASHTBL_DEFINE_MULTIMAP(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
+    HASHTBL__EXPAND_DEFINE_MULTIMAP(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+
+#define HASHTBL_DEFINE_MULTIMAP_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
+    HASHTBL__EXPAND_DEFINE_MULTIMAP(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+
+#define HASHTBL__EXPAND_DEFINE_MULTIMAP(...) \
+    HASHTBL__INTERNAL_DEFINE_MULTIMAP(__VA_ARGS__)
+
+#define HASHTBL__INTERNAL_DEFINE_MULTIMAP(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+    \
+    typedef ValueType       TblTypeName##_Value; \
+    typedef ConstValueType  TblTypeName##_ConstValue; \
+    typedef struct { \
+        unsigned count; \
+        unsigned first; \
+        unsigned last; \
+        size_t offset; /* of the values of the first chunk, saves looking at it for short keys */ \
+    } TblTypeName##_Run; \
+    /* next is (unsigned)-1 for the last chunk of a key, and links the free list for unused chunks. \
+       The chunk holds 1 << size_bits values, starting at tbl->values[offset]. */ \
+    typedef struct { \
+        unsigned next; \
+        unsigned used; \
+        unsigned size_bits; \
+        size_t offset; \
+    } TblTypeName##_Chunk; \
+    \
+    HASHTBL__INTERNAL_DEFINE(TblTypeName##_Keys, function_prefix##_keys, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, \
+                             TblTypeName##_Run, TblTypeName##_Run, /*nop*/, (void), _hashtbl_prime_bucket_count, _hashtbl_prime_index_for_hash, 0, \
+                             reallocarray, free) \
+    \
+    typedef TblTypeName##_Keys_ConstKey TblTypeName##_ConstKey; \
+    typedef struct { \
+        TblTypeName##_Keys keys; \
+        TblTypeName##_Chunk *chunks; \
+        unsigned chunks_allocated; \
+        unsigned chunks_used; \
+        unsigned firstfree[HASHTBL_MULTIMAP_MAX_CHUNK_BITS + 1]; \
+        TblTypeName##_Value *values; \
+        size_t values_allocated; \
+        size_t values_used; \
+        size_t value_count; \
+    } TblTypeName; \
+    \
+    static inline void \
+    function_prefix##_init(TblTypeName *tbl) \
+    { \
+        function_prefix##_keys_init(&tbl->keys); \
+        tbl->chunks = NULL; \
+        tbl->chunks_allocated = 0; \
+        tbl->chunks_used = 0; \
+        for (unsigned b = 0; b <= HASHTBL_MULTIMAP_MAX_CHUNK_BITS; ++b) \
+            tbl->firstfree[b] = (unsigned)-1; \
+        tbl->values = NULL; \
+        tbl->values_allocated = 0; \
+        tbl->values_used = 0; \
+        tbl->value_count = 0; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_free_values(TblTypeName *tbl, TblTypeName##_Run *run) \
+    { \
+        for (unsigned c = run->first; c != (unsigned)-1; ) { \
+            TblTypeName##_Chunk *chunk = &tbl->chunks[c]; \
+            for (unsigned i = 0; i < chunk->used; ++i) \
+                value_free_func(tbl->values[chunk->offset + i]); \
+            \
+            unsigned next = chunk->next; \
+            chunk->next = tbl->firstfree[chunk->size_bits]; \
+            chunk->used = 0; \
+            tbl->firstfree[chunk->size_bits] = c; \
+            c = next; \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TblTypeName *tbl) \
+    { \
+        TblTypeName##_Keys_Iterator it; \
+        function_prefix##_keys_iterator_init(&tbl->keys, &it); \
+        while (!function_prefix##_keys_iterator_at_end(&it)) { \
+            function_prefix##_internal_free_values(tbl, &function_prefix##_keys_iterator_item(&it)->value); \
+            function_prefix##_keys_iterator_next(&it); \
+        } \
+        \
+        function_prefix##_keys_clear(&tbl->keys); \
+        free(tbl->chunks); \
+        free(tbl->values); \
+        function_prefix##_init(tbl); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_key_count(TblTypeName *tbl) \
+    { \
+        return function_prefix##_keys_size(&tbl->keys); \
+    } \
+    \
+    static inline size_t \
+    function_prefix##_value_count(TblTypeName *tbl) \
+    { \
+        return tbl->value_count; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_count(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        TblTypeName##_Keys_Item *item = function_prefix##_keys_lookup(&tbl->keys, key); \
+        return item ? item->value.count : 0; \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_keys_contains(&tbl->keys, key); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_alloc_chunk(TblTypeName *tbl, unsigned size_bits) \
+    { \
+        unsigned c = tbl->firstfree[size_bits]; \
+        if (c != (unsigned)-1) { \
+            tbl->firstfree[size_bits] = tbl->chunks[c].next; \
+        } else { \
+            if (tbl->chunks_used == tbl->chunks_allocated) { \
+                if (tbl->chunks_allocated >= 0x7fffffffu) \
+                    return (unsigned)-1; \
+                \
+                unsigned new_allocated = tbl->chunks_allocated ? tbl->chunks_allocated * 2 : 16; \
+                TblTypeName##_Chunk *chunks = (TblTypeName##_Chunk *)reallocarray(tbl->chunks, new_allocated, sizeof(TblTypeName##_Chunk)); \
+                if (!chunks) \
+                    return (unsigned)-1; \
+                \
+                tbl->chunks = chunks; \
+                tbl->chunks_allocated = new_allocated; \
+            } \
+            \
+            size_t size = (size_t)1 << size_bits; \
+            if (tbl->values_allocated - tbl->values_used < size) { \
+                size_t new_allocated = tbl->values_allocated ? tbl->values_allocated : 16; \
+                while (new_allocated - tbl->values_used < size) { \
+                    if (new_allocated > (size_t)-1 / 2) \
+                        return (unsigned)-1; \
+                    new_allocated *= 2; \
+                } \
+                \
+                TblTypeName##_Value *values = (TblTypeName##_Value *)reallocarray(tbl->values, new_allocated, sizeof(TblTypeName##_Value)); \
+                if (!values) \
+                    return (unsigned)-1; \
+                \
+                tbl->values = values; \
+                tbl->values_allocated = new_allocated; \
+            } \
+            \
+            c = tbl->chunks_used++; \
+            tbl->chunks[c].size_bits = size_bits; \
+            tbl->chunks[c].offset = tbl->values_used; \
+            tbl->values_used += size; \
+        } \
+        \
+        tbl->chunks[c].next = (unsigned)-1; \
+        tbl->chunks[c].used = 0; \
+        return c; \
+    } \
+    \
+    static inline int \
+    function_prefix##_append(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        int inserted; \
+        TblTypeName##_Keys_Item *item = function_prefix##_keys_lookup_or_insert_zero(&tbl->keys, key, &inserted); \
+        if (!item) \
+            return 0; \
+        \
+        TblTypeName##_Run *run = &item->value; \
+        if (inserted) { \
+            unsigned c = function_prefix##_internal_alloc_chunk(tbl, 0); \
+            if (c == (unsigned)-1) { \
+                function_prefix##_keys_remove(&tbl->keys, key); \
+                return 0; \
+            } \
+            run->first = run->last = c; \
+            run->offset = tbl->chunks[c].offset; \
+        } else if (tbl->chunks[run->last].used == 1u << tbl->chunks[run->last].size_bits) { \
+            unsigned last = run->last; \
+            unsigned size_bits = tbl->chunks[last].size_bits; \
+            unsigned c = function_prefix##_internal_alloc_chunk(tbl, size_bits < HASHTBL_MULTIMAP_MAX_CHUNK_BITS ? size_bits + 1 : size_bits); \
+            if (c == (unsigned)-1) \
+                return 0; \
+            \
+            if (size_bits < HASHTBL_MULTIMAP_MAX_CHUNK_BITS) { \
+                /* the key's only chunk: move its values to the larger one */ \
+                memcpy(&tbl->values[tbl->chunks[c].offset], &tbl->values[tbl->chunks[last].offset], \
+                       tbl->chunks[last].used * sizeof(TblTypeName##_Value)); \
+                tbl->chunks[c].used = tbl->chunks[last].used; \
+                tbl->chunks[last].used = 0; \
+                tbl->chunks[last].next = tbl->firstfree[size_bits]; \
+                tbl->firstfree[size_bits] = last; \
+                run->first = c; \
+                run->offset = tbl->chunks[c].offset; \
+            } else { \
+                tbl->chunks[last].next = c; \
+            } \
+            run->last = c; \
+        } \
+        \
+        TblTypeName##_Chunk *chunk = &tbl->chunks[run->last]; \
+        tbl->values[chunk->offset + chunk->used++] = value_dup_func(value); \
+        run->count++; \
+        tbl->value_count++; \
+        return 1; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        TblTypeName##_Keys_Item *item = function_prefix##_keys_lookup(&tbl->keys, key); \
+        if (!item) \
+            return 0; \
+        \
+        unsigned count = item->value.count; \
+        function_prefix##_internal_free_values(tbl, &item->value); \
+        function_prefix##_keys_remove(&tbl->keys, key); \
+        tbl->value_count -= count; \
+        return count; \
+    } \
+    \
+    /* the range holds a copy of the current chunk's position, fill and link */ \
+    typedef struct { \
+        TblTypeName *tbl; \
+        size_t offset; \
+        unsigned i; \
+        unsigned used; \
+        unsigned next; \
+    } TblTypeName##_Range; \
+    \
+    static inline void \
+    function_prefix##_internal_range_enter(TblTypeName##_Range *range, unsigned c) \
+    { \
+        range->i = 0; \
+        if (c == (unsigned)-1) { \
+            range->used = 0; \
+            return; \
+        } \
+        \
+        range->offset = range->tbl->chunks[c].offset; \
+        range->used = range->tbl->chunks[c].used; \
+        range->next = range->tbl->chunks[c].next; \
+    } \
+    \
+    static inline void \
+    function_prefix##_equal_range(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_Range *range) \
+    { \
+        TblTypeName##_Keys_Item *item = function_prefix##_keys_lookup(&tbl->keys, key); \
+        range->tbl = tbl; \
+        if (item && item->value.first == item->value.last) { \
+            range->offset = item->value.offset; \
+            range->i = 0; \
+            range->used = item->value.count; \
+            range->next = (unsigned)-1; \
+        } else { \
+            function_prefix##_internal_range_enter(range, item ? item->value.first : (unsigned)-1); \
+        } \
+    } \
+    \
+    static inline int \
+    function_prefix##_range_at_end(TblTypeName##_Range *range) \
+    { \
+        return range->i >= range->used; \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_range_value(TblTypeName##_Range *range) \
+    { \
+        return &range->tbl->values[range->offset + range->i]; \
+    } \
+    \
+    static inline void \
+    function_prefix##_range_next(TblTypeName##_Range *range) \
+    { \
+        if (range->i >= range->used) \
+            return; \
+        \
+        if (++range->i == range->used) \
+            function_prefix##_internal_range_enter(range, range->next); \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_range_run(TblTypeName##_Range *range, unsigned *len) \
+    { \
+        if (range->i >= range->used) { \
+            *len = 0; \
+            return NULL; \
+        } \
+        \
+        TblTypeName##_Value *values = &range->tbl->values[range->offset + range->i]; \
+        *len = range->used - range->i; \
+        function_prefix##_internal_range_enter(range, range->next); \
+        return values; \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity(TblTypeName *tbl) \
+    { \
+        if (!function_prefix##_keys_check_internal_sanity(&tbl->keys)) \
+            return 0; \
+        \
+        size_t values = 0; \
+        size_t slots = 0; \
+        unsigned chunks = 0; \
+        TblTypeName##_Keys_Iterator it; \
+        function_prefix##_keys_iterator_init(&tbl->keys, &it); \
+        while (!function_prefix##_keys_iterator_at_end(&it)) { \
+            TblTypeName##_Run *run = &function_prefix##_keys_iterator_item(&it)->value; \
+            unsigned count = 0; \
+            unsigned c = run->first; \
+            for (;;) { \
+                if (c >= tbl->chunks_used || ++chunks > tbl->chunks_used) \
+                    return 0; \
+                unsigned size_bits = tbl->chunks[c].size_bits; \
+                if (!tbl->chunks[c].used || tbl->chunks[c].used > 1u << size_bits) \
+                    return 0; \
+                if (c == run->first && tbl->chunks[c].used <= (1u << size_bits) / 2) \
+                    return 0; /* the first chunk was only grown once the smaller one was full */ \
+                count += tbl->chunks[c].used; \
+                slots += (size_t)1 << size_bits; \
+                if (tbl->chunks[c].next == (unsigned)-1) \
+                    break; \
+                if (size_bits != HASHTBL_MULTIMAP_MAX_CHUNK_BITS || tbl->chunks[c].used != 1u << size_bits) \
+                    return 0; /* chains are made of full chunks of the maximum size */ \
+                c = tbl->chunks[c].next; \
+            } \
+            \
+            if (c != run->last || count != run->count || run->offset != tbl->chunks[run->first].offset) \
+                return 0; \
+            values += count; \
+            function_prefix##_keys_iterator_next(&it); \
+        } \
+        \
+        for (unsigned b = 0; b <= HASHTBL_MULTIMAP_MAX_CHUNK_BITS; ++b) { \
+            for (unsigned c = tbl->firstfree[b]; c != (unsigned)-1; c = tbl->chunks[c].next) { \
+                if (c >= tbl->chunks_used || ++chunks > tbl->chunks_used || tbl->chunks[c].size_bits != b) \
+                    return 0; \
+                slots += (size_t)1 << b; \
+            } \
+        } \
+        \
+        /* the chunks account for all of the value array that has been handed out */ \
+        return values == tbl->value_count && chunks == tbl->chunks_used \
+            && slots == tbl->values_used && tbl->values_used <= tbl->values_allocated; \
+    } \
+    \
+
@@ -0,0 +1,133 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+#include <pthread.h>
+
+/* Parallel reduction of hashtbl2.h tables
+ *
+ * How-To:
+ *      HASHTBL_DEFINE(WordCount, word_count,
+ *                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+ *                     HASHTBL_VALUE(int))
+ *      HASHTBL_DEFINE_PARALLEL_MERGE(WordCount, word_count)
+ *
+ *      static void add(int *value, int src_value, void *ctx) { *value += src_value; }
+ *
+ *      // every thread counts into its own table
+ *      WordCount per_thread[NUM_THREADS];
+ *      ...
+ *
+ *      // and the results are merged into per_thread[0]
+ *      word_count_merge_parallel(per_thread, NUM_THREADS, add, NULL);
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_PARALLEL_MERGE(TypeName, function_prefix)
+ *          Defines the function below for a table previously defined by one
+ *          of the HASHTBL_DEFINE macros from hashtbl2.h.
+ *
+ *      int
+ *      function_prefix_merge_parallel(TypeName *tbls, unsigned count,
+ *                                     void (*combine_func)(ValueType *value, ConstValueType src_value, void *ctx), void *ctx)
+ *          Merges all `count` tables into tbls[0] with function_prefix_merge()
+ *          in log2(count) rounds; each round merges pairs of tables on
+ *          separate threads. The other tables are left empty. combine_func
+ *          may be called from several threads at once, but never for the same
+ *          value. Returns 0 if memory ran out, in which case some items are
+ *          still in the other tables.
+ */
+
+#define HASHTBL_DEFINE_PARALLEL_MERGE(TblTypeName, function_prefix) \
+    \
+    typedef struct { \
+        TblTypeName *dst; \
+        TblTypeName *src; \
+        void (*combine_func)(TblTypeName##_Value *value, TblTypeName##_ConstValue src_value, void *ctx); \
+        void *ctx; \
+        int ok; \
+    } TblTypeName##_MergeJob; \
+    \
+    static inline void * \
+    function_prefix##_internal_merge_job(void *arg) \
+    { \
+        TblTypeName##_MergeJob *job = (TblTypeName##_MergeJob *)arg; \
+        job->ok = function_prefix##_merge(job->dst, job->src, job->combine_func, job->ctx); \
+        return NULL; \
+    } \
+    \
+    static inline int \
+    function_prefix##_merge_parallel(TblTypeName *tbls, unsigned count, \
+                                     void (*combine_func)(TblTypeName##_Value *value, TblTypeName##_ConstValue src_value, void *ctx), void *ctx) \
+    { \
+        if (count < 2) \
+            return 1; \
+        \
+        unsigned max_jobs = count / 2; \
+        TblTypeName##_MergeJob *jobs = (TblTypeName##_MergeJob *)calloc(max_jobs, sizeof(TblTypeName##_MergeJob)); \
+        pthread_t *threads = (pthread_t *)calloc(max_jobs, sizeof(pthread_t)); \
+        int *started = (int *)calloc(max_jobs, sizeof(int)); \
+        int ok = jobs && threads && started; \
+        \
+        for (unsigned stride = 1; ok && stride < count; stride *= 2) { \
+            unsigned njobs = 0; \
+            for (unsigned i = 0; i + stride < count; i += 2 * stride) { \
+                jobs[njobs].dst = &tbls[i]; \
+                jobs[njobs].src = &tbls[i + stride]; \
+                jobs[njobs].combine_func = combine_func; \
+                jobs[njobs].ctx = ctx; \
+                jobs[njobs].ok = 0; \
+                ++njobs; \
+            } \
+            \
+            /* the calling thread does the first merge itself */ \
+            for (unsigned j = 1; j < njobs; ++j) \
+                started[j] = !pthread_create(&threads[j], NULL, function_prefix##_internal_merge_job, &jobs[j]); \
+            \
+            function_prefix##_internal_merge_job(&jobs[0]); \
+            \
+            for (unsigned j = 1; j < njobs; ++j) { \
+                if (started[j]) \
+                    pthread_join(threads[j], NULL); \
+                else \
+                    function_prefix##_internal_merge_job(&jobs[j]); \
+            } \
+            \
+            for (unsigned j = 0; j < njobs; ++j) \
+                ok = ok && jobs[j].ok; \
+        } \
+        \
+        if (!(jobs && threads && started)) { \
+            /* no memory for the bookkeeping, merge sequentially */ \
+            ok = 1; \
+            for (unsigned i = 1; i < count; ++i) \
+                ok = function_prefix##_merge(&tbls[0], &tbls[i], combine_func, ctx) && ok; \
+        } \
+        \
+        free(jobs); \
+        free(threads); \
+        free(started); \
+        \
+        return ok; \
+    } \
+    \
+
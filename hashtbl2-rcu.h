@@ -0,0 +1,427 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+#include "epoch.h"
+
+/* Read-mostly hash map with lock-free readers
+ *
+ * How-To:
+ *      HASHTBL_DEFINE_RCU(Routes, routes,
+ *                         HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+ *                         HASHTBL_VALUE(int))
+ *
+ *      Routes r;
+ *      routes_init(&r);
+ *
+ *      // writers, any thread
+ *      routes_set(&r, "10.0.0.0/8", 3);
+ *
+ *      // readers, any thread
+ *      EpochThread self;
+ *      routes_register_thread(&r, &self);
+ *
+ *      routes_read_lock(&r, &self);
+ *      const Routes_Item *item = routes_lookup(&r, "10.0.0.0/8");
+ *      if (item)
+ *          use(item->value);
+ *      routes_read_unlock(&r, &self);  // item may be freed from now on
+ *
+ *      routes_unregister_thread(&r, &self);
+ *
+ *      routes_clear(&r);
+ *
+ * Items are immutable once published. Writers are serialized by a mutex and
+ * replace items and bucket arrays by atomically swapping pointers, so readers
+ * see either the old or the new version. Replaced memory is reclaimed through
+ * epoch.h once no reader can still hold it. Readers take no lock and don't
+ * write shared memory, which makes lookups scale with the number of cores as
+ * long as updates are rare. Each update allocates, so this is a poor fit for
+ * write-heavy tables.
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_RCU(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC)
+ *      HASHTBL_DEFINE_RCU_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+ *          Defines types and functions. The specs are the same as for
+ *          HASHTBL_DEFINE from hashtbl2.h.
+ *
+ *      void
+ *      function_prefix_init(TypeName *tbl)
+ *
+ *      void
+ *      function_prefix_clear(TypeName *tbl)
+ *          Frees all memory. There must not be any readers or writers left.
+ *          Call function_prefix_init() again to reuse the table.
+ *
+ *      unsigned
+ *      function_prefix_size(TypeName *tbl)
+ *
+ *      Reader functions:
+ *
+ *      void
+ *      function_prefix_register_thread(TypeName *tbl, EpochThread *t)
+ *      void
+ *      function_prefix_unregister_thread(TypeName *tbl, EpochThread *t)
+ *          See epoch_thread_register() and epoch_thread_unregister().
+ *
+ *      void
+ *      function_prefix_read_lock(TypeName *tbl, EpochThread *t)
+ *      void
+ *      function_prefix_read_unlock(TypeName *tbl, EpochThread *t)
+ *          Items returned by lookups stay valid until the read section ends.
+ *          Doesn't block and doesn't write to shared memory.
+ *
+ *      const TypeName_Item *
+ *      function_prefix_lookup(TypeName *tbl, ConstKeyType key)
+ *      const TypeName_Item *
+ *      function_prefix_lookup_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key)
+ *      int
+ *      function_prefix_contains(TypeName *tbl, ConstKeyType key)
+ *          Must be called within a read section.
+ *
+ *      Writer functions, which may be called from any thread:
+ *
+ *      int
+ *      function_prefix_set(TypeName *tbl, ConstKeyType key, ConstValueType value)
+ *          Publishes a new item for the key. Returns zero on allocation failure.
+ *
+ *      void
+ *      function_prefix_remove(TypeName *tbl, ConstKeyType key)
+ *
+ *      void
+ *      function_prefix_synchronize(TypeName *tbl)
+ *          Waits until all replaced items have been freed. Must not be called
+ *          within a read section. Writers reclaim memory on every update
+ *          anyway, this is only needed to bound the memory use after the
+ *          last update.
+ */
+
+#define HASHTBL_DEFINE_RCU(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
+    HASHTBL__INTERNAL_DEFINE_RCU(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+
+#define HASHTBL_DEFINE_RCU_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
+    HASHTBL__INTERNAL_DEFINE_RCU(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+
+#define HASHTBL__INTERNAL_DEFINE_RCU(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+    \
+    typedef KeyType         TblTypeName##_Key; \
+    typedef ConstKeyType    TblTypeName##_ConstKey; \
+    typedef ValueType       TblTypeName##_Value; \
+    typedef ConstValueType  TblTypeName##_ConstValue; \
+    typedef struct TblTypeName##_Item { \
+        EpochRetired retired; \
+        struct TblTypeName##_Item *next; \
+        unsigned hash; \
+        TblTypeName##_Key   key; \
+        TblTypeName##_Value value; \
+    } TblTypeName##_Item; \
+    typedef struct { \
+        EpochRetired retired; \
+        unsigned shift; \
+        TblTypeName##_Item **slots; \
+    } TblTypeName##_Buckets; \
+    typedef struct { \
+        TblTypeName##_Buckets *buckets; \
+        unsigned element_count; \
+        pthread_mutex_t write_lock; \
+        EpochDomain epoch; \
+        uint64_t hash_seed; \
+    } TblTypeName; \
+    \
+    static inline unsigned \
+    function_prefix##_internal_index_for_hash(const TblTypeName##_Buckets *b, unsigned hash) \
+    { \
+        return ((hash * 2654435769u) & 0xffffffffu) >> b->shift; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_free_item(EpochRetired *r) \
+    { \
+        TblTypeName##_Item *item = (TblTypeName##_Item *)(void *)r; \
+        key_free_func(item->key); \
+        value_free_func(item->value); \
+        free(item); \
+    } \
+    \
+    /* the key is still used by the item which replaced this one */ \
+    static inline void \
+    function_prefix##_internal_free_replaced_item(EpochRetired *r) \
+    { \
+        TblTypeName##_Item *item = (TblTypeName##_Item *)(void *)r; \
+        value_free_func(item->value); \
+        free(item); \
+    } \
+    \
+    /* key and value have been moved to a copy of the item */ \
+    static inline void \
+    function_prefix##_internal_free_moved_item(EpochRetired *r) \
+    { \
+        free(r); \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_free_buckets(EpochRetired *r) \
+    { \
+        free(r); \
+    } \
+    \
+    static inline void \
+    function_prefix##_init(TblTypeName *tbl) \
+    { \
+        tbl->hash_seed = key_hash_call(HASHTBL__USES_SEED, 0, 0) ? _hashtbl_random_seed(tbl) : 0; \
+        tbl->buckets = NULL; \
+        tbl->element_count = 0; \
+        pthread_mutex_init(&tbl->write_lock, NULL); \
+        epoch_init(&tbl->epoch); \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TblTypeName *tbl) \
+    { \
+        TblTypeName##_Buckets *b = tbl->buckets; \
+        if (b) { \
+            for (unsigned i = 0; i < (1u << (32 - b->shift)); ++i) { \
+                TblTypeName##_Item *item = b->slots[i]; \
+                while (item) { \
+                    TblTypeName##_Item *next = item->next; \
+                    function_prefix##_internal_free_item(&item->retired); \
+                    item = next; \
+                } \
+            } \
+            free(b); \
+        } \
+        \
+        epoch_clear(&tbl->epoch); \
+        pthread_mutex_destroy(&tbl->write_lock); \
+        tbl->buckets = NULL; \
+        tbl->element_count = 0; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TblTypeName *tbl) \
+    { \
+        return __atomic_load_n(&tbl->element_count, __ATOMIC_RELAXED); \
+    } \
+    \
+    static inline void \
+    function_prefix##_register_thread(TblTypeName *tbl, EpochThread *t) \
+    { \
+        epoch_thread_register(&tbl->epoch, t); \
+    } \
+    \
+    static inline void \
+    function_prefix##_unregister_thread(TblTypeName *tbl, EpochThread *t) \
+    { \
+        epoch_thread_unregister(&tbl->epoch, t); \
+    } \
+    \
+    static inline void \
+    function_prefix##_read_lock(TblTypeName *tbl, EpochThread *t) \
+    { \
+        epoch_read_lock(&tbl->epoch, t); \
+    } \
+    \
+    static inline void \
+    function_prefix##_read_unlock(TblTypeName *tbl, EpochThread *t) \
+    { \
+        epoch_read_unlock(&tbl->epoch, t); \
+    } \
+    \
+    static inline const TblTypeName##_Item * \
+    function_prefix##_lookup_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        TblTypeName##_Buckets *b = __atomic_load_n(&tbl->buckets, __ATOMIC_ACQUIRE); \
+        if (!b) \
+            return NULL; \
+        \
+        unsigned i = function_prefix##_internal_index_for_hash(b, hash); \
+        for (TblTypeName##_Item *item = __atomic_load_n(&b->slots[i], __ATOMIC_ACQUIRE); \
+             item; \
+             item = __atomic_load_n(&item->next, __ATOMIC_ACQUIRE)) { \
+            if (item->hash == hash && key_equal_func(item->key, key)) \
+                return item; \
+        } \
+        \
+        return NULL; \
+    } \
+    \
+    static inline const TblTypeName##_Item * \
+    function_prefix##_lookup(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup_with_hash(tbl, key_hash_call(key_hash_func, key, tbl->hash_seed), key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup(tbl, key) != NULL; \
+    } \
+    \
+    /* requires the write lock */ \
+    static inline TblTypeName##_Buckets * \
+    function_prefix##_internal_alloc_buckets(unsigned shift) \
+    { \
+        unsigned count = 1u << (32 - shift); \
+        TblTypeName##_Buckets *b = (TblTypeName##_Buckets *)reallocarray(NULL, 1, sizeof(TblTypeName##_Buckets) + count * sizeof(TblTypeName##_Item *)); \
+        if (!b) \
+            return NULL; \
+        \
+        b->shift = shift; \
+        b->slots = (TblTypeName##_Item **)(void *)(b + 1); \
+        for (unsigned i = 0; i < count; ++i) \
+            b->slots[i] = NULL; \
+        \
+        return b; \
+    } \
+    \
+    /* requires the write lock. Readers may still be walking the old buckets, \
+     * so all items are copied into the new ones. */ \
+    static inline int \
+    function_prefix##_internal_grow(TblTypeName *tbl) \
+    { \
+        TblTypeName##_Buckets *old = tbl->buckets; \
+        if (old && old->shift <= 1) \
+            return 0; \
+        \
+        TblTypeName##_Buckets *b = function_prefix##_internal_alloc_buckets(old ? old->shift - 1 : 28); \
+        if (!b) \
+            return 0; \
+        \
+        if (old) { \
+            for (unsigned i = 0; i < (1u << (32 - old->shift)); ++i) { \
+                for (TblTypeName##_Item *item = old->slots[i]; item; item = item->next) { \
+                    TblTypeName##_Item *copy = (TblTypeName##_Item *)reallocarray(NULL, 1, sizeof(TblTypeName##_Item)); \
+                    if (!copy) { \
+                        for (unsigned j = 0; j < (1u << (32 - b->shift)); ++j) { \
+                            while (b->slots[j]) { \
+                                TblTypeName##_Item *next = b->slots[j]->next; \
+                                free(b->slots[j]); \
+                                b->slots[j] = next; \
+                            } \
+                        } \
+                        free(b); \
+                        return 0; \
+                    } \
+                    \
+                    *copy = *item; \
+                    unsigned new_i = function_prefix##_internal_index_for_hash(b, item->hash); \
+                    copy->next = b->slots[new_i]; \
+                    b->slots[new_i] = copy; \
+                } \
+            } \
+        } \
+        \
+        __atomic_store_n(&tbl->buckets, b, __ATOMIC_RELEASE); \
+        \
+        if (old) { \
+            for (unsigned i = 0; i < (1u << (32 - old->shift)); ++i) { \
+                for (TblTypeName##_Item *item = old->slots[i]; item; ) { \
+                    TblTypeName##_Item *next = item->next; \
+                    epoch_retire(&tbl->epoch, &item->retired, function_prefix##_internal_free_moved_item); \
+                    item = next; \
+                } \
+            } \
+            epoch_retire(&tbl->epoch, &old->retired, function_prefix##_internal_free_buckets); \
+        } \
+        \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_set(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        unsigned hash = key_hash_call(key_hash_func, key, tbl->hash_seed); \
+        \
+        pthread_mutex_lock(&tbl->write_lock); \
+        \
+        if (!tbl->buckets || tbl->element_count >= (1u << (32 - tbl->buckets->shift))) { \
+            if (!function_prefix##_internal_grow(tbl) && !tbl->buckets) { \
+                pthread_mutex_unlock(&tbl->write_lock); \
+                return 0; \
+            } \
+        } \
+        \
+        TblTypeName##_Buckets *b = tbl->buckets; \
+        TblTypeName##_Item **head = &b->slots[function_prefix##_internal_index_for_hash(b, hash)]; \
+        TblTypeName##_Item **link = head; \
+        while (*link && !((*link)->hash == hash && key_equal_func((*link)->key, key))) \
+            link = &(*link)->next; \
+        \
+        TblTypeName##_Item *item = (TblTypeName##_Item *)reallocarray(NULL, 1, sizeof(TblTypeName##_Item)); \
+        if (!item) { \
+            pthread_mutex_unlock(&tbl->write_lock); \
+            return 0; \
+        } \
+        \
+        TblTypeName##_Item *old = *link; \
+        item->hash = hash; \
+        item->value = value_dup_func(value); \
+        if (old) { \
+            item->key = old->key; \
+            item->next = old->next; \
+            __atomic_store_n(link, item, __ATOMIC_RELEASE); \
+            epoch_retire(&tbl->epoch, &old->retired, function_prefix##_internal_free_replaced_item); \
+        } else { \
+            item->key = key_dup_func(key); \
+            item->next = *head; \
+            __atomic_store_n(head, item, __ATOMIC_RELEASE); \
+            __atomic_store_n(&tbl->element_count, tbl->element_count + 1, __ATOMIC_RELAXED); \
+        } \
+        \
+        epoch_collect(&tbl->epoch); \
+        \
+        pthread_mutex_unlock(&tbl->write_lock); \
+        return 1; \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        unsigned hash = key_hash_call(key_hash_func, key, tbl->hash_seed); \
+        \
+        pthread_mutex_lock(&tbl->write_lock); \
+        \
+        TblTypeName##_Buckets *b = tbl->buckets; \
+        if (b) { \
+            TblTypeName##_Item **link = &b->slots[function_prefix##_internal_index_for_hash(b, hash)]; \
+            while (*link && !((*link)->hash == hash && key_equal_func((*link)->key, key))) \
+                link = &(*link)->next; \
+            \
+            TblTypeName##_Item *old = *link; \
+            if (old) { \
+                __atomic_store_n(link, old->next, __ATOMIC_RELEASE); \
+                __atomic_store_n(&tbl->element_count, tbl->element_count - 1, __ATOMIC_RELAXED); \
+                epoch_retire(&tbl->epoch, &old->retired, function_prefix##_internal_free_item); \
+                epoch_collect(&tbl->epoch); \
+            } \
+        } \
+        \
+        pthread_mutex_unlock(&tbl->write_lock); \
+    } \
+    \
+    static inline void \
+    function_prefix##_synchronize(TblTypeName *tbl) \
+    { \
+        epoch_barrier(&tbl->epoch); \
+    } \
+    \
+
@@ -0,0 +1,404 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+/* Robin Hood variant of the hashtbl2.h hash map
+ *
+ * The interface is the same as for HASHTBL_DEFINE:
+ *
+ *      HASHTBL_DEFINE_ROBIN(MyTable, my_table,
+ *                           HASHTBL_KEY(const char *, str_hash, str_equal),
+ *                           HASHTBL_VALUE(int))
+ *
+ * Items are stored in a single power-of-two sized slot array using linear
+ * probing. Each item remembers its distance from its home slot, and an
+ * insert will displace any item that is closer to home than the new one
+ * ("take from the rich"). This keeps the variance of probe lengths low, and
+ * lookups can stop as soon as they meet an item which is closer to home than
+ * the searched key would be. Removal shifts the following items back by one
+ * slot instead of leaving tombstones, so the table stays fast up to its
+ * maximum load of 90%.
+ *
+ * Limits:
+ *      - only supports up to 2^31 slots
+ *      - item pointers are potentially invalid after adding or removing elements
+ *      - will never shrink when removing elements
+ *      - not safe against algorithmic complexity attacks
+ *      - iteration order is not related to insertion order
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_ROBIN(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC)
+ *      HASHTBL_DEFINE_ROBIN_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_fun, free_fun)
+ *          Like HASHTBL_DEFINE and HASHTBL_DEFINE_FULL from hashtbl2.h.
+ *
+ *      The following functions from hashtbl2.h are available with the same
+ *      semantics:
+ *
+ *          init, init_reserve, clear, size, lookup, lookup_with_hash,
+ *          contains, set, set_zero, remove, iterator_init, iterator_at_end,
+ *          iterator_item, iterator_next, iterator_delete,
+ *          check_internal_sanity
+ *
+ *      The TypeName_Item struct contains `hash`, `dist`, `key` and `value`
+ *      members; `dist` is 0 for an empty slot and 1 for an item in its home
+ *      slot. Keys are always copied with the dup function of the KEY_SPEC,
+ *      so HASHTBL_KEY_ARENA is not supported, and neither are alternative
+ *      key types.
+ *
+ *      int
+ *      function_prefix_check_internal_sanity_histogram(TypeName *tbl, unsigned *histogram, unsigned histogram_len)
+ *          Like function_prefix_check_internal_sanity(), but also fills
+ *          histogram[i] with the number of items that need i+1 probes to be
+ *          found. Items with longer probe lengths are counted in the last
+ *          histogram entry.
+ */
+
+#define HASHTBL_DEFINE_ROBIN(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
+    HASHTBL__INTERNAL_DEFINE_ROBIN(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+
+#define HASHTBL_DEFINE_ROBIN_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
+    HASHTBL__INTERNAL_DEFINE_ROBIN(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+
+#define HASHTBL__INTERNAL_DEFINE_ROBIN(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+    \
+    typedef KeyType         TblTypeName##_Key; \
+    typedef ConstKeyType    TblTypeName##_ConstKey; \
+    typedef ValueType       TblTypeName##_Value; \
+    typedef ConstValueType  TblTypeName##_ConstValue; \
+    typedef struct TblTypeName##_Item { \
+        unsigned hash; \
+        unsigned dist; \
+        TblTypeName##_Key   key; \
+        TblTypeName##_Value value; \
+    } TblTypeName##_Item; \
+    typedef struct { \
+        unsigned element_count; \
+        unsigned capacity; \
+        TblTypeName##_Item *item_storage; \
+        uint64_t hash_seed; \
+    } TblTypeName; \
+    \
+    static inline void \
+    function_prefix##_init(TblTypeName *tbl) \
+    { \
+        tbl->hash_seed = key_hash_call(HASHTBL__USES_SEED, 0, 0) ? _hashtbl_random_seed(tbl) : 0; \
+        tbl->element_count = 0; \
+        tbl->capacity = 0; \
+        tbl->item_storage = NULL; \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TblTypeName *tbl) \
+    { \
+        for (unsigned i = 0; i < tbl->capacity; ++i) { \
+            if (!tbl->item_storage[i].dist) \
+                continue; \
+            \
+            key_free_func(tbl->item_storage[i].key); \
+            value_free_func(tbl->item_storage[i].value); \
+        } \
+        \
+        free(tbl->item_storage); \
+        function_prefix##_init(tbl); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TblTypeName *tbl) \
+    { \
+        return tbl->element_count; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_index_for_hash(TblTypeName *tbl, unsigned hash) \
+    { \
+        return _hashtbl_mix(hash) & (tbl->capacity - 1); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_find(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        if (!tbl->capacity) \
+            return (unsigned)-1; \
+        \
+        unsigned mask = tbl->capacity - 1; \
+        unsigned item_i = function_prefix##_internal_index_for_hash(tbl, hash); \
+        for (unsigned dist = 1; dist <= tbl->item_storage[item_i].dist; ++dist) { \
+            if (tbl->item_storage[item_i].hash == hash && key_equal_func(tbl->item_storage[item_i].key, key)) \
+                return item_i; \
+            \
+            item_i = (item_i + 1) & mask; \
+        } \
+        \
+        return (unsigned)-1; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        unsigned item_i = function_prefix##_internal_find(tbl, hash, key); \
+        return item_i != (unsigned)-1 ? &tbl->item_storage[item_i] : NULL; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup_with_hash(tbl, key_hash_call(key_hash_func, key, tbl->hash_seed), key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup(tbl, key) != NULL; \
+    } \
+    \
+    /* Places the (not yet contained) item, displacing richer items as needed. \
+       Returns the slot where the given item ended up. */ \
+    static inline unsigned \
+    function_prefix##_internal_place(TblTypeName *tbl, TblTypeName##_Item *item) \
+    { \
+        unsigned mask = tbl->capacity - 1; \
+        unsigned item_i = function_prefix##_internal_index_for_hash(tbl, item->hash); \
+        unsigned placed_i = (unsigned)-1; \
+        TblTypeName##_Item carry = *item; \
+        carry.dist = 1; \
+        \
+        for (;;) { \
+            TblTypeName##_Item *slot = &tbl->item_storage[item_i]; \
+            if (!slot->dist) { \
+                *slot = carry; \
+                return placed_i != (unsigned)-1 ? placed_i : item_i; \
+            } \
+            \
+            if (slot->dist < carry.dist) { \
+                TblTypeName##_Item tmp = *slot; \
+                *slot = carry; \
+                carry = tmp; \
+                if (placed_i == (unsigned)-1) \
+                    placed_i = item_i; \
+            } \
+            \
+            carry.dist++; \
+            item_i = (item_i + 1) & mask; \
+        } \
+    } \
+    \
+    static inline int \
+    function_prefix##_internal_rehash(TblTypeName *tbl, unsigned num_items) \
+    { \
+        unsigned new_capacity = 16; \
+        while (num_items > new_capacity - new_capacity/10) { \
+            if (new_capacity >= 0x80000000u) \
+                return 0; \
+            new_capacity *= 2; \
+        } \
+        \
+        TblTypeName##_Item *new_items = (TblTypeName##_Item *)reallocarray(NULL, new_capacity, sizeof(TblTypeName##_Item)); \
+        if (!new_items) \
+            return 0; \
+        memset(new_items, 0, new_capacity * sizeof(TblTypeName##_Item)); \
+        \
+        TblTypeName old = *tbl; \
+        tbl->capacity = new_capacity; \
+        tbl->item_storage = new_items; \
+        \
+        for (unsigned i = 0; i < old.capacity; ++i) { \
+            if (old.item_storage[i].dist) \
+                function_prefix##_internal_place(tbl, &old.item_storage[i]); \
+        } \
+        \
+        free(old.item_storage); \
+        return 1; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set_zero(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        unsigned hash = key_hash_call(key_hash_func, key, tbl->hash_seed); \
+        TblTypeName##_Item *item = function_prefix##_lookup_with_hash(tbl, hash, key); \
+        if (item) { \
+            value_free_func((item)->value); \
+            memset(&item->value, 0, sizeof(item->value)); \
+            return item; \
+        } \
+        \
+        if (tbl->element_count + 1 > tbl->capacity - tbl->capacity/10) { \
+            if (!function_prefix##_internal_rehash(tbl, tbl->element_count + 1) \
+                    && tbl->element_count + 1 >= tbl->capacity) \
+                return NULL; /* we need at least one empty slot */ \
+        } \
+        \
+        TblTypeName##_Item n; \
+        memset(&n, 0, sizeof n); \
+        n.hash = hash; \
+        n.key = key_dup_func(key); \
+        tbl->element_count++; \
+        return &tbl->item_storage[function_prefix##_internal_place(tbl, &n)]; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set(TblTypeName *ptbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        TblTypeName##_Item *item = function_prefix##_set_zero(ptbl, key); \
+        if (item) { \
+            item->value = value_dup_func(value); \
+        } \
+        return item; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_dealloc_item(TblTypeName *tbl, unsigned item_i) \
+    { \
+        key_free_func(tbl->item_storage[item_i].key); \
+        value_free_func(tbl->item_storage[item_i].value); \
+        \
+        /* backward shift: pull the following displaced items one slot closer to home */ \
+        unsigned mask = tbl->capacity - 1; \
+        unsigned next_i = (item_i + 1) & mask; \
+        while (tbl->item_storage[next_i].dist > 1) { \
+            tbl->item_storage[item_i] = tbl->item_storage[next_i]; \
+            tbl->item_storage[item_i].dist--; \
+            item_i = next_i; \
+            next_i = (next_i + 1) & mask; \
+        } \
+        \
+        memset(&tbl->item_storage[item_i], 0, sizeof(TblTypeName##_Item)); \
+        tbl->element_count--; \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        unsigned item_i = function_prefix##_internal_find(tbl, key_hash_call(key_hash_func, key, tbl->hash_seed), key); \
+        if (item_i != (unsigned)-1) \
+            function_prefix##_internal_dealloc_item(tbl, item_i); \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity_histogram(TblTypeName *tbl, unsigned *histogram, unsigned histogram_len) \
+    { \
+        for (unsigned i = 0; i < histogram_len; ++i) \
+            histogram[i] = 0; \
+        \
+        unsigned elcount = 0; \
+        for (unsigned i = 0; i < tbl->capacity; ++i) { \
+            unsigned dist = tbl->item_storage[i].dist; \
+            if (!dist) \
+                continue; \
+            \
+            elcount++; \
+            if (((function_prefix##_internal_index_for_hash(tbl, tbl->item_storage[i].hash) + dist - 1) & (tbl->capacity - 1)) != i) \
+                return 0; \
+            \
+            /* Robin Hood invariant: the previous slot is at most one step further from home */ \
+            unsigned prev_dist = tbl->item_storage[(i - 1) & (tbl->capacity - 1)].dist; \
+            if (dist > prev_dist + 1) \
+                return 0; \
+            \
+            if (histogram_len) \
+                histogram[dist - 1 < histogram_len ? dist - 1 : histogram_len - 1]++; \
+        } \
+        \
+        if (elcount != tbl->element_count) \
+            return 0; \
+        \
+        if (elcount > tbl->capacity - tbl->capacity/10) \
+            return 0; \
+        \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity(TblTypeName *tbl) \
+    { \
+        return function_prefix##_check_internal_sanity_histogram(tbl, NULL, 0); \
+    } \
+    \
+    /* Iteration runs backwards, starting just before an empty slot. A backward \
+       shift in _iterator_delete only moves already visited items then. */ \
+    typedef struct { \
+        TblTypeName *tbl; \
+        unsigned i; \
+        unsigned left; \
+    } TblTypeName##_Iterator; \
+    \
+    static inline void \
+    function_prefix##_internal_iterator_skip_empty(TblTypeName##_Iterator *it) { \
+        while (it->left && !it->tbl->item_storage[it->i].dist) { \
+            it->i = (it->i - 1) & (it->tbl->capacity - 1); \
+            it->left--; \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_init(TblTypeName *tbl, TblTypeName##_Iterator *it) { \
+        it->tbl = tbl; \
+        it->i = 0; \
+        it->left = 0; \
+        \
+        if (!tbl->element_count) \
+            return; \
+        \
+        while (tbl->item_storage[it->i].dist) \
+            it->i++; \
+        \
+        it->i = (it->i - 1) & (tbl->capacity - 1); \
+        it->left = tbl->capacity - 1; \
+        function_prefix##_internal_iterator_skip_empty(it); \
+    } \
+    \
+    static inline int \
+    function_prefix##_iterator_at_end(TblTypeName##_Iterator *it) { \
+        return !it->left; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_iterator_item(TblTypeName##_Iterator *it) { \
+        return &it->tbl->item_storage[it->i]; \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_next(TblTypeName##_Iterator *it) { \
+        if (!it->left) \
+            return; \
+        \
+        it->i = (it->i - 1) & (it->tbl->capacity - 1); \
+        it->left--; \
+        function_prefix##_internal_iterator_skip_empty(it); \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_delete(TblTypeName##_Iterator *it) { \
+        if (!it->left || !it->tbl->item_storage[it->i].dist) \
+            return; /*FIXME: complain about misuse */\
+        \
+        function_prefix##_internal_dealloc_item(it->tbl, it->i); \
+    } \
+    \
+    static inline void \
+    function_prefix##_init_reserve(TblTypeName *tbl, unsigned num_items) \
+    { \
+        function_prefix##_init(tbl); \
+        function_prefix##_internal_rehash(tbl, num_items); \
+    } \
+    \
+
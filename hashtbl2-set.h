@@ -0,0 +1,253 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2-indexmap.h"
+
+/* Hash set on top of hashtbl2.h
+ *
+ *      HASHSET_DEFINE(WordSet, word_set,
+ *                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal))
+ *
+ *      WordSet a, b, both;
+ *      word_set_init(&a);
+ *      word_set_init(&b);
+ *      word_set_init(&both);
+ *      word_set_add(&a, "foo");
+ *      ...
+ *      word_set_intersect(&both, &a, &b);
+ *
+ * Takes the same KEY_SPECs as HASHTBL_DEFINE, but items only hold the
+ * hash, chain link and key, there is no value and no padding for one.
+ * Items are chained from prime sized buckets like in hashtbl2.h and kept
+ * dense like in hashtbl2-indexmap.h: removal moves the last item into the
+ * gap, so iterating (which the set operations do a lot) only ever touches
+ * the items that are actually there.
+ *
+ * The set operations walk the smaller of two sets and probe the larger
+ * one with the hash stored in the item. For seeded keys, this needs both
+ * sets to use the same seed, which the operations arrange by giving an
+ * empty `out` set the seed of an input; otherwise keys are hashed again.
+ *
+ * Limits:
+ *      - only supports up to 2^32-2 items
+ *      - item pointers are potentially invalid after adding or removing elements
+ *      - will never shrink when removing elements
+ *      - not safe against algorithmic complexity attacks
+ *
+ * Reference Docs:
+ *
+ *      HASHSET_DEFINE(TypeName, function_prefix, KEY_SPEC)
+ *      HASHSET_DEFINE_FULL(TypeName, function_prefix, KEY_SPEC, reallocarray_fun, free_fun)
+ *          Defines the set type and functions, see HASHTBL_DEFINE for the
+ *          KEY_SPECs. TypeName_Item contains `hash`, `next` and `key`.
+ *
+ *      function_prefix_init, function_prefix_init_reserve, function_prefix_clear,
+ *      function_prefix_size, function_prefix_hash, function_prefix_lookup,
+ *      function_prefix_lookup_with_hash, function_prefix_contains,
+ *      function_prefix_check_internal_sanity
+ *          Like in hashtbl2.h.
+ *
+ *      int
+ *      function_prefix_add(TypeName *set, ConstKeyType key)
+ *      int
+ *      function_prefix_add_with_hash(TypeName *set, unsigned hash, ConstKeyType key)
+ *          Add the key, if it isn't in the set yet. Returns 1 if the key was
+ *          added, 0 if it was already there and -1 if memory ran out.
+ *
+ *      int
+ *      function_prefix_remove(TypeName *set, ConstKeyType key)
+ *          Returns 1 if the key was removed, 0 if it wasn't in the set.
+ *
+ *      TypeName_Item *
+ *      function_prefix_item_at(TypeName *set, unsigned index)
+ *          The item at the given position, which must be less than
+ *          function_prefix_size().
+ *
+ *      TypeName_Iterator
+ *      function_prefix_iterator_init, function_prefix_iterator_at_end,
+ *      function_prefix_iterator_item, function_prefix_iterator_next,
+ *      function_prefix_iterator_delete
+ *          Like in hashtbl2-indexmap.h.
+ *
+ *      int
+ *      function_prefix_union(TypeName *out, TypeName *a, TypeName *b)
+ *      int
+ *      function_prefix_intersect(TypeName *out, TypeName *a, TypeName *b)
+ *      int
+ *      function_prefix_difference(TypeName *out, TypeName *a, TypeName *b)
+ *          Add the keys of a ∪ b, a ∩ b or a \ b to `out`, which is usually
+ *          empty and must be a different set than `a` and `b`. Returns 0
+ *          if memory ran out, in which case only some of the keys may have
+ *          been added.
+ *
+ *      int
+ *      function_prefix_is_subset(TypeName *a, TypeName *b)
+ *          Returns 1 if every key of `a` is also in `b`.
+ */
+
+#define HASHSET_DEFINE(TypeName, function_prefix, KEY_SPEC) \
+    HASHSET__EXPAND_DEFINE(TypeName, function_prefix, KEY_SPEC, reallocarray, free)
+
+#define HASHSET_DEFINE_FULL(TypeName, function_prefix, KEY_SPEC, reallocarray_func, free_func) \
+    HASHSET__EXPAND_DEFINE(TypeName, function_prefix, KEY_SPEC, reallocarray_func, free_func)
+
+#define HASHSET__EXPAND_DEFINE(...) \
+    HASHSET__INTERNAL_DEFINE(__VA_ARGS__)
+
+#define HASHSET__INTERNAL_DEFINE(SetTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, reallocarray, free) \
+    \
+    typedef KeyType         SetTypeName##_Key; \
+    typedef ConstKeyType    SetTypeName##_ConstKey; \
+    typedef struct SetTypeName##_Item { \
+        unsigned hash; \
+        unsigned next; \
+        SetTypeName##_Key key; \
+    } SetTypeName##_Item; \
+    \
+    static inline void \
+    function_prefix##_internal_free_item(SetTypeName##_Item *item) \
+    { \
+        key_free_func(item->key); \
+    } \
+    \
+    HASHTBL__INTERNAL_DEFINE_DENSE(SetTypeName, function_prefix, key_hash_func, key_equal_func, key_hash_call, reallocarray, free) \
+    \
+    static inline int \
+    function_prefix##_add_with_hash(SetTypeName *set, unsigned hash, SetTypeName##_ConstKey key) \
+    { \
+        if (function_prefix##_internal_find(set, hash, key) != (unsigned)-1) \
+            return 0; \
+        \
+        unsigned item_i = function_prefix##_internal_push(set, hash); \
+        if (item_i == (unsigned)-1) \
+            return -1; \
+        \
+        set->items[item_i].key = key_dup_func(key); \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_add(SetTypeName *set, SetTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_add_with_hash(set, function_prefix##_hash(set, key), key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_remove(SetTypeName *set, SetTypeName##_ConstKey key) \
+    { \
+        unsigned index = function_prefix##_internal_find(set, function_prefix##_hash(set, key), key); \
+        if (index == (unsigned)-1) \
+            return 0; \
+        \
+        function_prefix##_internal_remove_at(set, index); \
+        return 1; \
+    } \
+    \
+    /* the hash of an item of `src` for use in `dst` */ \
+    static inline unsigned \
+    function_prefix##_internal_hash_in(SetTypeName *dst, SetTypeName *src, unsigned item_i) \
+    { \
+        if (dst->hash_seed == src->hash_seed) \
+            return src->items[item_i].hash; \
+        \
+        return function_prefix##_hash(dst, key_own(VIEW, ~, src->items[item_i].key, ~)); \
+    } \
+    \
+    /* an empty output set takes over the seed of an input, so stored hashes can be reused */ \
+    static inline void \
+    function_prefix##_internal_adopt_seed(SetTypeName *out, SetTypeName *from) \
+    { \
+        if (!out->element_count) \
+            out->hash_seed = from->hash_seed; \
+    } \
+    \
+    /* adds the items of `src` that are (want_in_probe) or aren't (!want_in_probe) in `probe` */ \
+    static inline int \
+    function_prefix##_internal_add_filtered(SetTypeName *out, SetTypeName *src, SetTypeName *probe, int want_in_probe) \
+    { \
+        for (unsigned i = 0; i < src->element_count; ++i) { \
+            if (probe) { \
+                unsigned probe_hash = function_prefix##_internal_hash_in(probe, src, i); \
+                int found = function_prefix##_internal_find(probe, probe_hash, key_own(VIEW, ~, src->items[i].key, ~)) != (unsigned)-1; \
+                if (found != want_in_probe) \
+                    continue; \
+            } \
+            \
+            unsigned hash = function_prefix##_internal_hash_in(out, src, i); \
+            if (function_prefix##_add_with_hash(out, hash, key_own(VIEW, ~, src->items[i].key, ~)) < 0) \
+                return 0; \
+        } \
+        \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_union(SetTypeName *out, SetTypeName *a, SetTypeName *b) \
+    { \
+        SetTypeName *larger = a->element_count >= b->element_count ? a : b; \
+        SetTypeName *smaller = larger == a ? b : a; \
+        \
+        function_prefix##_internal_adopt_seed(out, larger); \
+        if (!function_prefix##_internal_reserve(out, out->element_count + larger->element_count)) \
+            return 0; \
+        \
+        /* adding to out deduplicates already, so probing larger first would \
+           only look up every key of the smaller set twice */ \
+        return function_prefix##_internal_add_filtered(out, larger, NULL, 0) \
+            && function_prefix##_internal_add_filtered(out, smaller, NULL, 0); \
+    } \
+    \
+    static inline int \
+    function_prefix##_intersect(SetTypeName *out, SetTypeName *a, SetTypeName *b) \
+    { \
+        SetTypeName *larger = a->element_count >= b->element_count ? a : b; \
+        SetTypeName *smaller = larger == a ? b : a; \
+        \
+        function_prefix##_internal_adopt_seed(out, smaller); \
+        return function_prefix##_internal_add_filtered(out, smaller, larger, 1); \
+    } \
+    \
+    static inline int \
+    function_prefix##_difference(SetTypeName *out, SetTypeName *a, SetTypeName *b) \
+    { \
+        function_prefix##_internal_adopt_seed(out, a); \
+        if (!b->element_count) \
+            return function_prefix##_internal_add_filtered(out, a, NULL, 0); \
+        \
+        return function_prefix##_internal_add_filtered(out, a, b, 0); \
+    } \
+    \
+    static inline int \
+    function_prefix##_is_subset(SetTypeName *a, SetTypeName *b) \
+    { \
+        if (a->element_count > b->element_count) \
+            return 0; \
+        \
+        for (unsigned i = 0; i < a->element_count; ++i) { \
+            unsigned hash = function_prefix##_internal_hash_in(b, a, i); \
+            if (function_prefix##_internal_find(b, hash, key_own(VIEW, ~, a->items[i].key, ~)) == (unsigned)-1) \
+                return 0; \
+        } \
+        \
+        return 1; \
+    } \
+    \
+
@@ -0,0 +1,260 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+#include <pthread.h>
+
+/* Sharded hash map for concurrent use, built from hashtbl2.h tables
+ *
+ * How-To:
+ *      // Define type and functions, with 2^6 = 64 shards
+ *      HASHTBL_DEFINE_SHARDED(WordCount, word_count,
+ *                             HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+ *                             HASHTBL_VALUE(int),
+ *                             6)
+ *
+ *      static void increment(int *value, void *ctx) { (*value)++; }
+ *
+ *      WordCount wc;
+ *      word_count_init(&wc);
+ *
+ *      // from any number of threads
+ *      word_count_lookup_or_insert(&wc, "word", 0, increment, NULL);
+ *
+ *      int count;
+ *      if (word_count_lookup(&wc, "word", &count))
+ *          printf("%d\n", count);
+ *
+ *      word_count_clear(&wc);
+ *
+ * The key space is split into 2^shard_bits independent hashtbl2 tables, the
+ * shard is chosen by the high bits of the key hash. Each shard has its own
+ * mutex, so threads only contend when they hit the same shard. Because other
+ * threads may modify the table at any time, no item pointers are handed out:
+ * values are copied out, or modified under the lock through a callback.
+ *
+ * With HASHTBL_KEY_SEEDED keys, all shards start out with the table's seed,
+ * which also selects the shard, so usually each key is hashed only once.
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_SHARDED(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, shard_bits)
+ *      HASHTBL_DEFINE_SHARDED_SIZED(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC, shard_bits)
+ *          Defines types and functions for a sharded table with 2^shard_bits
+ *          shards (0 <= shard_bits <= 16). The specs are the same as for
+ *          HASHTBL_DEFINE and HASHTBL_DEFINE_SIZED. Each shard is a
+ *          TypeName_Shard table defined with function prefix
+ *          function_prefix_shard, see hashtbl2.h.
+ *
+ *      void
+ *      function_prefix_init(TypeName *tbl)
+ *      void
+ *      function_prefix_init_reserve(TypeName *tbl, unsigned count)
+ *          Initializes the table and its locks.
+ *
+ *      void
+ *      function_prefix_clear(TypeName *tbl)
+ *          Frees all memory and destroys the locks. Must not be called
+ *          concurrently with other functions. Call function_prefix_init()
+ *          again to reuse the table.
+ *
+ *      unsigned
+ *      function_prefix_size(TypeName *tbl)
+ *          Number of elements. Only a snapshot if other threads modify the table.
+ *
+ *      int
+ *      function_prefix_lookup(TypeName *tbl, ConstKeyType key, ValueType *out_value)
+ *          Returns nonzero if the key was found. If out_value is not NULL, the
+ *          value is copied there by plain assignment; for value types which
+ *          own memory, access the value through function_prefix_lookup_or_insert()
+ *          instead.
+ *
+ *      int
+ *      function_prefix_contains(TypeName *tbl, ConstKeyType key)
+ *
+ *      int
+ *      function_prefix_set(TypeName *tbl, ConstKeyType key, ConstValueType value)
+ *          Like function_prefix_set() from hashtbl2.h, returns zero on failure.
+ *
+ *      void
+ *      function_prefix_remove(TypeName *tbl, ConstKeyType key)
+ *
+ *      int
+ *      function_prefix_lookup_or_insert(TypeName *tbl, ConstKeyType key, ConstValueType value,
+ *                                       void (*update_func)(ValueType *value, void *ctx), void *ctx)
+ *          Inserts `value` if the key is not in the table yet. Then, if
+ *          update_func is not NULL, calls it on the (found or inserted) value
+ *          while still holding the shard lock. Returns 1 if the item was
+ *          inserted, 0 if it already existed, -1 on failure.
+ *
+ *      unsigned
+ *      function_prefix_shard_for_hash(unsigned hash)
+ *          The shard index tbl->shards[i] responsible for the hash value.
+ */
+
+#define HASHTBL_DEFINE_SHARDED(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, shard_bits) \
+    HASHTBL__EXPAND_DEFINE(TblTypeName##_Shard, function_prefix##_shard, KEY_SPEC, VALUE_SPEC, HASHTBL_SIZING_PRIME, reallocarray, free) \
+    HASHTBL__INTERNAL_DEFINE_SHARDED(TblTypeName, function_prefix, shard_bits)
+
+#define HASHTBL_DEFINE_SHARDED_SIZED(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC, shard_bits) \
+    HASHTBL__EXPAND_DEFINE(TblTypeName##_Shard, function_prefix##_shard, KEY_SPEC, VALUE_SPEC, SIZING_SPEC, reallocarray, free) \
+    HASHTBL__INTERNAL_DEFINE_SHARDED(TblTypeName, function_prefix, shard_bits)
+
+#define HASHTBL__INTERNAL_DEFINE_SHARDED(TblTypeName, function_prefix, shard_bits) \
+    \
+    typedef TblTypeName##_Shard_Key         TblTypeName##_Key; \
+    typedef TblTypeName##_Shard_ConstKey    TblTypeName##_ConstKey; \
+    typedef TblTypeName##_Shard_Value       TblTypeName##_Value; \
+    typedef TblTypeName##_Shard_ConstValue  TblTypeName##_ConstValue; \
+    typedef struct { \
+        pthread_mutex_t lock; \
+        TblTypeName##_Shard tbl; \
+        char padding[64]; /* keep the locks of neighbouring shards off the same cache line */ \
+    } TblTypeName##_ShardSlot; \
+    typedef struct { \
+        uint64_t hash_seed; /* selects the shard, for seeded keys */ \
+        TblTypeName##_ShardSlot shards[1u << (shard_bits)]; \
+    } TblTypeName; \
+    \
+    static inline unsigned \
+    function_prefix##_shard_for_hash(unsigned hash) \
+    { \
+        return ((hash & 0xffffffffu) >> 16) >> (16 - (shard_bits)); \
+    } \
+    \
+    /* the hash value for use within the shard, which may have been reseeded */ \
+    static inline unsigned \
+    function_prefix##_internal_shard_hash(TblTypeName *tbl, TblTypeName##_ShardSlot *shard, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        if (shard->tbl.hash_seed == tbl->hash_seed) \
+            return hash; \
+        return function_prefix##_shard_hash(&shard->tbl, key); \
+    } \
+    \
+    static inline void \
+    function_prefix##_init(TblTypeName *tbl) \
+    { \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            pthread_mutex_init(&tbl->shards[i].lock, NULL); \
+            function_prefix##_shard_init(&tbl->shards[i].tbl); \
+            function_prefix##_shard_reseed(&tbl->shards[i].tbl, tbl->shards[0].tbl.hash_seed); \
+        } \
+        tbl->hash_seed = tbl->shards[0].tbl.hash_seed; \
+    } \
+    \
+    static inline void \
+    function_prefix##_init_reserve(TblTypeName *tbl, unsigned num_items) \
+    { \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            pthread_mutex_init(&tbl->shards[i].lock, NULL); \
+            function_prefix##_shard_init_reserve(&tbl->shards[i].tbl, (num_items >> (shard_bits)) + 1); \
+            function_prefix##_shard_reseed(&tbl->shards[i].tbl, tbl->shards[0].tbl.hash_seed); \
+        } \
+        tbl->hash_seed = tbl->shards[0].tbl.hash_seed; \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TblTypeName *tbl) \
+    { \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            function_prefix##_shard_clear(&tbl->shards[i].tbl); \
+            pthread_mutex_destroy(&tbl->shards[i].lock); \
+        } \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TblTypeName *tbl) \
+    { \
+        unsigned count = 0; \
+        for (unsigned i = 0; i < (1u << (shard_bits)); ++i) { \
+            pthread_mutex_lock(&tbl->shards[i].lock); \
+            count += function_prefix##_shard_size(&tbl->shards[i].tbl); \
+            pthread_mutex_unlock(&tbl->shards[i].lock); \
+        } \
+        return count; \
+    } \
+    \
+    static inline int \
+    function_prefix##_lookup(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_Value *out_value) \
+    { \
+        unsigned hash = function_prefix##_shard_hash_with_seed(tbl->hash_seed, key); \
+        TblTypeName##_ShardSlot *shard = &tbl->shards[function_prefix##_shard_for_hash(hash)]; \
+        \
+        pthread_mutex_lock(&shard->lock); \
+        TblTypeName##_Shard_Item *item = function_prefix##_shard_lookup_with_hash(&shard->tbl, function_prefix##_internal_shard_hash(tbl, shard, hash, key), key); \
+        if (item && out_value) \
+            *out_value = item->value; \
+        pthread_mutex_unlock(&shard->lock); \
+        \
+        return item != NULL; \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup(tbl, key, NULL); \
+    } \
+    \
+    static inline int \
+    function_prefix##_set(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        unsigned hash = function_prefix##_shard_hash_with_seed(tbl->hash_seed, key); \
+        TblTypeName##_ShardSlot *shard = &tbl->shards[function_prefix##_shard_for_hash(hash)]; \
+        \
+        pthread_mutex_lock(&shard->lock); \
+        TblTypeName##_Shard_Item *item = function_prefix##_shard_set_with_hash(&shard->tbl, \
+                function_prefix##_internal_shard_hash(tbl, shard, hash, key), key, value); \
+        pthread_mutex_unlock(&shard->lock); \
+        \
+        return item != NULL; \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        unsigned hash = function_prefix##_shard_hash_with_seed(tbl->hash_seed, key); \
+        TblTypeName##_ShardSlot *shard = &tbl->shards[function_prefix##_shard_for_hash(hash)]; \
+        \
+        pthread_mutex_lock(&shard->lock); \
+        function_prefix##_shard_remove_with_hash(&shard->tbl, function_prefix##_internal_shard_hash(tbl, shard, hash, key), key); \
+        pthread_mutex_unlock(&shard->lock); \
+    } \
+    \
+    static inline int \
+    function_prefix##_lookup_or_insert(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value, \
+                                       void (*update_func)(TblTypeName##_Value *value, void *ctx), void *ctx) \
+    { \
+        unsigned hash = function_prefix##_shard_hash_with_seed(tbl->hash_seed, key); \
+        TblTypeName##_ShardSlot *shard = &tbl->shards[function_prefix##_shard_for_hash(hash)]; \
+        int inserted = 0; \
+        \
+        pthread_mutex_lock(&shard->lock); \
+        TblTypeName##_Shard_Item *item = function_prefix##_shard_lookup_or_insert_with_hash(&shard->tbl, \
+                function_prefix##_internal_shard_hash(tbl, shard, hash, key), key, value, &inserted); \
+        if (item && update_func) \
+            update_func(&item->value, ctx); \
+        pthread_mutex_unlock(&shard->lock); \
+        \
+        return item ? inserted : -1; \
+    } \
+    \
+
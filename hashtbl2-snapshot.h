@@ -0,0 +1,426 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Memory mapped snapshots of hashtbl2.h tables
+ *
+ * How-To:
+ *      HASHTBL_DEFINE(Dictionary, dictionary,
+ *                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+ *                     HASHTBL_VALUE(int))
+ *      HASHTBL_DEFINE_SNAPSHOT_STR(Dictionary, dictionary)
+ *
+ *      // write it once
+ *      int fd = open("dictionary.bin", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+ *      dictionary_save(&dic, fd);
+ *      close(fd);
+ *
+ *      // and use it from any process, without rebuilding
+ *      Dictionary_Snapshot snap;
+ *      if (dictionary_map(&snap, "dictionary.bin")) {
+ *          const int *value = dictionary_snapshot_lookup(&snap, "word");
+ *          ...
+ *          dictionary_unmap(&snap);
+ *      }
+ *
+ * The file contains the bucket array and the item storage exactly as they are
+ * laid out in memory, followed by a blob with all string keys. Mapping it only
+ * checks the header, lookups then run directly on the mapped pages. They check
+ * every link and string key they follow, so a corrupt file can't make them
+ * read outside of it or loop forever. Values (and keys, unless they are
+ * strings) are stored bytewise, so they must not contain pointers. The format
+ * depends on the item layout, byte order and the sizing policy, so snapshots
+ * are only meant to be read by the same program on the same platform;
+ * mismatches in the header are detected.
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_SNAPSHOT(TypeName, function_prefix)
+ *          Defines the functions below for a table defined with hashtbl2.h,
+ *          for keys and values without pointers.
+ *
+ *      HASHTBL_DEFINE_SNAPSHOT_STR(TypeName, function_prefix)
+ *          Like above, for tables keyed by NUL-terminated strings
+ *          (char * / const char *). The strings are stored in the blob.
+ *
+ *      int
+ *      function_prefix_save(TypeName *tbl, int fd)
+ *          Write a snapshot of the table to `fd`. Finishes a pending
+ *          incremental resize first. Returns 0 and sets errno on failure.
+ *
+ *      int
+ *      function_prefix_map(TypeName_Snapshot *snap, const char *path)
+ *          Map a snapshot read-only. Returns 0 and sets errno on failure
+ *          (EINVAL if the file is not a snapshot of this table type). Only
+ *          reads the header, so it takes the same time for any table size.
+ *
+ *      int
+ *      function_prefix_verify(const TypeName_Snapshot *snap)
+ *          Walks all chains of a mapped snapshot and returns 0 if any link
+ *          or key is out of bounds, a chain doesn't end or the element count
+ *          is wrong. This reads the whole file; lookups are safe without it.
+ *
+ *      void
+ *      function_prefix_unmap(TypeName_Snapshot *snap)
+ *
+ *      unsigned
+ *      function_prefix_snapshot_size(const TypeName_Snapshot *snap)
+ *
+ *      const ValueType *
+ *      function_prefix_snapshot_lookup(const TypeName_Snapshot *snap, ConstKeyType key)
+ *          Pointer to the value in the mapped file, or NULL.
+ *
+ *      int
+ *      function_prefix_snapshot_contains(const TypeName_Snapshot *snap, ConstKeyType key)
+ */
+
+#define HASHTBL__SNAPSHOT_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t item_size;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t table_size_idx;
+    uint32_t bucket_count;
+    uint32_t element_count;
+    uint32_t item_count;
+    uint64_t hash_seed;
+    uint64_t strings_size;
+} HashtblSnapshotHeader;
+
+typedef struct {
+    int fd;
+    int ok;
+    size_t used;
+    char buf[65536];
+} HashtblSnapshotWriter;
+
+static inline void
+_hashtbl_snapshot_flush(HashtblSnapshotWriter *w)
+{
+    size_t done = 0;
+    while (w->ok && done < w->used) {
+        ssize_t r = write(w->fd, w->buf + done, w->used - done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            w->ok = 0;
+        else
+            done += (size_t)r;
+    }
+    w->used = 0;
+}
+
+static inline void
+_hashtbl_snapshot_put(HashtblSnapshotWriter *w, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len) {
+        if (w->used == sizeof(w->buf))
+            _hashtbl_snapshot_flush(w);
+
+        size_t n = sizeof(w->buf) - w->used < len ? sizeof(w->buf) - w->used : len;
+        memcpy(w->buf + w->used, p, n);
+        w->used += n;
+        p += n;
+        len -= n;
+    }
+}
+
+/* items start at this offset, suitably aligned for any item type */
+static inline size_t
+_hashtbl_snapshot_items_offset(uint32_t bucket_count)
+{
+    size_t off = sizeof(HashtblSnapshotHeader) + (size_t)bucket_count * sizeof(unsigned);
+    return (off + 15) & ~(size_t)15;
+}
+
+#define HASHTBL_DEFINE_SNAPSHOT(TblTypeName, function_prefix) \
+    \
+    static inline size_t \
+    function_prefix##_internal_snapshot_key_blob(TblTypeName##_ConstKey key, const char **data) \
+    { \
+        (void)key; \
+        *data = NULL; \
+        return 0; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_snapshot_key_to_file(TblTypeName##_Item *item, uint64_t blob_offset) \
+    { \
+        (void)item; \
+        (void)blob_offset; \
+    } \
+    \
+    static inline TblTypeName##_ConstKey \
+    function_prefix##_internal_snapshot_key_from_file(const char *strings, const TblTypeName##_Item *item) \
+    { \
+        (void)strings; \
+        return item->key; \
+    } \
+    \
+    static inline int \
+    function_prefix##_internal_snapshot_key_valid(uint64_t strings_size, const TblTypeName##_Item *item) \
+    { \
+        (void)strings_size; \
+        (void)item; \
+        return 1; \
+    } \
+    \
+    HASHTBL__INTERNAL_DEFINE_SNAPSHOT(TblTypeName, function_prefix)
+
+#define HASHTBL_DEFINE_SNAPSHOT_STR(TblTypeName, function_prefix) \
+    \
+    static inline size_t \
+    function_prefix##_internal_snapshot_key_blob(TblTypeName##_ConstKey key, const char **data) \
+    { \
+        *data = key ? key : ""; \
+        return strlen(*data) + 1; \
+    } \
+    \
+    /* the key pointer is replaced by its offset into the string blob */ \
+    static inline void \
+    function_prefix##_internal_snapshot_key_to_file(TblTypeName##_Item *item, uint64_t blob_offset) \
+    { \
+        item->key = (TblTypeName##_Key)(uintptr_t)blob_offset; \
+    } \
+    \
+    static inline TblTypeName##_ConstKey \
+    function_prefix##_internal_snapshot_key_from_file(const char *strings, const TblTypeName##_Item *item) \
+    { \
+        return strings + (uintptr_t)item->key; \
+    } \
+    \
+    /* the string starts within the blob, mapping checked that the blob ends with a NUL */ \
+    static inline int \
+    function_prefix##_internal_snapshot_key_valid(uint64_t strings_size, const TblTypeName##_Item *item) \
+    { \
+        return (uintptr_t)item->key < strings_size; \
+    } \
+    \
+    HASHTBL__INTERNAL_DEFINE_SNAPSHOT(TblTypeName, function_prefix)
+
+#define HASHTBL__INTERNAL_DEFINE_SNAPSHOT(TblTypeName, function_prefix) \
+    \
+    typedef struct { \
+        void *base; \
+        size_t size; \
+        const HashtblSnapshotHeader *header; \
+        const unsigned *hashtbl; \
+        const TblTypeName##_Item *items; \
+        const char *strings; \
+    } TblTypeName##_Snapshot; \
+    \
+    static inline int \
+    function_prefix##_save(TblTypeName *tbl, int fd) \
+    { \
+        function_prefix##_rehash_step(tbl, (unsigned)-1); \
+        \
+        HashtblSnapshotHeader header; \
+        memset(&header, 0, sizeof(header)); \
+        memcpy(header.magic, "HTBL2SNP", 8); \
+        header.version = HASHTBL__SNAPSHOT_VERSION; \
+        header.item_size = (uint32_t)sizeof(TblTypeName##_Item); \
+        header.key_size = (uint32_t)sizeof(TblTypeName##_Key); \
+        header.value_size = (uint32_t)sizeof(TblTypeName##_Value); \
+        header.table_size_idx = tbl->table_size_idx; \
+        header.bucket_count = tbl->hashtbl ? function_prefix##_internal_bucket_count(tbl->table_size_idx) : 0; \
+        header.element_count = tbl->element_count; \
+        header.item_count = tbl->item_storage_used; \
+        header.hash_seed = tbl->hash_seed; \
+        \
+        for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
+            const char *data; \
+            if (tbl->item_storage[i].next != (unsigned)-2) \
+                header.strings_size += function_prefix##_internal_snapshot_key_blob(tbl->item_storage[i].key, &data); \
+        } \
+        \
+        HashtblSnapshotWriter *w = (HashtblSnapshotWriter *)malloc(sizeof(HashtblSnapshotWriter)); \
+        if (!w) \
+            return 0; \
+        w->fd = fd; \
+        w->ok = 1; \
+        w->used = 0; \
+        \
+        _hashtbl_snapshot_put(w, &header, sizeof(header)); \
+        if (header.bucket_count) \
+            _hashtbl_snapshot_put(w, tbl->hashtbl, header.bucket_count * sizeof(unsigned)); \
+        \
+        static const char padding[16] = {0}; \
+        _hashtbl_snapshot_put(w, padding, _hashtbl_snapshot_items_offset(header.bucket_count) - sizeof(header) - header.bucket_count * sizeof(unsigned)); \
+        \
+        uint64_t blob_offset = 0; \
+        for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
+            TblTypeName##_Item item; \
+            memcpy(&item, &tbl->item_storage[i], sizeof(item)); \
+            if (item.next != (unsigned)-2) { \
+                const char *data; \
+                size_t len = function_prefix##_internal_snapshot_key_blob(item.key, &data); \
+                function_prefix##_internal_snapshot_key_to_file(&item, blob_offset); \
+                blob_offset += len; \
+            } else { \
+                memset(&item.key, 0, sizeof(item.key)); /* freed, don't leak pointers into the file */ \
+            } \
+            _hashtbl_snapshot_put(w, &item, sizeof(item)); \
+        } \
+        \
+        for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
+            const char *data; \
+            if (tbl->item_storage[i].next == (unsigned)-2) \
+                continue; \
+            size_t len = function_prefix##_internal_snapshot_key_blob(tbl->item_storage[i].key, &data); \
+            _hashtbl_snapshot_put(w, data, len); \
+        } \
+        \
+        _hashtbl_snapshot_flush(w); \
+        int ok = w->ok; \
+        free(w); \
+        return ok; \
+    } \
+    \
+    static inline int \
+    function_prefix##_map(TblTypeName##_Snapshot *snap, const char *path) \
+    { \
+        memset(snap, 0, sizeof(*snap)); \
+        \
+        int fd = open(path, O_RDONLY); \
+        if (fd < 0) \
+            return 0; \
+        \
+        struct stat st; \
+        if (fstat(fd, &st) < 0) { \
+            close(fd); \
+            return 0; \
+        } \
+        \
+        size_t size = (size_t)st.st_size; \
+        if (size < sizeof(HashtblSnapshotHeader)) { \
+            close(fd); \
+            errno = EINVAL; \
+            return 0; \
+        } \
+        \
+        void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0); \
+        close(fd); \
+        if (base == MAP_FAILED) \
+            return 0; \
+        \
+        const HashtblSnapshotHeader *h = (const HashtblSnapshotHeader *)base; \
+        size_t items_offset = _hashtbl_snapshot_items_offset(h->bucket_count); \
+        size_t strings_offset = items_offset + (size_t)h->item_count * sizeof(TblTypeName##_Item); \
+        if (memcmp(h->magic, "HTBL2SNP", 8) \
+                || h->version != HASHTBL__SNAPSHOT_VERSION \
+                || h->item_size != sizeof(TblTypeName##_Item) \
+                || h->key_size != sizeof(TblTypeName##_Key) \
+                || h->value_size != sizeof(TblTypeName##_Value) \
+                || h->table_size_idx >= HASHTBL__SIZE_STEPS \
+                || (h->bucket_count && h->bucket_count != function_prefix##_internal_bucket_count(h->table_size_idx)) \
+                || h->element_count > h->item_count \
+                || strings_offset > size \
+                || h->strings_size > size - strings_offset \
+                || (h->strings_size && ((const char *)base)[strings_offset + h->strings_size - 1] != '\0')) { \
+            munmap(base, size); \
+            errno = EINVAL; \
+            return 0; \
+        } \
+        \
+        snap->base = base; \
+        snap->size = size; \
+        snap->header = h; \
+        snap->hashtbl = (const unsigned *)(const void *)((const char *)base + sizeof(HashtblSnapshotHeader)); \
+        snap->items = (const TblTypeName##_Item *)(const void *)((const char *)base + items_offset); \
+        snap->strings = (const char *)base + strings_offset; \
+        return 1; \
+    } \
+    \
+    static inline void \
+    function_prefix##_unmap(TblTypeName##_Snapshot *snap) \
+    { \
+        if (snap->base) \
+            munmap(snap->base, snap->size); \
+        memset(snap, 0, sizeof(*snap)); \
+    } \
+    \
+    static inline int \
+    function_prefix##_verify(const TblTypeName##_Snapshot *snap) \
+    { \
+        const HashtblSnapshotHeader *h = snap->header; \
+        if (!h) \
+            return 0; \
+        \
+        unsigned chained = 0; \
+        for (unsigned b = 0; b < h->bucket_count; ++b) { \
+            for (unsigned i = snap->hashtbl[b]; i != (unsigned)-1; i = snap->items[i].next) { \
+                /* counting the links also catches cycles */ \
+                if (i >= h->item_count || snap->items[i].next == (unsigned)-2 || ++chained > h->element_count) \
+                    return 0; \
+                if (!function_prefix##_internal_snapshot_key_valid(h->strings_size, &snap->items[i])) \
+                    return 0; \
+            } \
+        } \
+        \
+        return !h->bucket_count || chained == h->element_count; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_snapshot_size(const TblTypeName##_Snapshot *snap) \
+    { \
+        return snap->header ? snap->header->element_count : 0; \
+    } \
+    \
+    static inline const TblTypeName##_Value * \
+    function_prefix##_snapshot_lookup(const TblTypeName##_Snapshot *snap, TblTypeName##_ConstKey key) \
+    { \
+        if (!snap->header || !snap->header->bucket_count) \
+            return NULL; \
+        \
+        unsigned hash = function_prefix##_hash_with_seed(snap->header->hash_seed, key); \
+        unsigned item_i = snap->hashtbl[function_prefix##_internal_bucket_index(hash, snap->header->table_size_idx)]; \
+        /* a corrupt file may have links out of bounds, chains in a cycle or \
+           keys outside of the blob, none of which must be followed */ \
+        for (unsigned steps = 0; item_i < snap->header->item_count && steps < snap->header->element_count; ++steps) { \
+            const TblTypeName##_Item *item = &snap->items[item_i]; \
+            if (item->hash == hash \
+                    && function_prefix##_internal_snapshot_key_valid(snap->header->strings_size, item) \
+                    && function_prefix##_internal_key_equal(function_prefix##_internal_snapshot_key_from_file(snap->strings, item), key)) \
+                return &item->value; \
+            item_i = item->next; \
+        } \
+        \
+        return NULL; \
+    } \
+    \
+    static inline int \
+    function_prefix##_snapshot_contains(const TblTypeName##_Snapshot *snap, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_snapshot_lookup(snap, key) != NULL; \
+    } \
+    \
+
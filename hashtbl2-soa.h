@@ -0,0 +1,465 @@
+#pragma once
+/*
+ * Copyright © 2021 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "hashtbl2.h"
+
+/* Structure-of-arrays variant of the hashtbl2.h hash map
+ *
+ *      HASHTBL_DEFINE_SOA(MyTable, my_table,
+ *                         HASHTBL_KEY(const char *, str_hash, str_equal),
+ *                         HASHTBL_VALUE(BigStruct))
+ *
+ * Like hashtbl2.h, items are chained from a prime sized bucket array. But
+ * instead of one array of items, every item slot is split over three
+ * parallel arrays: `links` holds the hash and chain link of each slot, and
+ * `keys` and `values` hold the rest. Walking a chain only reads the dense
+ * links array, keys are only compared on a hash match and values are only
+ * touched by the caller. This pays off for large values, where an item of
+ * hashtbl2.h would fill most of a cache line for the sake of 8 bytes.
+ *
+ * As there is no item struct, lookups return a pointer to the value, or
+ * the slot index of the item. Slot indices stay the same until the item is
+ * removed; value pointers become invalid when more items are added.
+ *
+ * Limits:
+ *      - only supports up to 2^32-3 items
+ *      - value pointers are potentially invalid after adding more elements
+ *      - will never shrink when removing elements
+ *      - not safe against algorithmic complexity attacks
+ *
+ * Reference Docs:
+ *
+ *      HASHTBL_DEFINE_SOA(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC)
+ *      HASHTBL_DEFINE_SOA_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_fun, free_fun)
+ *          Like HASHTBL_DEFINE and HASHTBL_DEFINE_FULL from hashtbl2.h.
+ *
+ *      function_prefix_init, function_prefix_init_reserve, function_prefix_clear,
+ *      function_prefix_size, function_prefix_hash, function_prefix_contains,
+ *      function_prefix_remove, function_prefix_check_internal_sanity
+ *          Like in hashtbl2.h.
+ *
+ *      ValueType *
+ *      function_prefix_lookup(TypeName *tbl, ConstKeyType key)
+ *      ValueType *
+ *      function_prefix_lookup_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key)
+ *          Returns the value for the given key, or NULL.
+ *
+ *      unsigned
+ *      function_prefix_index(TypeName *tbl, ConstKeyType key)
+ *      unsigned
+ *      function_prefix_index_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key)
+ *          Returns the slot index of the given key, or (unsigned)-1.
+ *
+ *      const KeyType *
+ *      function_prefix_key_at(TypeName *tbl, unsigned index)
+ *      ValueType *
+ *      function_prefix_value_at(TypeName *tbl, unsigned index)
+ *          Key and value in the given slot, which must hold an item.
+ *
+ *      ValueType *
+ *      function_prefix_lookup_or_insert_zero(TypeName *tbl, ConstKeyType key, int *inserted)
+ *      ValueType *
+ *      function_prefix_set_zero(TypeName *tbl, ConstKeyType key)
+ *      ValueType *
+ *      function_prefix_set(TypeName *tbl, ConstKeyType key, ConstValueType value)
+ *          Like in hashtbl2.h, but return the value instead of the item.
+ *
+ *      TypeName_Iterator
+ *      function_prefix_iterator_init, function_prefix_iterator_at_end,
+ *      function_prefix_iterator_next, function_prefix_iterator_delete
+ *          Like in hashtbl2.h.
+ *
+ *      unsigned
+ *      function_prefix_iterator_index(TypeName_Iterator *it)
+ *          The slot index of the current item, for use with _key_at() and
+ *          _value_at().
+ */
+
+#define HASHTBL_DEFINE_SOA(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
+    HASHTBL__EXPAND_DEFINE_SOA(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+
+#define HASHTBL_DEFINE_SOA_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
+    HASHTBL__EXPAND_DEFINE_SOA(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+
+#define HASHTBL__EXPAND_DEFINE_SOA(...) \
+    HASHTBL__INTERNAL_DEFINE_SOA(__VA_ARGS__)
+
+#define HASHTBL__INTERNAL_DEFINE_SOA(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+    \
+    typedef KeyType         TblTypeName##_Key; \
+    typedef ConstKeyType    TblTypeName##_ConstKey; \
+    typedef ValueType       TblTypeName##_Value; \
+    typedef ConstValueType  TblTypeName##_ConstValue; \
+    /* next is (unsigned)-1 at the end of a chain and (unsigned)-2 for a free \
+       slot, whose hash then links to the next free slot */ \
+    typedef struct { \
+        unsigned hash; \
+        unsigned next; \
+    } TblTypeName##_Link; \
+    typedef struct { \
+        unsigned element_count; \
+        unsigned table_size_idx; \
+        unsigned slots_allocated; \
+        unsigned slots_used; \
+        unsigned firstfree; \
+        unsigned *hashtbl; \
+        TblTypeName##_Link  *links; \
+        TblTypeName##_Key   *keys; \
+        TblTypeName##_Value *values; \
+        uint64_t hash_seed; \
+    } TblTypeName; \
+    \
+    static inline void \
+    function_prefix##_init(TblTypeName *tbl) \
+    { \
+        tbl->element_count = 0; \
+        tbl->table_size_idx = 0; \
+        tbl->slots_allocated = 0; \
+        tbl->slots_used = 0; \
+        tbl->firstfree = (unsigned)-1; \
+        tbl->hashtbl = NULL; \
+        tbl->links = NULL; \
+        tbl->keys = NULL; \
+        tbl->values = NULL; \
+        tbl->hash_seed = key_hash_call(HASHTBL__USES_SEED, 0, 0) ? _hashtbl_random_seed(tbl) : 0; \
+    } \
+    \
+    static inline void \
+    function_prefix##_clear(TblTypeName *tbl) \
+    { \
+        for (unsigned i = 0; i < tbl->slots_used; ++i) { \
+            if (tbl->links[i].next == (unsigned)-2) \
+                continue; \
+            \
+            key_free_func(tbl->keys[i]); \
+            value_free_func(tbl->values[i]); \
+        } \
+        \
+        free(tbl->hashtbl); \
+        free(tbl->links); \
+        free(tbl->keys); \
+        free(tbl->values); \
+        function_prefix##_init(tbl); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_size(TblTypeName *tbl) \
+    { \
+        return tbl->element_count; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_hash(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return key_hash_call(key_hash_func, key, tbl->hash_seed); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_index_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        if (!tbl->hashtbl) \
+            return (unsigned)-1; \
+        \
+        unsigned slot_i = tbl->hashtbl[_hashtbl_prime_index_for_hash(hash, tbl->table_size_idx)]; \
+        while (slot_i != (unsigned)-1) { \
+            if (tbl->links[slot_i].hash == hash && key_equal_func(tbl->keys[slot_i], key)) \
+                return slot_i; \
+            \
+            slot_i = tbl->links[slot_i].next; \
+        } \
+        \
+        return (unsigned)-1; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_index(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_index_with_hash(tbl, function_prefix##_hash(tbl, key), key); \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_lookup_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
+        unsigned slot_i = function_prefix##_index_with_hash(tbl, hash, key); \
+        return slot_i != (unsigned)-1 ? &tbl->values[slot_i] : NULL; \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_lookup(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_lookup_with_hash(tbl, function_prefix##_hash(tbl, key), key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_index(tbl, key) != (unsigned)-1; \
+    } \
+    \
+    static inline const TblTypeName##_Key * \
+    function_prefix##_key_at(TblTypeName *tbl, unsigned slot_i) \
+    { \
+        return &tbl->keys[slot_i]; \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_value_at(TblTypeName *tbl, unsigned slot_i) \
+    { \
+        return &tbl->values[slot_i]; \
+    } \
+    \
+    /* rebuilds the buckets from the links array, keys and values aren't touched */ \
+    static inline int \
+    function_prefix##_internal_resize_buckets(TblTypeName *tbl, unsigned num_items) \
+    { \
+        unsigned size_idx = 0; \
+        while (size_idx + 1 < HASHTBL__SIZE_STEPS \
+                && num_items > _hashtbl_prime_bucket_count(size_idx) - _hashtbl_prime_bucket_count(size_idx)/4) \
+            size_idx++; \
+        \
+        if (tbl->hashtbl && size_idx <= tbl->table_size_idx) \
+            return 1; \
+        \
+        unsigned bucket_count = _hashtbl_prime_bucket_count(size_idx); \
+        unsigned *hashtbl = (unsigned *)reallocarray(NULL, bucket_count, sizeof(unsigned)); \
+        if (!hashtbl) \
+            return 0; \
+        \
+        memset(hashtbl, 0xff, bucket_count * sizeof(unsigned)); \
+        for (unsigned i = 0; i < tbl->slots_used; ++i) { \
+            if (tbl->links[i].next == (unsigned)-2) \
+                continue; \
+            \
+            unsigned *bucket = &hashtbl[_hashtbl_prime_index_for_hash(tbl->links[i].hash, size_idx)]; \
+            tbl->links[i].next = *bucket; \
+            *bucket = i; \
+        } \
+        \
+        free(tbl->hashtbl); \
+        tbl->hashtbl = hashtbl; \
+        tbl->table_size_idx = size_idx; \
+        return 1; \
+    } \
+    \
+    /* grows all three arrays; one that was already moved is kept even if a \
+       later one fails, slots_allocated only counts what all of them hold */ \
+    static inline int \
+    function_prefix##_internal_reserve_slots(TblTypeName *tbl, unsigned num_slots) \
+    { \
+        if (num_slots <= tbl->slots_allocated) \
+            return 1; \
+        \
+        unsigned new_allocated = tbl->slots_allocated ? tbl->slots_allocated : 8; \
+        while (new_allocated < num_slots) { \
+            if (new_allocated > 0x7fffffffu) { \
+                new_allocated = 0xfffffffdu; \
+                break; \
+            } \
+            new_allocated *= 2; \
+        } \
+        if (new_allocated < num_slots) \
+            return 0; \
+        \
+        TblTypeName##_Link *links = (TblTypeName##_Link *)reallocarray(tbl->links, new_allocated, sizeof(TblTypeName##_Link)); \
+        if (!links) \
+            return 0; \
+        tbl->links = links; \
+        \
+        TblTypeName##_Key *keys = (TblTypeName##_Key *)reallocarray(tbl->keys, new_allocated, sizeof(TblTypeName##_Key)); \
+        if (!keys) \
+            return 0; \
+        tbl->keys = keys; \
+        \
+        TblTypeName##_Value *values = (TblTypeName##_Value *)reallocarray(tbl->values, new_allocated, sizeof(TblTypeName##_Value)); \
+        if (!values) \
+            return 0; \
+        tbl->values = values; \
+        \
+        tbl->slots_allocated = new_allocated; \
+        return 1; \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_lookup_or_insert_zero(TblTypeName *tbl, TblTypeName##_ConstKey key, int *inserted) \
+    { \
+        unsigned hash = function_prefix##_hash(tbl, key); \
+        TblTypeName##_Value *value = function_prefix##_lookup_with_hash(tbl, hash, key); \
+        if (value || !function_prefix##_internal_resize_buckets(tbl, tbl->element_count + 1)) { \
+            if (inserted) \
+                *inserted = 0; \
+            return value; \
+        } \
+        \
+        unsigned slot_i = tbl->firstfree; \
+        if (slot_i != (unsigned)-1) { \
+            tbl->firstfree = tbl->links[slot_i].hash; \
+        } else { \
+            if (!function_prefix##_internal_reserve_slots(tbl, tbl->slots_used + 1)) { \
+                if (inserted) \
+                    *inserted = 0; \
+                return NULL; \
+            } \
+            slot_i = tbl->slots_used++; \
+        } \
+        \
+        unsigned *bucket = &tbl->hashtbl[_hashtbl_prime_index_for_hash(hash, tbl->table_size_idx)]; \
+        tbl->links[slot_i].hash = hash; \
+        tbl->links[slot_i].next = *bucket; \
+        *bucket = slot_i; \
+        tbl->keys[slot_i] = key_dup_func(key); \
+        memset(&tbl->values[slot_i], 0, sizeof(TblTypeName##_Value)); \
+        tbl->element_count++; \
+        \
+        if (inserted) \
+            *inserted = 1; \
+        return &tbl->values[slot_i]; \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_set_zero(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        int inserted; \
+        TblTypeName##_Value *value = function_prefix##_lookup_or_insert_zero(tbl, key, &inserted); \
+        if (value && !inserted) { \
+            value_free_func(*value); \
+            memset(value, 0, sizeof(TblTypeName##_Value)); \
+        } \
+        return value; \
+    } \
+    \
+    static inline TblTypeName##_Value * \
+    function_prefix##_set(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        TblTypeName##_Value *v = function_prefix##_set_zero(tbl, key); \
+        if (v) \
+            *v = value_dup_func(value); \
+        return v; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_dealloc_slot(TblTypeName *tbl, unsigned slot_i) \
+    { \
+        unsigned *p = &tbl->hashtbl[_hashtbl_prime_index_for_hash(tbl->links[slot_i].hash, tbl->table_size_idx)]; \
+        while (*p != slot_i) \
+            p = &tbl->links[*p].next; \
+        *p = tbl->links[slot_i].next; \
+        \
+        key_free_func(tbl->keys[slot_i]); \
+        value_free_func(tbl->values[slot_i]); \
+        tbl->links[slot_i].next = (unsigned)-2; \
+        tbl->links[slot_i].hash = tbl->firstfree; \
+        tbl->firstfree = slot_i; \
+        tbl->element_count--; \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        unsigned slot_i = function_prefix##_index(tbl, key); \
+        if (slot_i != (unsigned)-1) \
+            function_prefix##_internal_dealloc_slot(tbl, slot_i); \
+    } \
+    \
+    static inline void \
+    function_prefix##_init_reserve(TblTypeName *tbl, unsigned num_items) \
+    { \
+        function_prefix##_init(tbl); \
+        if (function_prefix##_internal_reserve_slots(tbl, num_items)) \
+            function_prefix##_internal_resize_buckets(tbl, num_items); \
+    } \
+    \
+    static inline int \
+    function_prefix##_check_internal_sanity(TblTypeName *tbl) \
+    { \
+        if (tbl->slots_used > tbl->slots_allocated) \
+            return 0; \
+        \
+        unsigned free_count = 0; \
+        for (unsigned i = tbl->firstfree; i != (unsigned)-1; i = tbl->links[i].hash) { \
+            if (i >= tbl->slots_used || tbl->links[i].next != (unsigned)-2 || ++free_count > tbl->slots_used) \
+                return 0; \
+        } \
+        \
+        if (tbl->element_count + free_count != tbl->slots_used) \
+            return 0; \
+        \
+        if (!tbl->hashtbl) \
+            return tbl->element_count == 0; \
+        \
+        unsigned chained = 0; \
+        unsigned bucket_count = _hashtbl_prime_bucket_count(tbl->table_size_idx); \
+        for (unsigned b = 0; b < bucket_count; ++b) { \
+            for (unsigned i = tbl->hashtbl[b]; i != (unsigned)-1; i = tbl->links[i].next) { \
+                if (i >= tbl->slots_used || tbl->links[i].next == (unsigned)-2 || ++chained > tbl->element_count) \
+                    return 0; \
+                if (_hashtbl_prime_index_for_hash(tbl->links[i].hash, tbl->table_size_idx) != b) \
+                    return 0; \
+            } \
+        } \
+        \
+        return chained == tbl->element_count; \
+    } \
+    \
+    typedef struct { \
+        TblTypeName *tbl; \
+        unsigned i; \
+    } TblTypeName##_Iterator; \
+    \
+    static inline void \
+    function_prefix##_internal_iterator_skip_free(TblTypeName##_Iterator *it) { \
+        while (it->i < it->tbl->slots_used && it->tbl->links[it->i].next == (unsigned)-2) \
+            it->i++; \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_init(TblTypeName *tbl, TblTypeName##_Iterator *it) { \
+        it->tbl = tbl; \
+        it->i = 0; \
+        function_prefix##_internal_iterator_skip_free(it); \
+    } \
+    \
+    static inline int \
+    function_prefix##_iterator_at_end(TblTypeName##_Iterator *it) { \
+        return it->i >= it->tbl->slots_used; \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_iterator_index(TblTypeName##_Iterator *it) { \
+        return it->i; \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_next(TblTypeName##_Iterator *it) { \
+        if (it->i < it->tbl->slots_used) { \
+            it->i++; \
+            function_prefix##_internal_iterator_skip_free(it); \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_iterator_delete(TblTypeName##_Iterator *it) { \
+        if (it->i >= it->tbl->slots_used || it->tbl->links[it->i].next == (unsigned)-2) \
+            return; \
+        \
+        function_prefix##_internal_dealloc_slot(it->tbl, it->i); \
+    } \
+    \
+
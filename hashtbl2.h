@@ -22,6 +22,12 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__linux__)
+#   include <sys/random.h>
+#endif
 
 /* Macro-based generic hash map for C
  *
@@ -60,9 +66,11 @@
  * Limits:
  *      - only supports up to UINT_MAX-2 elements
  *      - item pointers are potentially invalid after adding more elements
- *      - will never shrink when when removing elements
+ *      - will not shrink when removing elements, unless auto shrinking is
+ *        enabled or function_prefix_shrink_to_fit() is called
  *      - uses separate chaining, performance can often be better with open addressing
- *      - not safe against algorithmic complexity attacks (unless your hash function is really clever somehow)
+ *      - not safe against algorithmic complexity attacks, unless the key uses a
+ *        keyed hash function through HASHTBL_KEY_SEEDED
  *
  * Reference Docs:
  *
@@ -75,10 +83,76 @@
  *
  *      HASHTBL_KEY(Type, hash_func, equal_func)
  *      HASHTBL_KEY_FULL(Type, ConstType, dup_func, free_func, hash_func, equal_func)
+ *      HASHTBL_KEY_SEEDED(Type, seeded_hash_func, equal_func)
+ *      HASHTBL_KEY_SEEDED_FULL(Type, ConstType, dup_func, free_func, seeded_hash_func, equal_func)
+ *          The _SEEDED variants take a keyed hash function
+ *          `unsigned seeded_hash_func(ConstType key, uint64_t seed)`, like
+ *          str_hash_seeded() from str.h. Every table gets its own random
+ *          seed, so colliding keys can't be precomputed. Should a chain
+ *          still grow beyond HASHTBL_RESEED_CHAIN_LENGTH items on insert,
+ *          the table picks a new seed and rehashes all keys.
+ *
+ *      HASHTBL_KEY_STR(hash_func)
+ *      HASHTBL_KEY_STR_SEEDED(seeded_hash_func)
+ *          String keys, passed as `const char *` and hashed by hash_func,
+ *          e.g. str_hash() or str_hash_seeded() from str.h. The table
+ *          stores them as HashtblStr: the length and the first
+ *          HASHTBL_STR_INLINE bytes live in the item itself, so keys
+ *          shorter than that are compared without touching any other
+ *          memory, and longer ones are told apart by their prefix before
+ *          following the pointer to their copy. Use hashtbl_str_cstr(&item->key)
+ *          to get the key as a C string, which points into the item for
+ *          short keys. With HASHTBL_KEY_ALT, alt_dup_func has to return
+ *          a HashtblStr, which hashtbl_str_from_buf(data, len) creates from
+ *          `len` bytes without a NUL. Can't be combined with
+ *          HASHTBL_KEY_ARENA or the snapshots of hashtbl2-snapshot.h.
+ *
+ *      HASHTBL_KEY_ALT(KEY_SPEC, AltType, alt_hash_func, alt_equal_func, alt_dup_func)
+ *          Adds a second key form to any of the above, for looking up keys
+ *          without constructing them first, e.g. StrSlice from str.h for
+ *          string keys. `alt_hash_func(AltType)` (seeded like the key's own
+ *          hash function) must hash equal keys to the same value as the
+ *          key's hash function, `int alt_equal_func(ConstType key, AltType alt)`
+ *          compares, and `Type alt_dup_func(AltType)` creates the key stored
+ *          on insert, in place of dup_func. Enables the *_alt functions.
+ *
+ *      HASHTBL_KEY_ARENA(KEY_SPEC)
+ *          For string keys (Type char *): the table copies the key bytes
+ *          into an arena of its own instead of calling dup_func and
+ *          free_func for each key, which saves a malloc() per insert and
+ *          lets function_prefix_clear() drop all keys at once. Keys of
+ *          removed items stay in the arena until function_prefix_compact()
+ *          or function_prefix_shrink_to_fit() copies the live keys to a
+ *          fresh one. With HASHTBL_KEY_ALT, the key made by alt_dup_func is
+ *          copied into the arena and then passed to free_func. Only honored
+ *          by hashtbl2.h itself, the other table variants keep using
+ *          dup_func and free_func.
  *
  *      HASHTBL_VALUE(Type)
  *      HASHTBL_VALUE_FULL(Type, ConstType, dup_func, free_func)
  *
+ *      HASHTBL_DEFINE_SIZED(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC)
+ *      HASHTBL_DEFINE_SIZED_FULL(TypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC, reallocarray_fun, free_fun)
+ *          Like above, but with an explicit bucket sizing policy. SIZING_SPEC
+ *          is one of:
+ *
+ *          HASHTBL_SIZING_PRIME
+ *              The default. Bucket counts are primes, the bucket index is
+ *              computed with a modulo. Works well even with weak hash functions.
+ *          HASHTBL_SIZING_POW2
+ *              Bucket counts are powers of two, the bucket index is taken from
+ *              the high bits of a multiplicative (Fibonacci) hash. Avoids the
+ *              integer division, but the hash function should mix all its
+ *              bits reasonably well.
+ *          HASHTBL_SIZING_INCREMENTAL(SIZING_SPEC, buckets_per_step)
+ *              Like the given SIZING_SPEC, but growing the table will not
+ *              relink all items at once. The old bucket array is kept around
+ *              and each lookup, insert or remove moves `buckets_per_step` of
+ *              its buckets into the new array, until all are migrated. Inserts
+ *              move more if needed to finish before the next grow is due, a
+ *              few buckets per insert with the default ladders. This bounds
+ *              the worst case latency of a single insert.
+ *
  *      void
  *      function_prefix_init(TypeName *tbl)
  *          Initializes a hash table
@@ -92,6 +166,17 @@
  *          Frees up all memory allocated for the hash table. If specified,
  *          the `key_free_func` and `value_free_func` will be called for each item
  *
+ *      unsigned
+ *      function_prefix_hash(TypeName *tbl, ConstKeyType key)
+ *          The hash value of the key, as used by the table. Useful for the
+ *          *_with_hash() variants.
+ *
+ *      void
+ *      function_prefix_reseed(TypeName *tbl, uint64_t seed)
+ *          Switch to another hash seed and rehash all keys. Hash values
+ *          obtained before are invalid afterwards. Only has an effect for
+ *          keys defined with HASHTBL_KEY_SEEDED*.
+ *
  *      TypeName_Item *
  *      function_prefix_item(TypeName *tbl, ConstKeyType key)
  *          Looks up the given key inside the hash table and returns a pointer to
@@ -103,6 +188,8 @@
  *
  *      TypeName_Item *
  *      function_prefix_set(TypeName *tbl, ConstKeyType key, ConstValueType value)
+ *      TypeName_Item *
+ *      function_prefix_set_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key, ConstValueType value)
  *          Insert the given value into the hash table, potentially overriding
  *          the old value for the given key. If specified, `key_dup_func`,
  *          `value_dup_func` and `value_free_func` will be called as needed.
@@ -111,21 +198,399 @@
  *          (this can happen if and only if there is no memory available or the
  *          hash table has reached its maximum size).
  *
+ *      TypeName_Item *
+ *      function_prefix_lookup_or_insert_zero(TypeName *tbl, ConstKeyType key, int *inserted)
+ *      TypeName_Item *
+ *      function_prefix_lookup_or_insert_zero_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key, int *inserted)
+ *      TypeName_Item *
+ *      function_prefix_lookup_or_insert(TypeName *tbl, ConstKeyType key, ConstValueType value, int *inserted)
+ *      TypeName_Item *
+ *      function_prefix_lookup_or_insert_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key, ConstValueType value, int *inserted)
+ *          Returns the item for the key. If the key is not in the table yet,
+ *          it is inserted first, with a zeroed value or a copy of `value`.
+ *          The key is hashed once and its chain is walked once. `*inserted`
+ *          (if not NULL) is set to whether the item is new. Returns NULL if
+ *          the insertion failed, like function_prefix_set().
+ *
+ *      int
+ *      function_prefix_upsert(TypeName *tbl, ConstKeyType key,
+ *                             void (*update_func)(ValueType *value, void *ctx), void *ctx)
+ *          Calls update_func on the value for the key, after inserting the
+ *          key with a zeroed value if it was missing. Returns 1 if the item
+ *          was inserted, 0 if it already existed and -1 on failure.
+ *
+ *      void
+ *      function_prefix_lookup_many(TypeName *tbl, const ConstKeyType *keys, unsigned n, TypeName_Item **out_items)
+ *      function_prefix_lookup_many_with_hash(TypeName *tbl, const unsigned *hashes, const ConstKeyType *keys, unsigned n, TypeName_Item **out_items)
+ *          Look up `n` keys at once and store the results (or NULL) in
+ *          `out_items`. The keys are processed in batches of
+ *          HASHTBL_LOOKUP_BATCH: all buckets of a batch are prefetched, then
+ *          all first items, and only then the chains are compared, so that
+ *          the cache misses of the batch overlap. The second variant takes
+ *          precomputed hash values.
+ *
+ *      unsigned
+ *      function_prefix_hash_alt(TypeName *tbl, AltType key)
+ *      TypeName_Item *
+ *      function_prefix_lookup_alt(TypeName *tbl, AltType key)
+ *      TypeName_Item *
+ *      function_prefix_lookup_alt_with_hash(TypeName *tbl, unsigned hash, AltType key)
+ *      int
+ *      function_prefix_contains_alt(TypeName *tbl, AltType key)
+ *          Only with HASHTBL_KEY_ALT: like the functions without _alt, for
+ *          the alternative key form.
+ *
+ *      TypeName_Item *
+ *      function_prefix_lookup_or_insert_alt(TypeName *tbl, AltType key, ConstValueType value, int *inserted)
+ *          Only with HASHTBL_KEY_ALT: returns the item for the key, after
+ *          inserting it with `value` if it was missing. The key is hashed
+ *          and looked up once, and only converted with alt_dup_func when
+ *          it is inserted. `*inserted` (if not NULL) is set to whether the
+ *          item is new. Returns NULL if memory ran out.
+ *
  *      void
  *      function_prefix_remove(TypeName *tbl, ConstKeyType key)
+ *      void
+ *      function_prefix_remove_with_hash(TypeName *tbl, unsigned hash, ConstKeyType key)
  *          Remove the item for the given key from the hash table. If specified,
  *          `key_free_func` and `value_free_func` will be called for the removed
  *          key and value.
+ *
+ *      int
+ *      function_prefix_build_from(TypeName *tbl, const ConstKeyType *keys, const ConstValueType *values, unsigned n)
+ *          Bulk insert `n` key/value pairs. The item storage and buckets are
+ *          sized once for all of them (counting duplicates, so the table may
+ *          end up larger than needed), all keys are hashed in one pass and
+ *          the items are linked without any per-insert growth checks. For
+ *          duplicate keys, the last value wins. Returns 0 if memory ran out,
+ *          in which case only some of the pairs may have been inserted.
+ *
+ *      int
+ *      function_prefix_build_from_combine(TypeName *tbl, const ConstKeyType *keys, const ConstValueType *values, unsigned n,
+ *                                         void (*combine_func)(ValueType *value, ConstValueType new_value, void *ctx), void *ctx)
+ *          Like function_prefix_build_from(), but if a key is already in the
+ *          table (or occurs more than once), combine_func is called to merge
+ *          the new value into the existing one. combine_func may be NULL,
+ *          which means last-wins.
+ *
+ *      int
+ *      function_prefix_merge(TypeName *dst, TypeName *src,
+ *                            void (*combine_func)(ValueType *value, ConstValueType src_value, void *ctx), void *ctx)
+ *          Move all items from `src` into `dst`, leaving `src` empty. Keys and
+ *          values are moved without being duplicated again (with
+ *          HASHTBL_KEY_ARENA, keys are copied into the arena of `dst`). If a
+ *          key is in both tables, combine_func is called to merge the value
+ *          from `src` into the one in `dst`, after which the `src` key and
+ *          value are freed; combine_func may be NULL, which means `src` wins. Meant for
+ *          aggregating per-thread tables. Returns 0 if memory ran out, in
+ *          which case both tables still hold all of their elements (though
+ *          `dst` may have reserved more memory, invalidating item pointers).
+ *
+ *      void
+ *      function_prefix_compact(TypeName *tbl)
+ *          Move all items to the front of the item storage, dropping the
+ *          free slots left behind by removed items, and rebuild the buckets
+ *          at the size appropriate for the current number of elements.
+ *          With HASHTBL_KEY_ARENA, the key arena is compacted as well, so
+ *          key pointers become invalid too. Item pointers and iterators are
+ *          invalidated.
+ *
+ *      void
+ *      function_prefix_shrink_to_fit(TypeName *tbl)
+ *          Like function_prefix_compact(), but also return the unused item
+ *          storage to the allocator.
+ *
+ *      void
+ *      function_prefix_set_auto_shrink(TypeName *tbl, int enabled)
+ *          If enabled, function_prefix_remove() calls
+ *          function_prefix_shrink_to_fit() once less than half of the item
+ *          storage is in use. Item pointers are then also invalidated by
+ *          removing elements. Off by default.
+ *
+ *      int
+ *      function_prefix_rehash_step(TypeName *tbl, unsigned steps)
+ *          Only useful with HASHTBL_SIZING_INCREMENTAL: migrate up to `steps`
+ *          buckets of a pending resize, e.g. while the application is idle.
+ *          Returns nonzero if there are still buckets left to migrate.
+ *
+ *      void
+ *      function_prefix_stats(TypeName *tbl, HashtblStats *out)
+ *          Fill `out` with statistics about the table structure, for
+ *          monitoring hash quality and memory use. During an incremental
+ *          resize, the not yet migrated old buckets count as buckets, too.
+ *          Takes O(buckets + items) time and doesn't modify the table.
  */
 
+/* number of keys processed together in function_prefix_lookup_many() */
+#define HASHTBL_LOOKUP_BATCH 32
+
+#ifdef __GNUC__
+#   define HASHTBL__PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#   define HASHTBL__PREFETCH(addr) ((void)(addr))
+#endif
+
+/* number of entries in HashtblStats.chain_histogram */
+#define HASHTBL_STATS_HISTOGRAM 16
+
+typedef struct {
+    unsigned element_count;
+    unsigned bucket_count;
+    double load_factor;         /* elements per bucket */
+    unsigned longest_chain;
+    unsigned empty_buckets;
+    double empty_bucket_ratio;
+    /* number of buckets with a chain of length i, the last entry also
+     * counts all longer chains */
+    unsigned chain_histogram[HASHTBL_STATS_HISTOGRAM];
+    unsigned freelist_length;   /* item slots left free by removals */
+    size_t bucket_bytes;
+    size_t item_bytes;          /* allocated item storage, used or not */
+    size_t key_bytes;           /* key arena, see HASHTBL_KEY_ARENA */
+} HashtblStats;
+
+/* chain length on insert which makes tables with seeded keys pick a new seed */
+#define HASHTBL_RESEED_CHAIN_LENGTH 32
+
 #define HASHTBL_KEY(Type, hash_func, equal_func) \
-    HASHTBL__INTERNAL_KEY_FULL(Type, Type, /*nop*/, (void), hash_func, equal_func)
+    HASHTBL__INTERNAL_KEY_FULL(Type, Type, /*nop*/, (void), hash_func, equal_func, HASHTBL__HASH_UNSEEDED)
 
 #define HASHTBL_KEY_FULL(Type, ConstType, dup_func, free_func, hash_func, equal_func) \
-    HASHTBL__INTERNAL_KEY_FULL(Type, ConstType, dup_func, free_func, hash_func, equal_func)
+    HASHTBL__INTERNAL_KEY_FULL(Type, ConstType, dup_func, free_func, hash_func, equal_func, HASHTBL__HASH_UNSEEDED)
+
+#define HASHTBL_KEY_SEEDED(Type, seeded_hash_func, equal_func) \
+    HASHTBL__INTERNAL_KEY_FULL(Type, Type, /*nop*/, (void), seeded_hash_func, equal_func, HASHTBL__HASH_SEEDED)
+
+#define HASHTBL_KEY_SEEDED_FULL(Type, ConstType, dup_func, free_func, seeded_hash_func, equal_func) \
+    HASHTBL__INTERNAL_KEY_FULL(Type, ConstType, dup_func, free_func, seeded_hash_func, equal_func, HASHTBL__HASH_SEEDED)
+
+#define HASHTBL__INTERNAL_KEY_FULL(Type, ConstType, dup_func, free_func, hash_func, equal_func, hash_call) \
+    Type, ConstType, dup_func, free_func, hash_func, equal_func, hash_call, HASHTBL__OWN_FUNCS, (HASHTBL__NO_ALT, ~, ~, ~, ~)
+
+#define HASHTBL_KEY_STR(hash_func) \
+    HASHTBL__INTERNAL_KEY_STR(hash_func, HASHTBL__HASH_UNSEEDED)
+
+#define HASHTBL_KEY_STR_SEEDED(seeded_hash_func) \
+    HASHTBL__INTERNAL_KEY_STR(seeded_hash_func, HASHTBL__HASH_SEEDED)
+
+#define HASHTBL__INTERNAL_KEY_STR(hash_func, hash_call) \
+    HashtblStr, const char *, _hashtbl_str_make, _hashtbl_str_free, hash_func, _hashtbl_str_equal, hash_call, HASHTBL__OWN_STR, (HASHTBL__NO_ALT, ~, ~, ~, ~)
+
+#define HASHTBL_KEY_ALT(KEY_SPEC, AltType, alt_hash_func, alt_equal_func, alt_dup_func) \
+    HASHTBL__KEY_WITH_ALT(KEY_SPEC, AltType, alt_hash_func, alt_equal_func, alt_dup_func)
+
+#define HASHTBL__KEY_WITH_ALT(Type, ConstType, dup_func, free_func, hash_func, equal_func, hash_call, key_own, no_alt, AltType, alt_hash_func, alt_equal_func, alt_dup_func) \
+    Type, ConstType, dup_func, free_func, hash_func, equal_func, hash_call, key_own, (HASHTBL__ALT, AltType, alt_hash_func, alt_equal_func, alt_dup_func)
+
+#define HASHTBL_KEY_ARENA(KEY_SPEC) \
+    HASHTBL__KEY_WITH_ARENA(KEY_SPEC)
+
+#define HASHTBL__KEY_WITH_ARENA(Type, ConstType, dup_func, free_func, hash_func, equal_func, hash_call, key_own, key_alt) \
+    Type, ConstType, dup_func, free_func, hash_func, equal_func, hash_call, HASHTBL__OWN_ARENA, key_alt
+
+/* the table code copies and frees keys through key_own(OP, func, key, arena) */
+#define HASHTBL__OWN_FUNCS(op, func, key, arena) HASHTBL__OWN_FUNCS_##op(func, key, arena)
+#define HASHTBL__OWN_FUNCS_DUP(func, key, arena) func(key)
+#define HASHTBL__OWN_FUNCS_FREE(func, key, arena) func(key)
+#define HASHTBL__OWN_FUNCS_MOVE(func, key, arena) (key)
+#define HASHTBL__OWN_FUNCS_DROP(func, key, arena) ((void)0)
+#define HASHTBL__OWN_FUNCS_IS_ARENA(func, key, arena) 0
+#define HASHTBL__OWN_FUNCS_VIEW(func, key, arena) (key)
+#define HASHTBL__OWN_FUNCS_CONST_EQUAL(func, a, b) func(a, b)
+
+#define HASHTBL__OWN_ARENA(op, func, key, arena) HASHTBL__OWN_ARENA_##op(func, key, arena)
+#define HASHTBL__OWN_ARENA_DUP(func, key, arena) _hashtbl_arena_str_dup(arena, key)
+#define HASHTBL__OWN_ARENA_FREE(func, key, arena) ((void)0)
+#define HASHTBL__OWN_ARENA_MOVE(func, key, arena) _hashtbl_arena_str_dup(arena, key)
+#define HASHTBL__OWN_ARENA_DROP(func, key, arena) func(key)
+#define HASHTBL__OWN_ARENA_IS_ARENA(func, key, arena) 1
+#define HASHTBL__OWN_ARENA_VIEW(func, key, arena) (key)
+#define HASHTBL__OWN_ARENA_CONST_EQUAL(func, a, b) func(a, b)
 
-#define HASHTBL__INTERNAL_KEY_FULL(Type, ConstType, dup_func, free_func, hash_func, equal_func) \
-    Type, ConstType, dup_func, free_func, hash_func, equal_func
+/* like HASHTBL__OWN_FUNCS, but the stored key (an lvalue) is a HashtblStr */
+#define HASHTBL__OWN_STR(op, func, key, arena) HASHTBL__OWN_STR_##op(func, key, arena)
+#define HASHTBL__OWN_STR_DUP(func, key, arena) func(key)
+#define HASHTBL__OWN_STR_FREE(func, key, arena) func(key)
+#define HASHTBL__OWN_STR_MOVE(func, key, arena) (key)
+#define HASHTBL__OWN_STR_DROP(func, key, arena) ((void)0)
+#define HASHTBL__OWN_STR_IS_ARENA(func, key, arena) 0
+#define HASHTBL__OWN_STR_VIEW(func, key, arena) hashtbl_str_cstr(&(key))
+#define HASHTBL__OWN_STR_CONST_EQUAL(func, a, b) (!strcmp(a, b))
+
+/* smallest and largest chunk of a key arena, chunks grow with the arena */
+#define HASHTBL_ARENA_MIN_CHUNK 4096
+#define HASHTBL_ARENA_MAX_CHUNK (1024 * 1024)
+
+typedef struct HashtblArenaChunk {
+    struct HashtblArenaChunk *next;
+    size_t size;
+    size_t used;
+} HashtblArenaChunk;
+
+typedef struct {
+    HashtblArenaChunk *chunks;  /* the one being filled comes first */
+    size_t allocated;           /* bytes in all chunks */
+    /* the allocator of the table owning the arena */
+    void *(*reallocarray_func)(void *, size_t, size_t);
+    void (*free_func)(void *);
+} HashtblArena;
+
+static inline void
+_hashtbl_arena_init(HashtblArena *a, void *(*reallocarray_func)(void *, size_t, size_t), void (*free_func)(void *))
+{
+    a->chunks = NULL;
+    a->allocated = 0;
+    a->reallocarray_func = reallocarray_func;
+    a->free_func = free_func;
+}
+
+static inline void
+_hashtbl_arena_clear(HashtblArena *a)
+{
+    while (a->chunks) {
+        HashtblArenaChunk *next = a->chunks->next;
+        a->free_func(a->chunks);
+        a->chunks = next;
+    }
+    a->allocated = 0;
+}
+
+static inline void *
+_hashtbl_arena_alloc(HashtblArena *a, size_t size)
+{
+    HashtblArenaChunk *c = a->chunks;
+    if (!c || c->size - c->used < size) {
+        size_t chunk_size = a->allocated < HASHTBL_ARENA_MIN_CHUNK ? HASHTBL_ARENA_MIN_CHUNK : a->allocated;
+        if (chunk_size > HASHTBL_ARENA_MAX_CHUNK)
+            chunk_size = HASHTBL_ARENA_MAX_CHUNK;
+        if (chunk_size < size)
+            chunk_size = size;
+
+        c = (HashtblArenaChunk *)a->reallocarray_func(NULL, 1, sizeof(HashtblArenaChunk) + chunk_size);
+        if (!c)
+            abort(); /* like str_dup() */
+
+        c->size = chunk_size;
+        c->used = 0;
+        if (a->chunks && chunk_size == size) {
+            /* a huge key gets a chunk of its own, the current one stays in front */
+            c->next = a->chunks->next;
+            a->chunks->next = c;
+        } else {
+            c->next = a->chunks;
+            a->chunks = c;
+        }
+        a->allocated += chunk_size;
+    }
+
+    void *p = (char *)(c + 1) + c->used;
+    c->used += size;
+    return p;
+}
+
+/* NULL is copied as an empty string, like str_dup() does */
+static inline char *
+_hashtbl_arena_str_dup(HashtblArena *a, const char *s)
+{
+    size_t len = s ? strlen(s) : 0;
+    char *r = (char *)_hashtbl_arena_alloc(a, len + 1);
+    if (len)
+        memcpy(r, s, len);
+    r[len] = 0;
+    return r;
+}
+
+/* bytes of a HashtblStr kept next to its length. Shorter strings are
+ * stored completely, longer ones as a prefix plus a pointer to a copy. */
+#define HASHTBL_STR_INLINE 20
+#define HASHTBL_STR_PREFIX (HASHTBL_STR_INLINE - sizeof(char *))
+
+typedef struct {
+    uint32_t len;
+    char data[HASHTBL_STR_INLINE];
+} HashtblStr;
+
+static inline const char *
+hashtbl_str_cstr(const HashtblStr *s)
+{
+    if (s->len < HASHTBL_STR_INLINE)
+        return s->data;
+
+    char *p;
+    memcpy(&p, s->data + HASHTBL_STR_PREFIX, sizeof(p));
+    return p;
+}
+
+static inline unsigned
+hashtbl_str_length(const HashtblStr *s)
+{
+    return s->len;
+}
+
+static inline HashtblStr
+hashtbl_str_from_buf(const char *str, size_t len)
+{
+    HashtblStr s;
+
+    memset(s.data, 0, sizeof(s.data));
+    if (len < HASHTBL_STR_INLINE) {
+        if (len)
+            memcpy(s.data, str, len);
+    } else {
+        char *p = (char *)malloc(len + 1);
+        if (!p)
+            abort(); /* like str_dup() */
+
+        memcpy(p, str, len);
+        p[len] = 0;
+        memcpy(s.data, str, HASHTBL_STR_PREFIX);
+        memcpy(s.data + HASHTBL_STR_PREFIX, &p, sizeof(p));
+    }
+    s.len = (uint32_t)len;
+
+    return s;
+}
+
+/* NULL is copied as an empty string, like str_dup() does */
+static inline HashtblStr
+_hashtbl_str_make(const char *str)
+{
+    return hashtbl_str_from_buf(str, str ? strlen(str) : 0);
+}
+
+static inline void
+_hashtbl_str_free(HashtblStr s)
+{
+    if (s.len >= HASHTBL_STR_INLINE)
+        free((void *)hashtbl_str_cstr(&s));
+}
+
+static inline int
+_hashtbl_str_equal(HashtblStr s, const char *key)
+{
+    /* the inline bytes decide most comparisons, `key` ends at the
+     * first mismatch since there is no NUL among them */
+    size_t n = s.len < HASHTBL_STR_INLINE ? s.len : HASHTBL_STR_PREFIX;
+    for (size_t i = 0; i < n; ++i) {
+        if (s.data[i] != key[i])
+            return 0;
+    }
+
+    if (s.len < HASHTBL_STR_INLINE)
+        return key[n] == 0;
+
+    return !strncmp(hashtbl_str_cstr(&s) + n, key + n, s.len - n) && key[s.len] == 0;
+}
+
+/* the table code hashes through key_hash_call(key_hash_func, key, seed),
+ * which always evaluates the seed so that callers don't need to mark it as
+ * used for unseeded keys */
+#define HASHTBL__HASH_UNSEEDED(hash_func, key, seed) ((void)(seed), hash_func(key))
+#define HASHTBL__HASH_SEEDED(hash_func, key, seed) hash_func(key, seed)
+
+/* key_hash_call(HASHTBL__USES_SEED, 0, 0) is 1 for seeded keys, 0 otherwise */
+#define HASHTBL__USES_SEED(...) HASHTBL__THIRD_ARG(__VA_ARGS__, 1, 0, ~)
+#define HASHTBL__THIRD_ARG(a, b, c, ...) c
 
 #define HASHTBL_VALUE(Type) \
     HASHTBL__INTERNAL_VALUE_FULL(Type, Type, /*nop*/, (void))
@@ -136,13 +601,35 @@
 #define HASHTBL__INTERNAL_VALUE_FULL(Type, ConstType, dup_func, free_func) \
     Type, ConstType, dup_func, free_func
 
+#define HASHTBL_SIZING_PRIME \
+    _hashtbl_prime_bucket_count, _hashtbl_prime_index_for_hash, 0
+
+#define HASHTBL_SIZING_POW2 \
+    _hashtbl_pow2_bucket_count, _hashtbl_pow2_index_for_hash, 0
+
+#define HASHTBL_SIZING_INCREMENTAL(SIZING_SPEC, buckets_per_step) \
+    HASHTBL__INTERNAL_SIZING_INCREMENTAL(SIZING_SPEC, buckets_per_step)
+
+#define HASHTBL__INTERNAL_SIZING_INCREMENTAL(bucket_count_func, index_for_hash_func, old_buckets_per_step, buckets_per_step) \
+    bucket_count_func, index_for_hash_func, buckets_per_step
+
 #define HASHTBL_DEFINE(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC) \
-    HASHTBL__INTERNAL_DEFINE(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray, free)
+    HASHTBL__EXPAND_DEFINE(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, HASHTBL_SIZING_PRIME, reallocarray, free)
 
 #define HASHTBL_DEFINE_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func) \
-    HASHTBL__INTERNAL_DEFINE(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, reallocarray_func, free_func)
+    HASHTBL__EXPAND_DEFINE(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, HASHTBL_SIZING_PRIME, reallocarray_func, free_func)
+
+#define HASHTBL_DEFINE_SIZED(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC) \
+    HASHTBL__EXPAND_DEFINE(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC, reallocarray, free)
+
+#define HASHTBL_DEFINE_SIZED_FULL(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC, reallocarray_func, free_func) \
+    HASHTBL__EXPAND_DEFINE(TblTypeName, function_prefix, KEY_SPEC, VALUE_SPEC, SIZING_SPEC, reallocarray_func, free_func)
+
+/* expands the spec macros into their arguments before they are counted */
+#define HASHTBL__EXPAND_DEFINE(...) \
+    HASHTBL__INTERNAL_DEFINE(__VA_ARGS__)
 
-#define HASHTBL__INTERNAL_DEFINE(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, ValueType, ConstValueType, value_dup_func, value_free_func, reallocarray, free) \
+#define HASHTBL__INTERNAL_DEFINE(TblTypeName, function_prefix, KeyType, ConstKeyType, key_dup_func, key_free_func, key_hash_func, key_equal_func, key_hash_call, key_own, key_alt, ValueType, ConstValueType, value_dup_func, value_free_func, bucket_count_func, index_for_hash_func, migrate_steps, reallocarray, free) \
     \
     typedef KeyType         TblTypeName##_Key; \
     typedef ConstKeyType    TblTypeName##_ConstKey; \
@@ -162,6 +649,13 @@
         unsigned item_storage_firstfree; \
         unsigned *hashtbl; \
         TblTypeName##_Item *item_storage; \
+        unsigned old_table_size_idx; \
+        unsigned migrate_pos; \
+        unsigned *old_hashtbl; \
+        int auto_shrink; \
+        uint64_t hash_seed; \
+        unsigned reseed_min_count; \
+        HashtblArena key_arena; /* only used with HASHTBL_KEY_ARENA */ \
     } TblTypeName; \
     \
     static inline void \
@@ -174,6 +668,13 @@
         tbl->item_storage_firstfree = (unsigned)-1; \
         tbl->hashtbl = NULL; \
         tbl->item_storage = NULL; \
+        tbl->old_table_size_idx = 0; \
+        tbl->migrate_pos = 0; \
+        tbl->old_hashtbl = NULL; \
+        tbl->auto_shrink = 0; \
+        tbl->hash_seed = key_hash_call(HASHTBL__USES_SEED, 0, 0) ? _hashtbl_random_seed(tbl) : 0; \
+        tbl->reseed_min_count = 0; \
+        _hashtbl_arena_init(&tbl->key_arena, reallocarray, free); \
     } \
     \
     static inline void \
@@ -183,12 +684,14 @@
             if (tbl->item_storage[i].next == (unsigned)-2) \
                 continue; \
             \
-            key_free_func(tbl->item_storage[i].key); \
+            key_own(FREE, key_free_func, tbl->item_storage[i].key, ~); \
             value_free_func(tbl->item_storage[i].value); \
         } \
         \
+        _hashtbl_arena_clear(&tbl->key_arena); \
         free(tbl->item_storage); \
         free(tbl->hashtbl); \
+        free(tbl->old_hashtbl); \
         function_prefix##_init(tbl); \
     } \
     \
@@ -199,14 +702,87 @@
     } \
     \
     static inline unsigned \
+    function_prefix##_hash_with_seed(uint64_t seed, TblTypeName##_ConstKey key) \
+    { \
+        return key_hash_call(key_hash_func, key, seed); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_hash(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        return function_prefix##_hash_with_seed(tbl->hash_seed, key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_internal_key_equal(TblTypeName##_ConstKey a, TblTypeName##_ConstKey b) \
+    { \
+        return key_own(CONST_EQUAL, key_equal_func, a, b); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_bucket_count(unsigned size_idx) \
+    { \
+        return bucket_count_func(size_idx); \
+    } \
+    \
+    static inline unsigned \
+    function_prefix##_internal_bucket_index(unsigned hash, unsigned size_idx) \
+    { \
+        return index_for_hash_func(hash, size_idx); \
+    } \
+    \
+    static inline unsigned \
     function_prefix##_internal_index_for_hash(TblTypeName *tbl, unsigned hash) \
     { \
-        return (hash * 11) % _hashtbl_size_map[tbl->table_size_idx]; \
+        return index_for_hash_func(hash, tbl->table_size_idx); \
+    } \
+    \
+    /* moves up to `steps` buckets of the old table into the new one, \
+       returns whether there is still something left to move */ \
+    static inline int \
+    function_prefix##_rehash_step(TblTypeName *tbl, unsigned steps) \
+    { \
+        if (!tbl->old_hashtbl) \
+            return 0; \
+        \
+        unsigned old_count = bucket_count_func(tbl->old_table_size_idx); \
+        for (; steps && tbl->migrate_pos < old_count; --steps, ++tbl->migrate_pos) { \
+            unsigned item_i = tbl->old_hashtbl[tbl->migrate_pos]; \
+            tbl->old_hashtbl[tbl->migrate_pos] = (unsigned)-1; \
+            while (item_i != (unsigned)-1) { \
+                unsigned next_i = tbl->item_storage[item_i].next; \
+                unsigned hash_i = function_prefix##_internal_index_for_hash(tbl, tbl->item_storage[item_i].hash); \
+                tbl->item_storage[item_i].next = tbl->hashtbl[hash_i]; \
+                tbl->hashtbl[hash_i] = item_i; \
+                item_i = next_i; \
+            } \
+        } \
+        \
+        if (tbl->migrate_pos < old_count) \
+            return 1; \
+        \
+        free(tbl->old_hashtbl); \
+        tbl->old_hashtbl = NULL; \
+        return 0; \
+    } \
+    \
+    /* returns the not yet migrated bucket of the old table for the hash, or NULL */ \
+    static inline unsigned * \
+    function_prefix##_internal_old_bucket_for_hash(TblTypeName *tbl, unsigned hash) \
+    { \
+        if (!tbl->old_hashtbl) \
+            return NULL; \
+        \
+        unsigned hash_i = index_for_hash_func(hash, tbl->old_table_size_idx); \
+        return hash_i >= tbl->migrate_pos ? &tbl->old_hashtbl[hash_i] : NULL; \
     } \
     \
     static inline TblTypeName##_Item * \
     function_prefix##_lookup_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
     { \
+        if (migrate_steps) \
+            function_prefix##_rehash_step(tbl, migrate_steps); \
+        \
         if (!tbl->hashtbl) { \
             /* XXX: degenerate case where we could not allocate the hashes */ \
             for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
@@ -228,13 +804,22 @@
             item_i = tbl->item_storage[item_i].next; \
         } \
         \
+        unsigned *old_bucket = function_prefix##_internal_old_bucket_for_hash(tbl, hash); \
+        item_i = old_bucket ? *old_bucket : (unsigned)-1; \
+        while (item_i != (unsigned)-1) { \
+            if (tbl->item_storage[item_i].hash == hash && key_equal_func(tbl->item_storage[item_i].key, key)) \
+                return &tbl->item_storage[item_i]; \
+            \
+            item_i = tbl->item_storage[item_i].next; \
+        } \
+        \
         return NULL; \
     } \
     \
     static inline TblTypeName##_Item * \
     function_prefix##_lookup(TblTypeName *tbl, TblTypeName##_ConstKey key) \
     { \
-        return function_prefix##_lookup_with_hash(tbl, key_hash_func(key), key); \
+        return function_prefix##_lookup_with_hash(tbl, function_prefix##_hash(tbl, key), key); \
     } \
     \
     static inline int \
@@ -244,18 +829,82 @@
     } \
     \
     static inline void \
-    function_prefix##_internal_recreate_hashtbl(TblTypeName *tbl) \
+    function_prefix##_lookup_many_with_hash(TblTypeName *tbl, const unsigned *hashes, const TblTypeName##_ConstKey *keys, unsigned n, TblTypeName##_Item **out_items) \
     { \
-        free(tbl->hashtbl); \
-        tbl->hashtbl = NULL; \
-        if (tbl->table_size_idx >= sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0])) \
-            return; /* FIXME: we should never ever be here */ \
+        if (migrate_steps) \
+            function_prefix##_rehash_step(tbl, migrate_steps); \
+        \
+        if (!tbl->hashtbl || tbl->old_hashtbl) { \
+            /* degenerate case or resize in progress, no need to be fast */ \
+            for (unsigned i = 0; i < n; ++i) \
+                out_items[i] = function_prefix##_lookup_with_hash(tbl, hashes[i], keys[i]); \
+            return; \
+        } \
+        \
+        unsigned item_i[HASHTBL_LOOKUP_BATCH]; \
+        for (unsigned base = 0; base < n; base += HASHTBL_LOOKUP_BATCH) { \
+            unsigned count = n - base < HASHTBL_LOOKUP_BATCH ? n - base : HASHTBL_LOOKUP_BATCH; \
+            \
+            /* all memory accesses of a stage are independent and can overlap */ \
+            for (unsigned j = 0; j < count; ++j) { \
+                item_i[j] = function_prefix##_internal_index_for_hash(tbl, hashes[base + j]); \
+                HASHTBL__PREFETCH(&tbl->hashtbl[item_i[j]]); \
+            } \
+            \
+            for (unsigned j = 0; j < count; ++j) { \
+                item_i[j] = tbl->hashtbl[item_i[j]]; \
+                if (item_i[j] != (unsigned)-1) \
+                    HASHTBL__PREFETCH(&tbl->item_storage[item_i[j]]); \
+            } \
+            \
+            for (unsigned j = 0; j < count; ++j) { \
+                unsigned i = item_i[j]; \
+                while (i != (unsigned)-1 && (tbl->item_storage[i].hash != hashes[base + j] \
+                            || !key_equal_func(tbl->item_storage[i].key, keys[base + j]))) \
+                    i = tbl->item_storage[i].next; \
+                \
+                out_items[base + j] = i != (unsigned)-1 ? &tbl->item_storage[i] : NULL; \
+            } \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_lookup_many(TblTypeName *tbl, const TblTypeName##_ConstKey *keys, unsigned n, TblTypeName##_Item **out_items) \
+    { \
+        unsigned hashes[HASHTBL_LOOKUP_BATCH]; \
+        for (unsigned base = 0; base < n; base += HASHTBL_LOOKUP_BATCH) { \
+            unsigned count = n - base < HASHTBL_LOOKUP_BATCH ? n - base : HASHTBL_LOOKUP_BATCH; \
+            for (unsigned j = 0; j < count; ++j) \
+                hashes[j] = function_prefix##_hash(tbl, keys[base + j]); \
+            \
+            function_prefix##_lookup_many_with_hash(tbl, hashes, &keys[base], count, &out_items[base]); \
+        } \
+    } \
+    \
+    /* relinks all items into `size_idx` buckets. If those can't be allocated, \
+       the current buckets (and size) are kept and relinked instead. Returns \
+       whether the table got the requested size. */ \
+    static inline int \
+    function_prefix##_internal_recreate_hashtbl(TblTypeName *tbl, unsigned size_idx) \
+    { \
+        if (size_idx >= HASHTBL__SIZE_STEPS) \
+            return 0; /* FIXME: we should never ever be here */ \
+        \
+        if (size_idx != tbl->table_size_idx || !tbl->hashtbl) { \
+            unsigned *hashtbl = (unsigned *)reallocarray(NULL, bucket_count_func(size_idx), sizeof(unsigned)); \
+            if (hashtbl) { \
+                free(tbl->hashtbl); \
+                tbl->hashtbl = hashtbl; \
+                tbl->table_size_idx = size_idx; \
+            } \
+        } \
         \
-        tbl->hashtbl = (unsigned *)reallocarray(NULL, _hashtbl_size_map[tbl->table_size_idx], sizeof(unsigned)); \
+        free(tbl->old_hashtbl); \
+        tbl->old_hashtbl = NULL; \
         if (!tbl->hashtbl) \
-            return; /* FIXME!??? degenerate case where we cant alloc the hash table */ \
+            return 0; /* FIXME!??? degenerate case where we cant alloc the hash table */ \
         \
-        for (unsigned i = 0; i < _hashtbl_size_map[tbl->table_size_idx]; ++i) { \
+        for (unsigned i = 0; i < bucket_count_func(tbl->table_size_idx); ++i) { \
             tbl->hashtbl[i] = (unsigned)-1; \
         } \
         \
@@ -267,19 +916,47 @@
             tbl->item_storage[i].next = tbl->hashtbl[hash_i]; \
             tbl->hashtbl[hash_i] = i; \
         } \
+        return tbl->table_size_idx == size_idx; \
     } \
     \
     static inline void \
     function_prefix##_internal_auto_grow(TblTypeName *tbl) \
     { \
         unsigned target_table_size = tbl->table_size_idx; \
-        while (target_table_size < sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0])  \
-                &&  tbl->element_count > _hashtbl_size_map[target_table_size] - _hashtbl_size_map[target_table_size]/4) \
+        while (target_table_size < HASHTBL__SIZE_STEPS  \
+                &&  tbl->element_count > bucket_count_func(target_table_size) - bucket_count_func(target_table_size)/4) \
             target_table_size++; \
         \
         if (target_table_size != tbl->table_size_idx || !tbl->hashtbl) { \
-            tbl->table_size_idx = target_table_size; \
-            function_prefix##_internal_recreate_hashtbl(tbl); \
+            if (migrate_steps && tbl->hashtbl && target_table_size < HASHTBL__SIZE_STEPS) { \
+                /* incremental mode: keep the old buckets and migrate them step by step. \
+                   The inserts since the last grow have normally finished that \
+                   migration already */ \
+                function_prefix##_rehash_step(tbl, (unsigned)-1); \
+                \
+                unsigned *new_hashtbl = (unsigned *)reallocarray(NULL, bucket_count_func(target_table_size), sizeof(unsigned)); \
+                if (!new_hashtbl) \
+                    return; /* keep working with the old (overloaded) buckets */ \
+                \
+                for (unsigned i = 0; i < bucket_count_func(target_table_size); ++i) { \
+                    new_hashtbl[i] = (unsigned)-1; \
+                } \
+                \
+                tbl->old_hashtbl = tbl->hashtbl; \
+                tbl->old_table_size_idx = tbl->table_size_idx; \
+                tbl->migrate_pos = 0; \
+                tbl->hashtbl = new_hashtbl; \
+                tbl->table_size_idx = target_table_size; \
+                function_prefix##_rehash_step(tbl, migrate_steps); \
+            } else { \
+                function_prefix##_internal_recreate_hashtbl(tbl, target_table_size); \
+            } \
+        } else if (migrate_steps && tbl->old_hashtbl) { \
+            /* spread the rest of the migration over the inserts left until the \
+               next grow, so that one never has to finish it all at once */ \
+            unsigned left = bucket_count_func(tbl->old_table_size_idx) - tbl->migrate_pos; \
+            unsigned inserts = bucket_count_func(tbl->table_size_idx) - bucket_count_func(tbl->table_size_idx)/4 - tbl->element_count + 1; \
+            function_prefix##_rehash_step(tbl, (left + inserts - 1) / inserts); \
         } \
     } \
     \
@@ -306,7 +983,8 @@
             if (a) { \
                 tbl->item_storage = (TblTypeName##_Item *)a; \
                 tbl->item_storage_allocated = newsize; \
-                memset(&tbl->item_storage[tbl->item_storage_used], 0, (tbl->item_storage_allocated - tbl->item_storage_used)*sizeof(tbl->item_storage[0])); \
+                if (!migrate_steps) /* incremental mode avoids O(n) work on a single insert */ \
+                    memset(&tbl->item_storage[tbl->item_storage_used], 0, (tbl->item_storage_allocated - tbl->item_storage_used)*sizeof(tbl->item_storage[0])); \
                 return tbl->item_storage_used++; \
             } else { \
                 /* FIXME: alloc failed, how to handle?? */ \
@@ -316,12 +994,43 @@
     } \
     \
     static inline void \
+    function_prefix##_reseed(TblTypeName *tbl, uint64_t seed) \
+    { \
+        tbl->hash_seed = seed; \
+        if (!key_hash_call(HASHTBL__USES_SEED, 0, 0)) \
+            return; \
+        \
+        for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
+            if (tbl->item_storage[i].next == (unsigned)-2) \
+                continue; /* free item, the hash is the free list link */ \
+            \
+            tbl->item_storage[i].hash = function_prefix##_hash(tbl, key_own(VIEW, ~, tbl->item_storage[i].key, ~)); \
+        } \
+        \
+        if (tbl->hashtbl) \
+            function_prefix##_internal_recreate_hashtbl(tbl, tbl->table_size_idx); \
+    } \
+    \
+    static inline void \
     function_prefix##_internal_hookup_item(TblTypeName *tbl, unsigned item_i) \
     { \
         if (tbl->hashtbl) { \
             unsigned hash_i = function_prefix##_internal_index_for_hash(tbl, tbl->item_storage[item_i].hash); \
             tbl->item_storage[item_i].next = tbl->hashtbl[hash_i]; \
             tbl->hashtbl[hash_i] = item_i; \
+            \
+            if (key_hash_call(HASHTBL__USES_SEED, 0, 0) && tbl->element_count >= tbl->reseed_min_count) { \
+                unsigned chain_length = 0; \
+                for (unsigned i = item_i; i != (unsigned)-1; i = tbl->item_storage[i].next) \
+                    chain_length++; \
+                \
+                if (chain_length > HASHTBL_RESEED_CHAIN_LENGTH) { \
+                    /* someone found colliding keys for our seed, or we were unlucky */ \
+                    function_prefix##_reseed(tbl, _hashtbl_random_seed(tbl)); \
+                    /* don't keep rehashing if the hash function is just bad */ \
+                    tbl->reseed_min_count = tbl->element_count * 2 + 1; \
+                } \
+            } \
         } else { \
             tbl->item_storage[item_i].next = (unsigned)-1; \
         } \
@@ -330,53 +1039,185 @@
     } \
     \
     static inline TblTypeName##_Item * \
-    function_prefix##_set_zero(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    function_prefix##_lookup_or_insert_zero_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key, int *inserted) \
     { \
-        unsigned hash = key_hash_func(key); \
+        if (inserted) \
+            *inserted = 0; \
+        \
         TblTypeName##_Item *item = function_prefix##_lookup_with_hash(tbl, hash, key); \
-        if (item) { \
+        if (item) \
+            return item; \
+        \
+        /* the new item goes to the head of the chain, no need to walk it again */ \
+        unsigned item_i = function_prefix##_internal_alloc_item(tbl); \
+        if (item_i == (unsigned)-1) \
+            return NULL; \
+        \
+        tbl->item_storage[item_i].hash = hash; \
+        tbl->item_storage[item_i].key = key_own(DUP, key_dup_func, key, &tbl->key_arena); \
+        memset(&tbl->item_storage[item_i].value, 0, sizeof tbl->item_storage[item_i].value); \
+        function_prefix##_internal_hookup_item(tbl, item_i); \
+        if (inserted) \
+            *inserted = 1; \
+        return &tbl->item_storage[item_i]; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_or_insert_zero(TblTypeName *tbl, TblTypeName##_ConstKey key, int *inserted) \
+    { \
+        return function_prefix##_lookup_or_insert_zero_with_hash(tbl, function_prefix##_hash(tbl, key), key, inserted); \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_or_insert_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key, \
+                                                TblTypeName##_ConstValue value, int *inserted) \
+    { \
+        int is_new; \
+        TblTypeName##_Item *item = function_prefix##_lookup_or_insert_zero_with_hash(tbl, hash, key, &is_new); \
+        if (item && is_new) \
+            item->value = value_dup_func(value); \
+        if (inserted) \
+            *inserted = is_new; \
+        return item; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_or_insert(TblTypeName *tbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value, int *inserted) \
+    { \
+        return function_prefix##_lookup_or_insert_with_hash(tbl, function_prefix##_hash(tbl, key), key, value, inserted); \
+    } \
+    \
+    static inline int \
+    function_prefix##_upsert(TblTypeName *tbl, TblTypeName##_ConstKey key, \
+                             void (*update_func)(TblTypeName##_Value *value, void *ctx), void *ctx) \
+    { \
+        int inserted; \
+        TblTypeName##_Item *item = function_prefix##_lookup_or_insert_zero(tbl, key, &inserted); \
+        if (!item) \
+            return -1; \
+        \
+        update_func(&item->value, ctx); \
+        return inserted; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set_zero(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        int inserted; \
+        TblTypeName##_Item *item = function_prefix##_lookup_or_insert_zero(tbl, key, &inserted); \
+        if (item && !inserted) { \
             value_free_func((item)->value); \
             memset(&item->value, 0, sizeof(item->value)); \
-            return item; \
-        } else { \
-            unsigned item_i = function_prefix##_internal_alloc_item(tbl); \
-            if (item_i != (unsigned)-1) { \
-                tbl->item_storage[item_i].hash = hash; \
-                tbl->item_storage[item_i].key = key_dup_func(key); \
-                memset(&tbl->item_storage[item_i].value, 0, sizeof tbl->item_storage[item_i].value); \
-                function_prefix##_internal_hookup_item(tbl, item_i); \
-                return &tbl->item_storage[item_i]; \
-            } else { \
-                return NULL; \
-            } \
         } \
+        return item; \
     } \
     \
     static inline TblTypeName##_Item * \
-    function_prefix##_set(TblTypeName *ptbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    function_prefix##_set_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
     { \
-        TblTypeName##_Item *item = function_prefix##_set_zero(ptbl, key); \
+        int inserted; \
+        TblTypeName##_Item *item = function_prefix##_lookup_or_insert_zero_with_hash(tbl, hash, key, &inserted); \
         if (item) { \
+            if (!inserted) \
+                value_free_func((item)->value); \
             item->value = value_dup_func(value); \
         } \
         return item; \
     } \
     \
+    static inline TblTypeName##_Item * \
+    function_prefix##_set(TblTypeName *ptbl, TblTypeName##_ConstKey key, TblTypeName##_ConstValue value) \
+    { \
+        return function_prefix##_set_with_hash(ptbl, function_prefix##_hash(ptbl, key), key, value); \
+    } \
+    \
     static inline void \
     function_prefix##_internal_dealloc_item(TblTypeName *tbl, unsigned item_i) \
     { \
-        key_free_func(tbl->item_storage[item_i].key); \
+        key_own(FREE, key_free_func, tbl->item_storage[item_i].key, ~); \
         value_free_func(tbl->item_storage[item_i].value); \
         tbl->item_storage[item_i].next = (unsigned)-2; \
         tbl->item_storage[item_i].hash = tbl->item_storage_firstfree; \
         tbl->item_storage_firstfree = item_i; \
     } \
     \
+    static inline unsigned \
+    function_prefix##_internal_size_idx_for(unsigned num_items) \
+    { \
+        unsigned target_table_size = 0; \
+        while (target_table_size < HASHTBL__SIZE_STEPS  \
+                &&  num_items > bucket_count_func(target_table_size) - bucket_count_func(target_table_size)/4) \
+            target_table_size++; \
+        \
+        return target_table_size; \
+    } \
+    \
     static inline void \
-    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    function_prefix##_compact(TblTypeName *tbl) \
     { \
-        unsigned hash = key_hash_func(key); \
+        unsigned used = 0; \
+        for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
+            if (tbl->item_storage[i].next == (unsigned)-2) \
+                continue; /* free item */ \
+            \
+            if (i != used) \
+                memcpy(&tbl->item_storage[used], &tbl->item_storage[i], sizeof(tbl->item_storage[0])); \
+            used++; \
+        } \
         \
+        tbl->item_storage_used = used; \
+        tbl->item_storage_firstfree = (unsigned)-1; \
+        \
+        if (key_own(IS_ARENA, ~, ~, ~)) { \
+            /* removed keys are only reclaimed here, by copying the live ones */ \
+            HashtblArena old_arena = tbl->key_arena; \
+            _hashtbl_arena_init(&tbl->key_arena, reallocarray, free); \
+            for (unsigned i = 0; i < used; ++i) \
+                tbl->item_storage[i].key = key_own(MOVE, key_dup_func, tbl->item_storage[i].key, &tbl->key_arena); \
+            _hashtbl_arena_clear(&old_arena); \
+        } \
+        \
+        function_prefix##_internal_recreate_hashtbl(tbl, function_prefix##_internal_size_idx_for(tbl->element_count)); \
+    } \
+    \
+    static inline void \
+    function_prefix##_shrink_to_fit(TblTypeName *tbl) \
+    { \
+        function_prefix##_compact(tbl); \
+        \
+        if (!tbl->item_storage_used) { \
+            free(tbl->item_storage); \
+            tbl->item_storage = NULL; \
+            tbl->item_storage_allocated = 0; \
+        } else if (tbl->item_storage_used < tbl->item_storage_allocated) { \
+            void *a = reallocarray(tbl->item_storage, tbl->item_storage_used, sizeof tbl->item_storage[0]); \
+            if (a) { \
+                tbl->item_storage = (TblTypeName##_Item *)a; \
+                tbl->item_storage_allocated = tbl->item_storage_used; \
+            } \
+        } \
+    } \
+    \
+    static inline void \
+    function_prefix##_set_auto_shrink(TblTypeName *tbl, int enabled) \
+    { \
+        tbl->auto_shrink = enabled; \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_auto_shrink(TblTypeName *tbl) \
+    { \
+        /* shrink when more than half of the item storage is free, \
+           at which point the cost is amortized over the removals */ \
+        if (tbl->auto_shrink \
+                && tbl->item_storage_allocated >= 64 \
+                && tbl->element_count < tbl->item_storage_allocated / 2) \
+            function_prefix##_shrink_to_fit(tbl); \
+    } \
+    \
+    static inline void \
+    function_prefix##_remove_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_ConstKey key) \
+    { \
         if (!tbl->hashtbl) { \
             /* XXX: degenerate case where we could not allocate the hashes */ \
             for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
@@ -385,31 +1226,92 @@
                     && key_equal_func(tbl->item_storage[i].key, key)) { \
                         function_prefix##_internal_dealloc_item(tbl, i); \
                         tbl->element_count--; \
+                        function_prefix##_internal_auto_shrink(tbl); \
                         return; \
                 } \
             } \
         } else { \
+            if (migrate_steps) \
+                function_prefix##_rehash_step(tbl, migrate_steps); \
+            \
             unsigned hash_i = function_prefix##_internal_index_for_hash(tbl, hash); \
             unsigned *p_item_i = &tbl->hashtbl[hash_i]; \
-            while (*p_item_i != (unsigned)-1) { \
-                if (tbl->item_storage[*p_item_i].hash == hash && key_equal_func(tbl->item_storage[*p_item_i].key, key)) { \
-                    unsigned tmp_i = *p_item_i; \
-                    *p_item_i = tbl->item_storage[tmp_i].next; \
-                    function_prefix##_internal_dealloc_item(tbl, tmp_i); \
-                    tbl->element_count--; \
-                    return; \
+            for (int pass = 0; pass < 2 && p_item_i; ++pass) { \
+                while (*p_item_i != (unsigned)-1) { \
+                    if (tbl->item_storage[*p_item_i].hash == hash && key_equal_func(tbl->item_storage[*p_item_i].key, key)) { \
+                        unsigned tmp_i = *p_item_i; \
+                        *p_item_i = tbl->item_storage[tmp_i].next; \
+                        function_prefix##_internal_dealloc_item(tbl, tmp_i); \
+                        tbl->element_count--; \
+                        function_prefix##_internal_auto_shrink(tbl); \
+                        return; \
+                    } \
+                    \
+                    p_item_i = &tbl->item_storage[*p_item_i].next; \
                 } \
                 \
-                p_item_i = &tbl->item_storage[*p_item_i].next; \
+                /* second pass: the item might still be in the old buckets */ \
+                p_item_i = function_prefix##_internal_old_bucket_for_hash(tbl, hash); \
             } \
         } \
     } \
     \
+    static inline void \
+    function_prefix##_remove(TblTypeName *tbl, TblTypeName##_ConstKey key) \
+    { \
+        function_prefix##_remove_with_hash(tbl, function_prefix##_hash(tbl, key), key); \
+    } \
+    \
+    static inline void \
+    function_prefix##_internal_stats_add_chain(TblTypeName *tbl, HashtblStats *out, unsigned item_i) \
+    { \
+        unsigned length = 0; \
+        for (; item_i != (unsigned)-1; item_i = tbl->item_storage[item_i].next) \
+            length++; \
+        \
+        out->bucket_count++; \
+        if (!length) \
+            out->empty_buckets++; \
+        if (length > out->longest_chain) \
+            out->longest_chain = length; \
+        out->chain_histogram[length < HASHTBL_STATS_HISTOGRAM ? length : HASHTBL_STATS_HISTOGRAM - 1]++; \
+    } \
+    \
+    static inline void \
+    function_prefix##_stats(TblTypeName *tbl, HashtblStats *out) \
+    { \
+        memset(out, 0, sizeof(*out)); \
+        out->element_count = tbl->element_count; \
+        \
+        if (tbl->hashtbl) { \
+            for (unsigned i = 0; i < bucket_count_func(tbl->table_size_idx); ++i) \
+                function_prefix##_internal_stats_add_chain(tbl, out, tbl->hashtbl[i]); \
+            out->bucket_bytes += bucket_count_func(tbl->table_size_idx) * sizeof(unsigned); \
+        } \
+        \
+        if (tbl->old_hashtbl) { \
+            for (unsigned i = tbl->migrate_pos; i < bucket_count_func(tbl->old_table_size_idx); ++i) \
+                function_prefix##_internal_stats_add_chain(tbl, out, tbl->old_hashtbl[i]); \
+            out->bucket_bytes += bucket_count_func(tbl->old_table_size_idx) * sizeof(unsigned); \
+        } \
+        \
+        for (unsigned i = tbl->item_storage_firstfree; i != (unsigned)-1; i = tbl->item_storage[i].hash) \
+            out->freelist_length++; \
+        \
+        out->item_bytes = (size_t)tbl->item_storage_allocated * sizeof(TblTypeName##_Item); \
+        out->key_bytes = tbl->key_arena.allocated; \
+        \
+        if (out->bucket_count) { \
+            out->load_factor = (double)out->element_count / out->bucket_count; \
+            out->empty_bucket_ratio = (double)out->empty_buckets / out->bucket_count; \
+        } \
+    } \
+    \
     static inline int \
     function_prefix##_check_internal_sanity(TblTypeName *tbl) \
     { \
         size_t elcount = 0; \
-        for (size_t i = 0; i < _hashtbl_size_map[tbl->table_size_idx]; ++i) { \
+        for (size_t i = 0; i < bucket_count_func(tbl->table_size_idx); ++i) { \
             unsigned item_i = tbl->hashtbl[i]; \
             while (item_i != (unsigned)-1) { \
                 elcount++; \
@@ -421,11 +1323,26 @@
             } \
         } \
         \
+        for (size_t i = 0; tbl->old_hashtbl && i < bucket_count_func(tbl->old_table_size_idx); ++i) { \
+            unsigned item_i = tbl->old_hashtbl[i]; \
+            if (i < tbl->migrate_pos && item_i != (unsigned)-1) \
+                return 0; \
+            \
+            while (item_i != (unsigned)-1) { \
+                elcount++; \
+                \
+                if (index_for_hash_func(tbl->item_storage[item_i].hash, tbl->old_table_size_idx) != i) \
+                    return 0; \
+                \
+                item_i = tbl->item_storage[item_i].next; \
+            } \
+        } \
+        \
         if (elcount != tbl->element_count) \
             return 0; \
         \
-        if (_hashtbl_size_map[tbl->table_size_idx] - _hashtbl_size_map[tbl->table_size_idx]/4 < elcount \
-                && tbl->table_size_idx < sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0]) - 1) \
+        if (bucket_count_func(tbl->table_size_idx) - bucket_count_func(tbl->table_size_idx)/4 < elcount \
+                && tbl->table_size_idx < HASHTBL__SIZE_STEPS - 1) \
             return 0; \
         \
         return 1; \
@@ -473,12 +1390,16 @@
         if (it->tbl->hashtbl) { \
             unsigned hashtbl_i = function_prefix##_internal_index_for_hash(it->tbl, it->tbl->item_storage[it->i].hash); \
             unsigned *p_item_i = &it->tbl->hashtbl[hashtbl_i]; \
-            while (*p_item_i != (unsigned)-1) { \
-                if (*p_item_i == it->i) { \
-                    *p_item_i = it->tbl->item_storage[it->i].next; \
-                } else { \
-                    p_item_i = &it->tbl->item_storage[*p_item_i].next; \
+            for (int pass = 0; pass < 2 && p_item_i; ++pass) { \
+                while (*p_item_i != (unsigned)-1) { \
+                    if (*p_item_i == it->i) { \
+                        *p_item_i = it->tbl->item_storage[it->i].next; \
+                    } else { \
+                        p_item_i = &it->tbl->item_storage[*p_item_i].next; \
+                    } \
                 } \
+                \
+                p_item_i = function_prefix##_internal_old_bucket_for_hash(it->tbl, it->tbl->item_storage[it->i].hash); \
             } \
         } \
         \
@@ -491,13 +1412,7 @@
     { \
         function_prefix##_init(tbl); \
         \
-        unsigned target_table_size = 0; \
-        while (target_table_size < sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0])  \
-                &&  num_items > _hashtbl_size_map[target_table_size] - _hashtbl_size_map[target_table_size]/4) \
-            target_table_size++; \
-        \
-        tbl->table_size_idx = target_table_size; \
-        function_prefix##_internal_recreate_hashtbl(tbl); \
+        function_prefix##_internal_recreate_hashtbl(tbl, function_prefix##_internal_size_idx_for(num_items)); \
         tbl->item_storage = (TblTypeName##_Item *)reallocarray(NULL, num_items, sizeof tbl->item_storage[0]); \
         if (tbl->item_storage) { \
             tbl->item_storage_allocated = num_items; \
@@ -505,10 +1420,256 @@
         } \
     } \
     \
+    /* Sizes the item storage and the buckets once for n more items and \
+     * finishes any pending migration. Returns nonzero if items can now be \
+     * allocated and linked without any growth checks. On failure, the \
+     * elements are left as they were, only the reserved memory may differ. */ \
+    static inline int \
+    function_prefix##_internal_reserve_bulk(TblTypeName *tbl, unsigned n) \
+    { \
+        unsigned target_table_size = function_prefix##_internal_size_idx_for(tbl->element_count + n); \
+        if (target_table_size > tbl->table_size_idx || !tbl->hashtbl) { \
+            if (!function_prefix##_internal_recreate_hashtbl(tbl, target_table_size)) \
+                return 0; \
+        } else { \
+            function_prefix##_rehash_step(tbl, (unsigned)-1); \
+        } \
+        \
+        if (tbl->item_storage_used + n > tbl->item_storage_allocated) { \
+            void *a = reallocarray(tbl->item_storage, tbl->item_storage_used + n, sizeof tbl->item_storage[0]); \
+            if (!a) \
+                return 0; \
+            tbl->item_storage = (TblTypeName##_Item *)a; \
+            tbl->item_storage_allocated = tbl->item_storage_used + n; \
+        } \
+        \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_build_from_combine(TblTypeName *tbl, const TblTypeName##_ConstKey *keys, const TblTypeName##_ConstValue *values, unsigned n, \
+                                         void (*combine_func)(TblTypeName##_Value *value, TblTypeName##_ConstValue new_value, void *ctx), void *ctx) \
+    { \
+        if (n > (unsigned)-2 - tbl->item_storage_used) \
+            return 0; /* we need indices -1 and -2 as sentinels */ \
+        \
+        int reserved = function_prefix##_internal_reserve_bulk(tbl, n); \
+        \
+        unsigned *hashes = (unsigned *)reallocarray(NULL, n ? n : 1, sizeof(unsigned)); \
+        if (!hashes || !reserved) { \
+            /* out of memory, the slow path might still work */ \
+            free(hashes); \
+            for (unsigned i = 0; i < n; ++i) { \
+                TblTypeName##_Item *item = function_prefix##_lookup(tbl, keys[i]); \
+                if (item && combine_func) { \
+                    combine_func(&item->value, values[i], ctx); \
+                } else if (!function_prefix##_set(tbl, keys[i], values[i])) { \
+                    return 0; \
+                } \
+            } \
+            return 1; \
+        } \
+        \
+        for (unsigned i = 0; i < n; ++i) \
+            hashes[i] = function_prefix##_hash(tbl, keys[i]); \
+        \
+        for (unsigned i = 0; i < n; ++i) { \
+            unsigned hash_i = function_prefix##_internal_index_for_hash(tbl, hashes[i]); \
+            unsigned item_i = tbl->hashtbl[hash_i]; \
+            while (item_i != (unsigned)-1 && (tbl->item_storage[item_i].hash != hashes[i] \
+                        || !key_equal_func(tbl->item_storage[item_i].key, keys[i]))) \
+                item_i = tbl->item_storage[item_i].next; \
+            \
+            if (item_i != (unsigned)-1) { \
+                /* duplicate key */ \
+                if (combine_func) { \
+                    combine_func(&tbl->item_storage[item_i].value, values[i], ctx); \
+                } else { \
+                    value_free_func(tbl->item_storage[item_i].value); \
+                    tbl->item_storage[item_i].value = value_dup_func(values[i]); \
+                } \
+                continue; \
+            } \
+            \
+            item_i = function_prefix##_internal_alloc_item(tbl); \
+            tbl->item_storage[item_i].hash = hashes[i]; \
+            tbl->item_storage[item_i].key = key_own(DUP, key_dup_func, keys[i], &tbl->key_arena); \
+            tbl->item_storage[item_i].value = value_dup_func(values[i]); \
+            tbl->item_storage[item_i].next = tbl->hashtbl[hash_i]; \
+            tbl->hashtbl[hash_i] = item_i; \
+            tbl->element_count++; \
+        } \
+        \
+        free(hashes); \
+        return 1; \
+    } \
+    \
+    static inline int \
+    function_prefix##_build_from(TblTypeName *tbl, const TblTypeName##_ConstKey *keys, const TblTypeName##_ConstValue *values, unsigned n) \
+    { \
+        return function_prefix##_build_from_combine(tbl, keys, values, n, NULL, NULL); \
+    } \
+    \
+    static inline int \
+    function_prefix##_merge(TblTypeName *dst, TblTypeName *src, \
+                            void (*combine_func)(TblTypeName##_Value *value, TblTypeName##_ConstValue src_value, void *ctx), void *ctx) \
+    { \
+        if (src->element_count > (unsigned)-2 - dst->item_storage_used) \
+            return 0; /* we need indices -1 and -2 as sentinels */ \
+        \
+        if (!function_prefix##_internal_reserve_bulk(dst, src->element_count)) \
+            return 0; \
+        \
+        for (unsigned i = 0; i < src->item_storage_used; ++i) { \
+            TblTypeName##_Item *s = &src->item_storage[i]; \
+            if (s->next == (unsigned)-2) \
+                continue; \
+            \
+            /* tables with seeded keys don't share their seeds */ \
+            unsigned hash = dst->hash_seed == src->hash_seed ? s->hash : function_prefix##_hash(dst, key_own(VIEW, ~, s->key, ~)); \
+            unsigned hash_i = function_prefix##_internal_index_for_hash(dst, hash); \
+            unsigned item_i = dst->hashtbl[hash_i]; \
+            while (item_i != (unsigned)-1 && (dst->item_storage[item_i].hash != hash \
+                        || !key_equal_func(dst->item_storage[item_i].key, key_own(VIEW, ~, s->key, ~)))) \
+                item_i = dst->item_storage[item_i].next; \
+            \
+            if (item_i != (unsigned)-1) { \
+                if (combine_func) { \
+                    combine_func(&dst->item_storage[item_i].value, s->value, ctx); \
+                    value_free_func(s->value); \
+                } else { \
+                    value_free_func(dst->item_storage[item_i].value); \
+                    dst->item_storage[item_i].value = s->value; \
+                } \
+                key_own(FREE, key_free_func, s->key, ~); \
+                continue; \
+            } \
+            \
+            /* move the item over, key and value keep their memory \
+               (unless the keys live in the arena of `src`) */ \
+            item_i = function_prefix##_internal_alloc_item(dst); \
+            dst->item_storage[item_i].hash = hash; \
+            dst->item_storage[item_i].key = key_own(MOVE, key_dup_func, s->key, &dst->key_arena); \
+            dst->item_storage[item_i].value = s->value; \
+            dst->item_storage[item_i].next = dst->hashtbl[hash_i]; \
+            dst->hashtbl[hash_i] = item_i; \
+            dst->element_count++; \
+        } \
+        \
+        /* everything has been moved out or freed already */ \
+        int auto_shrink = src->auto_shrink; \
+        _hashtbl_arena_clear(&src->key_arena); \
+        free(src->item_storage); \
+        free(src->hashtbl); \
+        free(src->old_hashtbl); \
+        function_prefix##_init(src); \
+        src->auto_shrink = auto_shrink; \
+        \
+        return 1; \
+    } \
+    \
+    HASHTBL__DEFINE_ALT_EXPAND(TblTypeName, function_prefix, key_hash_call, key_own, key_free_func, value_dup_func, migrate_steps, HASHTBL__UNPACK key_alt) \
+    \
 
 
 
 
+/* KEY_SPECs carry a tuple (selector, AltType, alt_hash_func, alt_equal_func, alt_dup_func),
+ * the selector defines the _alt functions or nothing */
+#define HASHTBL__UNPACK(...) __VA_ARGS__
+
+#define HASHTBL__DEFINE_ALT_EXPAND(...) \
+    HASHTBL__DEFINE_ALT_SELECT(__VA_ARGS__)
+
+#define HASHTBL__DEFINE_ALT_SELECT(TblTypeName, function_prefix, key_hash_call, key_own, key_free_func, value_dup_func, migrate_steps, selector, AltType, alt_hash_func, alt_equal_func, alt_dup_func) \
+    selector(TblTypeName, function_prefix, key_hash_call, key_own, key_free_func, value_dup_func, migrate_steps, AltType, alt_hash_func, alt_equal_func, alt_dup_func)
+
+#define HASHTBL__NO_ALT(TblTypeName, function_prefix, key_hash_call, key_own, key_free_func, value_dup_func, migrate_steps, AltType, alt_hash_func, alt_equal_func, alt_dup_func)
+
+#define HASHTBL__ALT(TblTypeName, function_prefix, key_hash_call, key_own, key_free_func, value_dup_func, migrate_steps, AltType, alt_hash_func, alt_equal_func, alt_dup_func) \
+    typedef AltType TblTypeName##_AltKey; \
+    \
+    static inline unsigned \
+    function_prefix##_hash_alt(TblTypeName *tbl, TblTypeName##_AltKey key) \
+    { \
+        return key_hash_call(alt_hash_func, key, tbl->hash_seed); \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_alt_with_hash(TblTypeName *tbl, unsigned hash, TblTypeName##_AltKey key) \
+    { \
+        if (migrate_steps) \
+            function_prefix##_rehash_step(tbl, migrate_steps); \
+        \
+        if (!tbl->hashtbl) { \
+            /* XXX: degenerate case where we could not allocate the hashes */ \
+            for (unsigned i = 0; i < tbl->item_storage_used; ++i) { \
+                if (tbl->item_storage[i].next != (unsigned)-2 \
+                    && tbl->item_storage[i].hash == hash \
+                    && alt_equal_func(key_own(VIEW, ~, tbl->item_storage[i].key, ~), key)) { \
+                        return &tbl->item_storage[i]; \
+                } \
+            } \
+            return NULL; \
+        } \
+        \
+        unsigned *bucket = &tbl->hashtbl[function_prefix##_internal_index_for_hash(tbl, hash)]; \
+        for (int pass = 0; pass < 2 && bucket; ++pass) { \
+            unsigned item_i = *bucket; \
+            while (item_i != (unsigned)-1) { \
+                if (tbl->item_storage[item_i].hash == hash && alt_equal_func(key_own(VIEW, ~, tbl->item_storage[item_i].key, ~), key)) \
+                    return &tbl->item_storage[item_i]; \
+                \
+                item_i = tbl->item_storage[item_i].next; \
+            } \
+            \
+            /* second pass: the item might still be in the old buckets */ \
+            bucket = function_prefix##_internal_old_bucket_for_hash(tbl, hash); \
+        } \
+        \
+        return NULL; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_alt(TblTypeName *tbl, TblTypeName##_AltKey key) \
+    { \
+        return function_prefix##_lookup_alt_with_hash(tbl, function_prefix##_hash_alt(tbl, key), key); \
+    } \
+    \
+    static inline int \
+    function_prefix##_contains_alt(TblTypeName *tbl, TblTypeName##_AltKey key) \
+    { \
+        return function_prefix##_lookup_alt(tbl, key) != NULL; \
+    } \
+    \
+    static inline TblTypeName##_Item * \
+    function_prefix##_lookup_or_insert_alt(TblTypeName *tbl, TblTypeName##_AltKey key, TblTypeName##_ConstValue value, int *inserted) \
+    { \
+        if (inserted) \
+            *inserted = 0; \
+        \
+        unsigned hash = function_prefix##_hash_alt(tbl, key); \
+        TblTypeName##_Item *item = function_prefix##_lookup_alt_with_hash(tbl, hash, key); \
+        if (item) \
+            return item; \
+        \
+        unsigned item_i = function_prefix##_internal_alloc_item(tbl); \
+        if (item_i == (unsigned)-1) \
+            return NULL; \
+        \
+        /* only now the key is materialized */ \
+        TblTypeName##_Key new_key = alt_dup_func(key); \
+        tbl->item_storage[item_i].hash = hash; \
+        tbl->item_storage[item_i].key = key_own(MOVE, ~, new_key, &tbl->key_arena); \
+        key_own(DROP, key_free_func, new_key, ~); \
+        tbl->item_storage[item_i].value = value_dup_func(value); \
+        function_prefix##_internal_hookup_item(tbl, item_i); \
+        if (inserted) \
+            *inserted = 1; \
+        return &tbl->item_storage[item_i]; \
+    } \
+    \
+
 static const unsigned _hashtbl_size_map[] = {
     53,
     97,
@@ -537,3 +1698,63 @@ static const unsigned _hashtbl_size_map[] = {
     805306457,
     1610612741
 };
+
+#define HASHTBL__SIZE_STEPS (sizeof(_hashtbl_size_map)/sizeof(_hashtbl_size_map[0]))
+
+static inline unsigned
+_hashtbl_prime_bucket_count(unsigned size_idx)
+{
+    return _hashtbl_size_map[size_idx];
+}
+
+static inline unsigned
+_hashtbl_prime_index_for_hash(unsigned hash, unsigned size_idx)
+{
+    return (hash * 11) % _hashtbl_size_map[size_idx];
+}
+
+/* same number of steps as the prime ladder: 64 ... 2^31 buckets */
+static inline unsigned
+_hashtbl_pow2_bucket_count(unsigned size_idx)
+{
+    return 64u << size_idx;
+}
+
+static inline unsigned
+_hashtbl_pow2_index_for_hash(unsigned hash, unsigned size_idx)
+{
+    return ((hash * 2654435769u) & 0xffffffffu) >> (26 - size_idx);
+}
+
+/* the user supplied hash is not necessarily well distributed in all bits,
+ * open addressing tables mix it before taking their low bits */
+static inline unsigned
+_hashtbl_mix(unsigned hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+/* a fresh random seed for tables with seeded keys */
+static inline uint64_t
+_hashtbl_random_seed(const void *salt)
+{
+    uint64_t seed = 0;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    arc4random_buf(&seed, sizeof(seed));
+    return seed;
+#else
+#   if defined(__linux__)
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == (ssize_t)sizeof(seed))
+        return seed;
+#   endif
+    /* not unpredictable, but at least different between tables and runs */
+    seed = (uint64_t)(uintptr_t)salt ^ ((uint64_t)time(NULL) << 20) ^ (uint64_t)clock();
+    seed += 0x9e3779b97f4a7c15ull;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+    return seed ^ (seed >> 31);
+#endif
+}
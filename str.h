@@ -24,6 +24,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -934,3 +935,209 @@ str_hash(const char *str)
     }
     return h;
 }
+
+static inline uint64_t
+_str_hash_read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+_str_hash_read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// full 64x64 -> 128 bit multiplication, low half in *a, high half in *b
+static inline void
+_str_hash_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+_str_hash_mix(uint64_t a, uint64_t b)
+{
+    _str_hash_mum(&a, &b);
+    return a ^ b;
+}
+
+// 64 bit hash of len bytes (wyhash style, 16 bytes per step), s may be NULL if len == 0
+static inline uint64_t
+str_hash64_buf(const char *s, int len)
+{
+    static const uint64_t p0 = 0xa0761d6478bd642full;
+    static const uint64_t p1 = 0xe7037ed1a0b428dbull;
+
+    const unsigned char *p = (const unsigned char *)s;
+    size_t n = len > 0 ? (size_t)len : 0;
+
+    uint64_t seed = _str_hash_mix(p0, p1);
+    uint64_t a, b;
+    if (n <= 16) {
+        if (n >= 4) {
+            size_t mid = (n >> 3) << 2;
+            a = (_str_hash_read32(p) << 32) | _str_hash_read32(p + mid);
+            b = (_str_hash_read32(p + n - 4) << 32) | _str_hash_read32(p + n - 4 - mid);
+        } else if (n > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[n >> 1] << 8) | p[n - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = n;
+        while (i > 16) {
+            seed = _str_hash_mix(_str_hash_read64(p) ^ p1, _str_hash_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        // the last 16 bytes, which may overlap with the previous step
+        a = _str_hash_read64(p + i - 16);
+        b = _str_hash_read64(p + i - 8);
+    }
+
+    a ^= p1;
+    b ^= seed;
+    _str_hash_mum(&a, &b);
+    return _str_hash_mix(a ^ p0 ^ n, b ^ p1);
+}
+
+static inline uint32_t
+str_hash32_buf(const char *s, int len)
+{
+    uint64_t h = str_hash64_buf(s, len);
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// like str_hash(), but much faster for longer strings and all bits are well mixed
+static inline unsigned
+str_hash_buf(const char *s, int len)
+{
+    return str_hash32_buf(s, len);
+}
+
+static inline uint64_t
+_str_hash_rotl64(uint64_t x, int b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline void
+_str_sipround(uint64_t v[4])
+{
+    v[0] += v[1]; v[1] = _str_hash_rotl64(v[1], 13); v[1] ^= v[0]; v[0] = _str_hash_rotl64(v[0], 32);
+    v[2] += v[3]; v[3] = _str_hash_rotl64(v[3], 16); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = _str_hash_rotl64(v[3], 21); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = _str_hash_rotl64(v[1], 17); v[1] ^= v[2]; v[2] = _str_hash_rotl64(v[2], 32);
+}
+
+// SipHash-1-3 of len bytes with the 128 bit key (k0, k1), s may be NULL if len == 0
+static inline uint64_t
+str_siphash13_buf(const char *s, int len, uint64_t k0, uint64_t k1)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    size_t n = len > 0 ? (size_t)len : 0;
+
+    uint64_t v[4] = {
+        0x736f6d6570736575ull ^ k0,
+        0x646f72616e646f6dull ^ k1,
+        0x6c7967656e657261ull ^ k0,
+        0x7465646279746573ull ^ k1,
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t m = 0;
+        for (int j = 0; j < 8; ++j)
+            m |= (uint64_t)p[i + (size_t)j] << (8 * j); // little endian, compiles to a single load there
+        v[3] ^= m;
+        _str_sipround(v);
+        v[0] ^= m;
+    }
+
+    uint64_t b = (uint64_t)n << 56;
+    for (int j = 0; i + (size_t)j < n; ++j)
+        b |= (uint64_t)p[i + (size_t)j] << (8 * j);
+    v[3] ^= b;
+    _str_sipround(v);
+    v[0] ^= b;
+
+    v[2] ^= 0xff;
+    _str_sipround(v);
+    _str_sipround(v);
+    _str_sipround(v);
+
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+// keyed hash for HASHTBL_KEY_SEEDED, NULL is treated like an empty string
+static inline unsigned
+str_hash_seeded(const char *str, uint64_t seed)
+{
+    uint64_t h = str_siphash13_buf(str, str_length(str), seed, seed ^ 0x9e3779b97f4a7c15ull);
+    return (unsigned)(h ^ (h >> 32));
+}
+
+// a (pointer, length) view of a string inside a larger buffer, not NUL-terminated
+typedef struct {
+    const char *data;
+    int len;
+} StrSlice;
+
+static inline StrSlice
+str_slice(const char *data, int len)
+{
+    StrSlice s;
+    s.data = data;
+    s.len = len;
+    return s;
+}
+
+// same value as str_hash() of the slice contents, to look up keys hashed with str_hash()
+static inline unsigned
+str_slice_hash(StrSlice s)
+{
+    unsigned h = 3323198485u;
+    for (int i = 0; i < s.len; ++i) {
+        h ^= (unsigned char)s.data[i];
+        h *= 0x5bd1e995;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+static inline bool
+str_slice_equal(const char *str, StrSlice s)
+{
+    str = str ? str : "";
+
+    for (int i = 0; i < s.len; ++i)
+        if (!str[i] || str[i] != s.data[i])
+            return false;
+
+    return !str[s.len];
+}
+
+static inline char *
+str_slice_dup(StrSlice s)
+{
+    return str_dup_buf(s.data, s.len);
+}
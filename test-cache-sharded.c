@@ -0,0 +1,255 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "cache-sharded.h"
+
+#include "str.h"
+#include "str-list.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+CACHE_DEFINE_SHARDED(IntCache, int_cache,
+                     HASHTBL_KEY(int, int_hash, int_equal),
+                     HASHTBL_VALUE(int),
+                     0)
+
+CACHE_DEFINE_SHARDED(WordCache, word_cache,
+                     HASHTBL_KEY_SEEDED_FULL(char *, const char *, str_dup, free, str_hash_seeded, str_equal),
+                     HASHTBL_VALUE(int),
+                     4)
+
+CACHE_DEFINE_SHARDED(StrWordCache, str_word_cache,
+                     HASHTBL_KEY_STR(str_hash),
+                     HASHTBL_VALUE_FULL(char *, const char *, str_dup, free),
+                     2)
+
+CACHE_DEFINE_LRU(LruWordCache, lru_word_cache,
+                 HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                 HASHTBL_VALUE(int))
+
+#define NUM_THREADS 4
+
+static void
+record_eviction(int key, int *value, void *ctx)
+{
+    int *evicted = (int *)ctx;
+    assert(*value == key * 10);
+    evicted[key]++;
+}
+
+static void
+test_s3fifo(void)
+{
+    int evicted[200] = {0};
+
+    IntCache c;
+    assert(int_cache_init(&c, 10));
+    int_cache_set_evict_func(&c, record_eviction, evicted);
+
+    for (int i = 1; i <= 10; ++i)
+        assert(int_cache_put(&c, i, i * 10));
+    assert(int_cache_size(&c) == 10);
+
+    int value = 0;
+    assert(int_cache_get(&c, 1, &value) && value == 10);
+    assert(!int_cache_get(&c, 11, NULL));
+
+    // 1 was hit and moves on to the main queue, 2 is evicted
+    assert(int_cache_put(&c, 11, 110));
+    assert(evicted[1] == 0 && evicted[2] == 1);
+    assert(int_cache_contains(&c, 1) && !int_cache_contains(&c, 2));
+    assert(c.shards[0].main.count == 1);
+
+    // a scan of keys which are never hit again leaves the main queue alone
+    for (int i = 100; i < 200; ++i)
+        assert(int_cache_put(&c, i, i * 10));
+    assert(int_cache_contains(&c, 1));
+    assert(int_cache_size(&c) == 10);
+
+    // a recently evicted key is remembered and goes straight to the main queue
+    assert(int_cache_put(&c, 190, 1900));
+    assert(c.shards[0].main.count == 2);
+
+    CacheCounters counters = int_cache_counters(&c);
+    assert(counters.hits == 1 && counters.misses == 1);
+    assert(counters.evictions == 1 + 100 + 1);
+    int_cache_reset_counters(&c);
+    assert(int_cache_counters(&c).evictions == 0);
+
+    // removed entries are gone right away, and neither evicted nor counted later
+    assert(int_cache_remove(&c, 1));
+    assert(!int_cache_remove(&c, 1));
+    assert(!int_cache_contains(&c, 1));
+    assert(int_cache_size(&c) == 9);
+    assert(int_cache_check_internal_sanity(&c));
+
+    assert(int_cache_put(&c, 1, 10));
+    assert(int_cache_get(&c, 1, &value) && value == 10);
+    assert(int_cache_remove(&c, 1));
+    for (int i = 120; i < 140; ++i)
+        assert(int_cache_put(&c, i, i * 10));
+    assert(evicted[1] == 0);
+    assert(int_cache_check_internal_sanity(&c));
+
+    int_cache_clear(&c);
+}
+
+static StrList
+load_words(void)
+{
+    StrList words = NULL;
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+        str_list_add(&words, buf);
+    }
+
+    free(buf);
+    fclose(f);
+
+    return words;
+}
+
+static void
+test_hit_ratio(StrList words)
+{
+    size_t nwords = str_list_length(words);
+
+    WordCache s3;
+    LruWordCache lru;
+    assert(word_cache_init(&s3, 4096));
+    lru_word_cache_init(&lru, 4096);
+
+    // every fourth access is part of a scan over words which are never seen again
+    for (size_t i = 0; i < nwords; ++i) {
+        const char *word = words[i];
+        char scan[32];
+        if (i % 4 == 3) {
+            snprintf(scan, sizeof(scan), "#scan%zu", i);
+            word = scan;
+        }
+
+        if (!word_cache_get(&s3, word, NULL))
+            assert(word_cache_put(&s3, word, (int)strlen(word)));
+        if (!lru_word_cache_get(&lru, word))
+            assert(lru_word_cache_put(&lru, word, (int)strlen(word), 1));
+    }
+
+    double s3_ratio = cache_counters_hit_ratio(word_cache_counters(&s3));
+    double lru_ratio = cache_counters_hit_ratio(lru_word_cache_counters(&lru));
+    printf("hit ratio with scans: S3-FIFO %.3f, LRU %.3f\n", s3_ratio, lru_ratio);
+    assert(s3_ratio > lru_ratio);
+    assert(word_cache_size(&s3) <= 4096);
+    assert(word_cache_check_internal_sanity(&s3));
+
+    lru_word_cache_clear(&lru);
+    word_cache_clear(&s3);
+}
+
+typedef struct {
+    WordCache *cache;
+    StrList words;
+    unsigned offset;
+} WorkerArgs;
+
+static void *
+cache_worker(void *arg)
+{
+    WorkerArgs *args = (WorkerArgs *)arg;
+    size_t nwords = str_list_length(args->words);
+
+    for (size_t i = 0; i < nwords; ++i) {
+        const char *word = args->words[(i + args->offset) % nwords];
+        int value = 0;
+        if (word_cache_get(args->cache, word, &value)) {
+            assert(value == (int)strlen(word));
+        } else {
+            int ok = word_cache_put(args->cache, word, (int)strlen(word));
+            assert(ok);
+            (void)ok;
+        }
+        if (i % 1000 == 0)
+            word_cache_remove(args->cache, word);
+    }
+
+    return NULL;
+}
+
+static void
+test_threads(StrList words)
+{
+    WordCache c;
+    assert(word_cache_init(&c, 2000));
+
+    pthread_t threads[NUM_THREADS];
+    WorkerArgs args[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        args[t].cache = &c;
+        args[t].words = words;
+        args[t].offset = (unsigned)t * 1000;
+        int r = pthread_create(&threads[t], NULL, cache_worker, &args[t]);
+        assert(r == 0);
+        (void)r;
+    }
+    for (int t = 0; t < NUM_THREADS; ++t)
+        pthread_join(threads[t], NULL);
+
+    CacheCounters counters = word_cache_counters(&c);
+    assert(counters.hits + counters.misses == NUM_THREADS * str_list_length(words));
+    assert(word_cache_size(&c) <= 2000);
+    assert(word_cache_check_internal_sanity(&c));
+    printf("threads: hit ratio %.3f, %u cached\n", cache_counters_hit_ratio(counters), word_cache_size(&c));
+
+    word_cache_clear(&c);
+}
+
+static void
+test_str_keys(StrList words)
+{
+    StrWordCache c;
+    assert(str_word_cache_init(&c, 500));
+
+    for (size_t i = 0; i < 100000; ++i) {
+        char *value = NULL;
+        if (str_word_cache_get(&c, words[i], &value))
+            assert(!strcmp(value, words[i]));
+        else
+            assert(str_word_cache_put(&c, words[i], words[i]));
+    }
+
+    assert(str_word_cache_size(&c) <= 500);
+    assert(str_word_cache_check_internal_sanity(&c));
+
+    str_word_cache_clear(&c);
+}
+
+int main(void)
+{
+    test_s3fifo();
+
+    StrList words = load_words();
+
+    test_hit_ratio(words);
+    test_threads(words);
+    test_str_keys(words);
+
+    str_list_clear(&words);
+}
@@ -0,0 +1,180 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "cache.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+CACHE_DEFINE_LRU(IntCache, int_cache,
+                 HASHTBL_KEY(int, int_hash, int_equal),
+                 HASHTBL_VALUE(int))
+
+CACHE_DEFINE_LRU(WordCache, word_cache,
+                 HASHTBL_KEY_SEEDED_FULL(char *, const char *, str_dup, free, str_hash_seeded, str_equal),
+                 HASHTBL_VALUE_FULL(char *, const char *, str_dup, free))
+
+static void
+record_eviction(int key, int *value, void *ctx)
+{
+    int *evicted = (int *)ctx;
+    assert(*value == key * 10);
+    evicted[key]++;
+}
+
+static void
+test_lru_order(void)
+{
+    int evicted[100] = {0};
+
+    IntCache c;
+    int_cache_init(&c, 3);
+    int_cache_set_evict_func(&c, record_eviction, evicted);
+
+    assert(int_cache_put(&c, 1, 10, 1));
+    assert(int_cache_put(&c, 2, 20, 1));
+    assert(int_cache_put(&c, 3, 30, 1));
+    assert(int_cache_size(&c) == 3);
+
+    // 1 becomes the most recently used, so 2 goes first
+    assert(*int_cache_get(&c, 1) == 10);
+    assert(int_cache_put(&c, 4, 40, 1));
+    assert(evicted[2] == 1);
+    assert(!int_cache_contains(&c, 2));
+
+    // peek does not promote, so 3 goes next
+    assert(*int_cache_peek(&c, 3) == 30);
+    assert(int_cache_put(&c, 5, 50, 1));
+    assert(evicted[3] == 1);
+    assert(int_cache_get(&c, 3) == NULL);
+
+    IntCache_Entry *e = int_cache_list_first(&c.lru);
+    assert(e->key == 5);
+    e = int_cache_list_next(&c.lru, e);
+    assert(e->key == 4);
+    e = int_cache_list_next(&c.lru, e);
+    assert(e->key == 1);
+
+    CacheCounters counters = int_cache_counters(&c);
+    assert(counters.hits == 1 && counters.misses == 1 && counters.evictions == 2);
+    assert(cache_counters_hit_ratio(counters) == 0.5);
+    int_cache_reset_counters(&c);
+    assert(int_cache_counters(&c).hits == 0);
+
+    // replacing a value changes its cost and promotes it
+    assert(int_cache_put(&c, 1, 10, 2));
+    assert(int_cache_size(&c) == 2 && int_cache_cost(&c) == 3);
+    assert(evicted[4] == 1);
+
+    // too expensive entries are not cached and drop the old value
+    assert(!int_cache_put(&c, 1, 10, 4));
+    assert(!int_cache_contains(&c, 1));
+    assert(evicted[1] == 0);
+
+    // removing does not count as eviction
+    assert(int_cache_remove(&c, 5) == 1);
+    assert(int_cache_remove(&c, 5) == 0);
+    assert(evicted[5] == 0);
+    assert(int_cache_size(&c) == 0 && int_cache_cost(&c) == 0);
+
+    for (int i = 0; i < 100; ++i)
+        assert(int_cache_put(&c, i, i * 10, 1));
+    assert(int_cache_size(&c) == 3);
+    int_cache_set_capacity(&c, 1);
+    assert(int_cache_size(&c) == 1 && int_cache_contains(&c, 99));
+    assert(int_cache_check_internal_sanity(&c));
+
+    int_cache_clear(&c);
+    assert(int_cache_size(&c) == 0 && int_cache_capacity(&c) == 1);
+    assert(int_cache_put(&c, 1, 10, 1));
+    assert(int_cache_check_internal_sanity(&c));
+    int_cache_clear(&c);
+}
+
+static void
+test_no_allocation_when_full(void)
+{
+    IntCache c;
+    int_cache_init(&c, 1000);
+
+    for (int i = 0; i < 1000; ++i)
+        assert(int_cache_put(&c, i, i * 10, 1));
+
+    unsigned entries = c.entries_allocated;
+    unsigned slabs = c.slab_count;
+    unsigned items = c.table.item_storage_allocated;
+
+    // a sliding window over the keys: every put evicts the oldest one
+    for (int i = 1000; i < 100000; ++i) {
+        assert(int_cache_get(&c, i - 500) != NULL);
+        assert(int_cache_put(&c, i, i * 10, 1));
+        assert(!int_cache_contains(&c, i - 1000));
+    }
+
+    assert(c.entries_allocated == entries && c.slab_count == slabs);
+    assert(c.table.item_storage_allocated == items);
+    assert(int_cache_counters(&c).evictions == 99000);
+    assert(int_cache_check_internal_sanity(&c));
+
+    int_cache_clear(&c);
+}
+
+static void
+test_words(void)
+{
+    WordCache c;
+    word_cache_init(&c, 64 * 1024);
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    unsigned lines = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        char **cached = word_cache_get(&c, buf);
+        if (cached) {
+            assert(!strcmp(*cached, buf));
+        } else {
+            assert(word_cache_put(&c, buf, buf, strlen(buf) + 1));
+        }
+
+        if (++lines % 100000 == 0)
+            assert(word_cache_check_internal_sanity(&c));
+    }
+
+    free(buf);
+    fclose(f);
+
+    CacheCounters counters = word_cache_counters(&c);
+    assert(counters.hits + counters.misses == lines);
+    assert(word_cache_cost(&c) <= 64 * 1024);
+    printf("words: %u, hit ratio %.3f, %u cached\n", lines, cache_counters_hit_ratio(counters), word_cache_size(&c));
+
+    word_cache_clear(&c);
+}
+
+int main(void)
+{
+    test_lru_order();
+
+    test_no_allocation_when_full();
+
+    test_words();
+}
@@ -9,6 +9,41 @@
 
 HASHTBL_DEFINE(ConstStrDictionary, const_str_dictionary, const char *, const char *, str_hash, str_equal)
 HASHTBL_DEFINE_2(WordCountDic, word_count_dic, char *, const char *, str_dup, free, int, int, /*nop*/, (void), str_hash, str_equal);
+HASHTBL_DEFINE_4(Pow2Dic, pow2_dic, char *, const char *, str_dup, free, int, int, /*nop*/, (void), str_hash, str_equal, realloc, free, HASHTBL_SIZING_POW2);
+
+static void
+test_pow2_sizing(void)
+{
+    Pow2Dic dic = pow2_dic_create();
+
+    for (int i = 0; i < 100000; ++i) {
+        char *key = str_printf("key %d", i);
+        pow2_dic_set(&dic, key, i);
+        free(key);
+    }
+
+    assert(pow2_dic_check_internal_sanity(dic));
+    assert(_hashtbl_pow2_bucket_count(dic->table_size) == 262144);
+
+    // removing shrinks the table again
+    for (int i = 0; i < 100000; i += 2) {
+        char *key = str_printf("key %d", i);
+        pow2_dic_remove(&dic, key);
+        free(key);
+    }
+
+    for (int i = 0; i < 100000; ++i) {
+        char *key = str_printf("key %d", i);
+        Pow2Dic_Item *item = pow2_dic_lookup(dic, key);
+        assert(i % 2 ? item && item->value == i : !item);
+        free(key);
+    }
+
+    assert(dic->element_count == 50000);
+    assert(pow2_dic_check_internal_sanity(dic));
+
+    pow2_dic_free(dic);
+}
 
 static void
 test_wordcount(void)
@@ -45,17 +80,18 @@ test_wordcount(void)
     printf("element count: %zu\n", dic->element_count);
     printf("table size %zu: %zu\n", dic->table_size, _hashtbl_size_map[dic->table_size]);
 
-    // count collisions
-    size_t collcount = 0;
-    for (size_t i = 0; i < _hashtbl_size_map[dic->table_size]; ++i) {
-        WordCountDic_Item *item = dic->items[i];
-        while (item && item->next) {
-            collcount++;
-            item = item->next;
-        }
-    }
+    HashtblStats stats;
+    word_count_dic_stats(dic, &stats);
+    assert(stats.element_count == dic->element_count);
+    assert(stats.bucket_count == _hashtbl_size_map[dic->table_size]);
+    assert(stats.freelist_length == 0);
 
-    printf("collision count: %zu\n", collcount);
+    // every element but the first one in each bucket collides
+    unsigned collcount = stats.element_count - (stats.bucket_count - stats.empty_buckets);
+
+    printf("collision count: %u\n", collcount);
+    printf("load factor: %.2f, empty buckets: %.2f, longest chain: %u\n",
+           stats.load_factor, stats.empty_bucket_ratio, stats.longest_chain);
 
     assert(word_count_dic_check_internal_sanity(dic));
 
@@ -79,5 +115,7 @@ int main(void)
 
     const_str_dictionary_free(dic);
 
+    test_pow2_sizing();
+
     test_wordcount();
 }
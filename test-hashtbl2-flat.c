@@ -0,0 +1,170 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-flat.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+HASHTBL_DEFINE_FLAT(ConstStrDictionary, const_str_dictionary,
+                    HASHTBL_KEY(const char *, str_hash, str_equal),
+                    HASHTBL_VALUE(const char *))
+
+HASHTBL_DEFINE_FLAT(WordCountDic, word_count_dic,
+                    HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                    HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_FLAT(IntSet, int_set,
+                    HASHTBL_KEY(int, int_hash, int_equal),
+                    HASHTBL_VALUE(int))
+
+static void
+test_wordcount(void)
+{
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        int inserted;
+        WordCountDic_Item *item = word_count_dic_lookup_or_insert_zero(&dic, buf, &inserted);
+        assert(item && inserted == (item->value == 0));
+        assert(item->hash == word_count_dic_hash(&dic, buf));
+        item->value++;
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    // remove all words with low count
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+        if (item->value < 53) {
+            word_count_dic_iterator_delete(&it);
+        }
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    // print it
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+        if (item->value > 1) {
+            printf("%s: %d\n", item->key, item->value);
+        }
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    printf("element count: %u\n", dic.element_count);
+    printf("capacity: %u, deleted: %u\n", dic.capacity, dic.deleted_count);
+
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    word_count_dic_clear(&dic);
+}
+
+static void
+test_churn(void)
+{
+    IntSet s;
+    int_set_init_reserve(&s, 100);
+
+    // insert and remove overlapping ranges so that tombstones pile up
+    for (int round = 0; round < 50; ++round) {
+        for (int i = round * 100; i < round * 100 + 1000; ++i)
+            int_set_set(&s, i, -i);
+
+        for (int i = round * 100; i < round * 100 + 900; ++i)
+            int_set_remove(&s, i);
+
+        assert(int_set_check_internal_sanity(&s));
+    }
+
+    // only the tail of the last round survives
+    assert(int_set_size(&s) == 100);
+    for (int i = 0; i < 6000; ++i) {
+        IntSet_Item *item = int_set_lookup(&s, i);
+        if (i >= 5800 && i < 5900) {
+            assert(item && item->value == -i);
+        } else {
+            assert(!item);
+        }
+    }
+
+    int_set_clear(&s);
+
+    // the same just below the maximum load, where every new slot would
+    // push the table over it: tombstones must not force a rebuild each time
+    int_set_init_reserve(&s, 1024 - 1024/8);
+    assert(s.capacity == 1024);
+    for (int i = 0; i < 1024 - 1024/8 - 1; ++i)
+        int_set_set(&s, i, -i);
+
+    unsigned rebuilds = 0;
+    unsigned char *ctrl = s.ctrl;
+    for (int i = 0; i < 20000; ++i) {
+        int_set_remove(&s, i);
+        int_set_set(&s, i + 1024 - 1024/8 - 1, -i);
+        if (s.ctrl != ctrl) {
+            ctrl = s.ctrl;
+            rebuilds++;
+        }
+    }
+    assert(rebuilds < 50);
+    assert(int_set_size(&s) == 1024 - 1024/8 - 1);
+    assert(int_set_check_internal_sanity(&s));
+
+    int_set_clear(&s);
+}
+
+int main(void)
+{
+    ConstStrDictionary dic;
+    const_str_dictionary_init(&dic);
+
+    const_str_dictionary_set(&dic, "Hello", "World");
+
+    ConstStrDictionary_Item *item = const_str_dictionary_lookup(&dic, "Hello");
+    assert(!strcmp(item->value, "World"));
+
+    const_str_dictionary_set(&dic, "Hello", "Hohoho");
+    item = const_str_dictionary_lookup(&dic, "Hello");
+    assert(!strcmp(item->value, "Hohoho"));
+
+    assert(!const_str_dictionary_lookup(&dic, "World"));
+    const_str_dictionary_remove(&dic, "Hello");
+    assert(!const_str_dictionary_contains(&dic, "Hello"));
+
+    assert(const_str_dictionary_check_internal_sanity(&dic));
+
+    const_str_dictionary_clear(&dic);
+
+    test_churn();
+
+    test_wordcount();
+}
@@ -0,0 +1,227 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-frozen.h"
+
+#include "str.h"
+#include "str-list.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+HASHTBL_DEFINE(WordCountDic, word_count_dic,
+               HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+               HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_FROZEN(FrozenWordCount, frozen_word_count, int)
+HASHTBL_DEFINE_FROZEN_FROM_TABLE(FrozenWordCount, frozen_word_count, WordCountDic, word_count_dic)
+
+typedef struct {
+    double weight;
+    short flags;
+} Attributes;
+
+HASHTBL_DEFINE_FROZEN(FrozenAttributes, frozen_attributes, Attributes)
+
+static void
+check_word_count(const FrozenWordCount *fw, WordCountDic *dic)
+{
+    assert(frozen_word_count_size(fw) == word_count_dic_size(dic));
+
+    // every key has its own index
+    unsigned char *seen = (unsigned char *)calloc(frozen_word_count_size(fw), 1);
+
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+
+        unsigned index = frozen_word_count_index(fw, item->key);
+        assert(index < frozen_word_count_size(fw));
+        assert(!seen[index]);
+        seen[index] = 1;
+        assert(str_equal(frozen_word_count_key_at(fw, index), item->key));
+
+        const int *value = frozen_word_count_lookup(fw, item->key);
+        assert(value && *value == item->value);
+
+        // and misses are detected
+        char *miss = str_printf("%s#", item->key);
+        assert(!frozen_word_count_contains(fw, miss));
+        assert(!frozen_word_count_lookup_buf(fw, miss, str_length(miss) - 1) == !value);
+        free(miss);
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    free(seen);
+}
+
+static void
+test_wordcount(void)
+{
+    StrList words = NULL;
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+        str_list_add(&words, buf);
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+    for (size_t i = 0; words[i]; ++i) {
+        WordCountDic_Item *item = word_count_dic_lookup(&dic, words[i]);
+        if (item) {
+            item->value++;
+        } else {
+            word_count_dic_set(&dic, words[i], 1);
+        }
+    }
+
+    FrozenWordCount fw;
+    assert(frozen_word_count_build_from_table(&fw, &dic));
+    check_word_count(&fw, &dic);
+
+    size_t index_bytes = (size_t)fw.frozen.header->bucket_count * sizeof(uint16_t)
+                       + (fw.frozen.header->slot_count - fw.frozen.header->key_count) * sizeof(uint32_t);
+    printf("element count: %u, index bits per key: %.2f\n", frozen_word_count_size(&fw),
+           (double)index_bytes * 8 / frozen_word_count_size(&fw));
+
+    // through a file
+    char path[] = "/tmp/test-hashtbl2-frozen-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(frozen_word_count_save(&fw, fd));
+    close(fd);
+    frozen_word_count_clear(&fw);
+
+    assert(frozen_word_count_map(&fw, path));
+    check_word_count(&fw, &dic);
+    frozen_word_count_clear(&fw);
+
+    FrozenAttributes wrong;
+    assert(!frozen_attributes_map(&wrong, path));
+    unlink(path);
+
+    // a StrList with duplicates gives the same key set
+    assert(frozen_word_count_build_from_str_list(&fw, words));
+    assert(frozen_word_count_size(&fw) == word_count_dic_size(&dic));
+    for (size_t i = 0; words[i]; ++i) {
+        const int *value = frozen_word_count_lookup(&fw, words[i]);
+        assert(value && *value == 0);
+    }
+    frozen_word_count_clear(&fw);
+
+    word_count_dic_clear(&dic);
+    str_list_clear(&words);
+}
+
+static void
+patch(const char *path, size_t offset, const void *data, size_t len)
+{
+    int fd = open(path, O_WRONLY);
+    assert(fd >= 0);
+    assert(pwrite(fd, data, len, (off_t)offset) == (ssize_t)len);
+    close(fd);
+}
+
+static void
+save_to(const FrozenWordCount *fw, const char *path)
+{
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    assert(fd >= 0);
+    assert(frozen_word_count_save(fw, fd));
+    close(fd);
+}
+
+static void
+test_corrupt(void)
+{
+    const char *keys[1000];
+    for (unsigned i = 0; i < 1000; ++i)
+        keys[i] = str_printf("key %u", i);
+
+    FrozenWordCount fw;
+    assert(frozen_word_count_build(&fw, keys, NULL, 1000));
+    const HashtblFrozen *f = &fw.frozen;
+    assert(f->header->slot_count > f->header->key_count);
+    size_t remap_offset = (size_t)((const char *)f->remap - (const char *)f->base);
+    size_t key_offsets_offset = (size_t)((const char *)f->key_offsets - (const char *)f->base);
+    size_t strings_end = (size_t)(f->strings - (const char *)f->base) + f->header->strings_size;
+
+    char path[] = "/tmp/test-hashtbl2-frozen-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    FrozenWordCount mapped;
+
+    // a spare slot redirected past the keys
+    save_to(&fw, path);
+    uint32_t bad = 1000;
+    patch(path, remap_offset, &bad, sizeof(bad));
+    assert(!frozen_word_count_map(&mapped, path) && errno == EINVAL);
+
+    // key offsets out of order
+    save_to(&fw, path);
+    bad = 0;
+    patch(path, key_offsets_offset + 10 * sizeof(uint32_t), &bad, sizeof(bad));
+    assert(!frozen_word_count_map(&mapped, path) && errno == EINVAL);
+
+    // a key offset past the strings
+    save_to(&fw, path);
+    bad = 0xfffffff0u;
+    patch(path, key_offsets_offset + 10 * sizeof(uint32_t), &bad, sizeof(bad));
+    assert(!frozen_word_count_map(&mapped, path) && errno == EINVAL);
+
+    // a key which isn't NUL-terminated
+    save_to(&fw, path);
+    patch(path, strings_end - 1, "x", 1);
+    assert(!frozen_word_count_map(&mapped, path) && errno == EINVAL);
+
+    save_to(&fw, path);
+    assert(frozen_word_count_map(&mapped, path));
+    assert(frozen_word_count_contains(&mapped, "key 42"));
+    frozen_word_count_clear(&mapped);
+
+    unlink(path);
+    frozen_word_count_clear(&fw);
+    for (unsigned i = 0; i < 1000; ++i)
+        free((char *)keys[i]);
+}
+
+int main(void)
+{
+    const char *keys[] = { "red", "green", "blue", "", "green" };
+    Attributes values[] = { { 1.0, 1 }, { 2.0, 2 }, { 3.0, 3 }, { 4.0, 4 }, { 5.0, 5 } };
+
+    FrozenAttributes fa;
+    assert(frozen_attributes_build(&fa, keys, values, 5));
+    assert(frozen_attributes_size(&fa) == 4);
+    assert(frozen_attributes_lookup(&fa, "red")->flags == 1);
+    assert(frozen_attributes_lookup(&fa, "green")->weight == 2.0);
+    assert(frozen_attributes_lookup(&fa, "blue")->flags == 3);
+    assert(frozen_attributes_lookup(&fa, "")->flags == 4);
+    assert(frozen_attributes_lookup_buf(&fa, "blueberry", 4)->flags == 3);
+    assert(!frozen_attributes_contains(&fa, "yellow"));
+    assert(!frozen_attributes_contains(&fa, "blu"));
+    frozen_attributes_clear(&fa);
+
+    assert(frozen_attributes_build(&fa, NULL, NULL, 0));
+    assert(frozen_attributes_size(&fa) == 0);
+    assert(!frozen_attributes_contains(&fa, ""));
+    frozen_attributes_clear(&fa);
+
+    test_wordcount();
+
+    test_corrupt();
+}
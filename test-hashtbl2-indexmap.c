@@ -0,0 +1,158 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-indexmap.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+HASHTBL_DEFINE_INDEXMAP(WordCountDic, word_count_dic,
+                        HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                        HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_INDEXMAP(IntMap, int_map,
+                        HASHTBL_KEY(int, int_hash, int_equal),
+                        HASHTBL_VALUE(int))
+
+static void
+test_wordcount(void)
+{
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    unsigned new_words = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        int inserted;
+        WordCountDic_Item *item = word_count_dic_lookup_or_insert_zero(&dic, buf, &inserted);
+        item->value++;
+
+        // new words are appended
+        if (inserted)
+            assert(item == word_count_dic_item_at(&dic, new_words++));
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    assert(word_count_dic_size(&dic) == new_words);
+
+    // remove all words with low count
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+        if (item->value < 53) {
+            word_count_dic_iterator_delete(&it);
+        }
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    // the survivors are dense, and all of them are found again
+    for (unsigned i = 0; i < word_count_dic_size(&dic); ++i) {
+        WordCountDic_Item *item = word_count_dic_item_at(&dic, i);
+        assert(item->value >= 53);
+        assert(word_count_dic_index(&dic, item->key) == i);
+    }
+
+    printf("element count: %u\n", word_count_dic_size(&dic));
+
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    word_count_dic_clear(&dic);
+}
+
+static void
+test_order(void)
+{
+    IntMap m;
+    int_map_init(&m);
+
+    for (int i = 0; i < 10000; ++i)
+        int_map_set(&m, i * 7, i);
+
+    for (unsigned i = 0; i < 10000; ++i)
+        assert(int_map_item_at(&m, i)->key == (int)i * 7);
+
+    // removing the last item keeps everything else in place
+    int_map_remove(&m, 9999 * 7);
+    assert(int_map_size(&m) == 9999);
+    assert(int_map_item_at(&m, 9998)->key == 9998 * 7);
+
+    // swap-remove moves the last item into the gap
+    int_map_remove(&m, 0);
+    assert(int_map_item_at(&m, 0)->key == 9998 * 7);
+    int_map_remove_at(&m, 5);
+    assert(int_map_item_at(&m, 5)->key == 9997 * 7);
+    assert(int_map_lookup(&m, 9997 * 7)->value == 9997);
+    assert(!int_map_contains(&m, 5 * 7));
+    assert(int_map_size(&m) == 9997);
+    assert(int_map_check_internal_sanity(&m));
+
+    // heavy churn, then iteration only sees the live items
+    for (int round = 0; round < 20; ++round) {
+        for (int i = round; i < 10000; i += 3)
+            int_map_remove(&m, i * 7);
+        for (int i = round; i < 10000; i += 3)
+            int_map_set(&m, i * 7, i);
+        assert(int_map_check_internal_sanity(&m));
+    }
+
+    for (int i = 0; i < 10000; i += 2)
+        int_map_remove(&m, i * 7);
+
+    unsigned seen = 0;
+    IntMap_Iterator it;
+    int_map_iterator_init(&m, &it);
+    while (!int_map_iterator_at_end(&it)) {
+        IntMap_Item *item = int_map_iterator_item(&it);
+        assert(item->key % 2 && item->key == item->value * 7);
+        ++seen;
+        int_map_iterator_next(&it);
+    }
+    assert(seen == int_map_size(&m));
+    assert(seen == 5000);
+
+    // deleting everything while iterating visits every item once
+    seen = 0;
+    int_map_iterator_init(&m, &it);
+    while (!int_map_iterator_at_end(&it)) {
+        ++seen;
+        int_map_iterator_delete(&it);
+        int_map_iterator_next(&it);
+    }
+    assert(seen == 5000);
+    assert(int_map_size(&m) == 0);
+    assert(int_map_check_internal_sanity(&m));
+
+    int_map_clear(&m);
+}
+
+int main(void)
+{
+    test_wordcount();
+
+    test_order();
+}
@@ -0,0 +1,205 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-multimap.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+HASHTBL_DEFINE_MULTIMAP(WordLines, word_lines,
+                        HASHTBL_KEY_SEEDED_FULL(char *, const char *, str_dup, free, str_hash_seeded, str_equal),
+                        HASHTBL_VALUE(unsigned))
+
+HASHTBL_DEFINE_MULTIMAP(LengthWords, length_words,
+                        HASHTBL_KEY(int, int_hash, int_equal),
+                        HASHTBL_VALUE_FULL(char *, const char *, str_dup, free))
+
+HASHTBL_DEFINE_MULTIMAP(IntMulti, int_multi,
+                        HASHTBL_KEY(int, int_hash, int_equal),
+                        HASHTBL_VALUE(int))
+
+static void
+test_words(void)
+{
+    WordLines index;
+    LengthWords by_length;
+    word_lines_init(&index);
+    length_words_init(&by_length);
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    unsigned lines = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        assert(word_lines_append(&index, buf, lines));
+        assert(length_words_append(&by_length, (int)strlen(buf), buf));
+        ++lines;
+    }
+
+    fclose(f);
+
+    assert(word_lines_value_count(&index) == lines);
+    assert(word_lines_key_count(&index) < lines);
+    assert(length_words_value_count(&by_length) == lines);
+    assert(word_lines_check_internal_sanity(&index));
+    assert(length_words_check_internal_sanity(&by_length));
+
+    // the posting lists come back in line order and match the counts
+    size_t total = 0;
+    unsigned most = 0;
+    WordLines_Keys_Iterator it;
+    word_lines_keys_iterator_init(&index.keys, &it);
+    while (!word_lines_keys_iterator_at_end(&it)) {
+        const char *word = word_lines_keys_iterator_item(&it)->key;
+
+        unsigned count = 0;
+        unsigned prev = 0;
+        WordLines_Range r;
+        for (word_lines_equal_range(&index, word, &r); !word_lines_range_at_end(&r); word_lines_range_next(&r)) {
+            assert(count == 0 || *word_lines_range_value(&r) > prev);
+            prev = *word_lines_range_value(&r);
+            ++count;
+        }
+        assert(count == word_lines_count(&index, word));
+        if (count > most)
+            most = count;
+        total += count;
+
+        word_lines_keys_iterator_next(&it);
+    }
+    assert(total == lines);
+
+    // re-read the list, every line number must be found under its word
+    f = fopen("wordlist.txt", "r");
+    unsigned line = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        int found = 0;
+        WordLines_Range r;
+        word_lines_equal_range(&index, buf, &r);
+        unsigned *ids, len;
+        while ((ids = word_lines_range_run(&r, &len)))
+            for (unsigned i = 0; i < len; ++i)
+                found |= ids[i] == line;
+        assert(found);
+
+        LengthWords_Range lr;
+        length_words_equal_range(&by_length, (int)strlen(buf), &lr);
+        assert(!length_words_range_at_end(&lr));
+        assert(strlen(*length_words_range_value(&lr)) == strlen(buf));
+        ++line;
+    }
+
+    free(buf);
+    fclose(f);
+
+    printf("words: %u, lines: %u, most lines per word: %u\n", word_lines_key_count(&index), lines, most);
+
+    assert(word_lines_count(&index, "not a word at all") == 0);
+    WordLines_Range r;
+    word_lines_equal_range(&index, "not a word at all", &r);
+    assert(word_lines_range_at_end(&r));
+
+    length_words_clear(&by_length);
+    word_lines_clear(&index);
+}
+
+static void
+test_runs(void)
+{
+    IntMulti m;
+    int_multi_init(&m);
+
+    // interleave appends so the chunks of different keys alternate
+    for (int v = 0; v < 100; ++v)
+        for (int k = 0; k < 50; ++k)
+            if (v < k * 2 + 1)
+                assert(int_multi_append(&m, k, v * 1000 + k));
+
+    assert(int_multi_key_count(&m) == 50);
+    assert(int_multi_value_count(&m) == 50 * 50);
+    assert(int_multi_check_internal_sanity(&m));
+    for (int k = 0; k < 50; ++k) {
+        assert(int_multi_count(&m, k) == (unsigned)(k * 2 + 1));
+
+        // runs cover the rest of the values, in order
+        IntMulti_Range r;
+        int_multi_equal_range(&m, k, &r);
+        assert(*int_multi_range_value(&r) == k);
+        int_multi_range_next(&r);
+        int expected = 1;
+        unsigned len;
+        int *values;
+        while ((values = int_multi_range_run(&r, &len))) {
+            // short keys have all their values in one chunk
+            assert(len == (unsigned)(k * 2));
+            for (unsigned i = 0; i < len; ++i)
+                assert(values[i] == (expected++) * 1000 + k);
+        }
+        assert(expected == k * 2 + 1);
+        assert(int_multi_range_run(&r, &len) == NULL && len == 0);
+    }
+
+    // removed keys give their chunks back
+    unsigned chunks = m.chunks_used;
+    size_t slots = m.values_used;
+    for (int k = 0; k < 50; k += 2)
+        assert(int_multi_remove(&m, k) == (unsigned)(k * 2 + 1));
+    assert(int_multi_remove(&m, 0) == 0);
+    assert(int_multi_key_count(&m) == 25);
+    assert(int_multi_check_internal_sanity(&m));
+
+    for (int k = 0; k < 50; k += 2)
+        for (int v = 0; v < k * 2 + 1; ++v)
+            assert(int_multi_append(&m, k + 1000, v));
+    assert(m.chunks_used == chunks && m.values_used == slots);
+    assert(int_multi_value_count(&m) == 50 * 50);
+    assert(int_multi_check_internal_sanity(&m));
+
+    // long runs are capped at the maximum chunk size
+    for (unsigned v = 0; v < 5 * HASHTBL_MULTIMAP_MAX_CHUNK; ++v)
+        assert(int_multi_append(&m, -1, (int)v));
+    IntMulti_Range r;
+    int_multi_equal_range(&m, -1, &r);
+    unsigned len, runs = 0, seen = 0;
+    int *values;
+    while ((values = int_multi_range_run(&r, &len))) {
+        assert(len == HASHTBL_MULTIMAP_MAX_CHUNK && values[0] == (int)seen);
+        seen += len;
+        runs++;
+    }
+    assert(seen == 5 * HASHTBL_MULTIMAP_MAX_CHUNK && runs == 5);
+    assert(int_multi_check_internal_sanity(&m));
+
+    int_multi_clear(&m);
+    assert(int_multi_key_count(&m) == 0 && int_multi_value_count(&m) == 0);
+    assert(int_multi_append(&m, 1, 1));
+    assert(int_multi_count(&m, 1) == 1);
+    int_multi_clear(&m);
+}
+
+int main(void)
+{
+    test_words();
+
+    test_runs();
+}
@@ -0,0 +1,119 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-parallel.h"
+
+#include "str.h"
+#include "str-list.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+HASHTBL_DEFINE(WordCountDic, word_count_dic,
+               HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+               HASHTBL_VALUE(int))
+HASHTBL_DEFINE_PARALLEL_MERGE(WordCountDic, word_count_dic)
+
+#define NUM_THREADS 5
+
+typedef struct {
+    WordCountDic *dic;
+    StrList words;
+    size_t begin;
+    size_t end;
+} WorkerArgs;
+
+static void
+count_words(WordCountDic *dic, StrList words, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        WordCountDic_Item *item = word_count_dic_lookup(dic, words[i]);
+        if (item) {
+            item->value++;
+        } else {
+            word_count_dic_set(dic, words[i], 1);
+        }
+    }
+}
+
+static void *
+count_worker(void *arg)
+{
+    WorkerArgs *args = (WorkerArgs *)arg;
+    count_words(args->dic, args->words, args->begin, args->end);
+    return NULL;
+}
+
+static void
+add(int *value, int src_value, void *ctx)
+{
+    (void)ctx;
+    *value += src_value;
+}
+
+int main(void)
+{
+    StrList words = NULL;
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+        str_list_add(&words, buf);
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    size_t nwords = str_list_length(words);
+
+    // every thread counts its part of the words into its own table
+    WordCountDic per_thread[NUM_THREADS];
+    pthread_t threads[NUM_THREADS];
+    WorkerArgs args[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        word_count_dic_init(&per_thread[t]);
+        args[t].dic = &per_thread[t];
+        args[t].words = words;
+        args[t].begin = nwords * (size_t)t / NUM_THREADS;
+        args[t].end = nwords * (size_t)(t + 1) / NUM_THREADS;
+        int r = pthread_create(&threads[t], NULL, count_worker, &args[t]);
+        assert(r == 0);
+        (void)r;
+    }
+    for (int t = 0; t < NUM_THREADS; ++t)
+        pthread_join(threads[t], NULL);
+
+    assert(word_count_dic_merge_parallel(per_thread, NUM_THREADS, add, NULL));
+
+    for (int t = 1; t < NUM_THREADS; ++t)
+        assert(word_count_dic_size(&per_thread[t]) == 0);
+    assert(word_count_dic_check_internal_sanity(&per_thread[0]));
+
+    // compare with a sequential count
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+    count_words(&dic, words, 0, nwords);
+
+    assert(word_count_dic_size(&per_thread[0]) == word_count_dic_size(&dic));
+
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+        assert(word_count_dic_lookup(&per_thread[0], item->key)->value == item->value);
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    printf("element count: %u\n", word_count_dic_size(&dic));
+
+    word_count_dic_clear(&dic);
+    for (int t = 0; t < NUM_THREADS; ++t)
+        word_count_dic_clear(&per_thread[t]);
+    str_list_clear(&words);
+}
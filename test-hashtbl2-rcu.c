@@ -0,0 +1,153 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-rcu.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+HASHTBL_DEFINE_RCU(StrDictionary, str_dictionary,
+                   HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                   HASHTBL_VALUE_FULL(char *, const char *, str_dup, free))
+
+HASHTBL_DEFINE_RCU(IntMap, int_map,
+                   HASHTBL_KEY(int, int_hash, int_equal),
+                   HASHTBL_VALUE(int))
+
+#define NUM_READERS 3
+#define NUM_KEYS 2000
+
+static int stop_readers;
+
+static void *
+reader(void *arg)
+{
+    IntMap *map = (IntMap *)arg;
+    EpochThread self;
+    int_map_register_thread(map, &self);
+
+    unsigned long found = 0;
+    while (!__atomic_load_n(&stop_readers, __ATOMIC_ACQUIRE)) {
+        int_map_read_lock(map, &self);
+        for (int k = 0; k < NUM_KEYS; ++k) {
+            const IntMap_Item *item = int_map_lookup(map, k);
+            if (item) {
+                // every version of the value encodes its key
+                assert(item->key == k);
+                assert(item->value / 16 == k);
+                ++found;
+            }
+        }
+        int_map_read_unlock(map, &self);
+    }
+
+    int_map_unregister_thread(map, &self);
+    return (void *)found;
+}
+
+static void
+test_concurrent_readers(void)
+{
+    IntMap map;
+    int_map_init(&map);
+
+    pthread_t threads[NUM_READERS];
+    for (int t = 0; t < NUM_READERS; ++t) {
+        int r = pthread_create(&threads[t], NULL, reader, &map);
+        assert(r == 0);
+        (void)r;
+    }
+
+    // grow the table, replace values and remove keys while the readers run
+    for (int round = 0; round < 16; ++round) {
+        for (int k = 0; k < NUM_KEYS; ++k)
+            assert(int_map_set(&map, k, k * 16 + round));
+
+        for (int k = round % 2; k < NUM_KEYS; k += 2)
+            int_map_remove(&map, k);
+    }
+
+    __atomic_store_n(&stop_readers, 1, __ATOMIC_RELEASE);
+    for (int t = 0; t < NUM_READERS; ++t)
+        pthread_join(threads[t], NULL);
+
+    int_map_synchronize(&map);
+    assert(map.epoch.retired == NULL);
+
+    // the last round removed the odd keys
+    EpochThread self;
+    int_map_register_thread(&map, &self);
+    int_map_read_lock(&map, &self);
+    assert(int_map_size(&map) == NUM_KEYS / 2);
+    for (int k = 0; k < NUM_KEYS; ++k) {
+        const IntMap_Item *item = int_map_lookup(&map, k);
+        if (k % 2) {
+            assert(!item);
+        } else {
+            assert(item && item->value == k * 16 + 15);
+        }
+    }
+    int_map_read_unlock(&map, &self);
+    int_map_unregister_thread(&map, &self);
+
+    int_map_clear(&map);
+}
+
+int main(void)
+{
+    StrDictionary dic;
+    str_dictionary_init(&dic);
+
+    EpochThread self;
+    str_dictionary_register_thread(&dic, &self);
+
+    assert(str_dictionary_set(&dic, "Hello", "World"));
+
+    str_dictionary_read_lock(&dic, &self);
+    const StrDictionary_Item *item = str_dictionary_lookup(&dic, "Hello");
+    assert(!strcmp(item->value, "World"));
+    str_dictionary_read_unlock(&dic, &self);
+
+    // a replaced item must survive until the read section ends
+    str_dictionary_read_lock(&dic, &self);
+    const StrDictionary_Item *old_item = str_dictionary_lookup(&dic, "Hello");
+    assert(str_dictionary_set(&dic, "Hello", "Hohoho"));
+    assert(!strcmp(old_item->value, "World"));
+    assert(dic.epoch.retired != NULL);
+    item = str_dictionary_lookup(&dic, "Hello");
+    assert(!strcmp(item->value, "Hohoho"));
+    assert(!str_dictionary_lookup(&dic, "World"));
+    str_dictionary_read_unlock(&dic, &self);
+
+    str_dictionary_synchronize(&dic);
+    assert(dic.epoch.retired == NULL);
+
+    str_dictionary_remove(&dic, "Hello");
+
+    str_dictionary_read_lock(&dic, &self);
+    assert(!str_dictionary_contains(&dic, "Hello"));
+    str_dictionary_read_unlock(&dic, &self);
+    assert(str_dictionary_size(&dic) == 0);
+
+    str_dictionary_unregister_thread(&dic, &self);
+    str_dictionary_clear(&dic);
+
+    test_concurrent_readers();
+
+    printf("ok\n");
+}
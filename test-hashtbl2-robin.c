@@ -0,0 +1,176 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-robin.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+HASHTBL_DEFINE_ROBIN(ConstStrDictionary, const_str_dictionary,
+                     HASHTBL_KEY(const char *, str_hash, str_equal),
+                     HASHTBL_VALUE(const char *))
+
+HASHTBL_DEFINE_ROBIN(WordCountDic, word_count_dic,
+                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                     HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_ROBIN(IntSet, int_set,
+                     HASHTBL_KEY(int, int_hash, int_equal),
+                     HASHTBL_VALUE(int))
+
+static void
+test_wordcount(void)
+{
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        WordCountDic_Item *item = word_count_dic_lookup(&dic, buf);
+        if (item) {
+            item->value++;
+        } else {
+            word_count_dic_set(&dic, buf, 1);
+        }
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    // remove all words with low count
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+        if (item->value < 53) {
+            word_count_dic_iterator_delete(&it);
+        }
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    // print it
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+        if (item->value > 1) {
+            printf("%s: %d\n", item->key, item->value);
+        }
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    printf("element count: %u\n", dic.element_count);
+    printf("capacity: %u\n", dic.capacity);
+
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    word_count_dic_clear(&dic);
+}
+
+static void
+test_high_load(void)
+{
+    IntSet s;
+    int_set_init_reserve(&s, 920);
+    assert(s.capacity == 1024);
+
+    // run at > 90% load and remove/insert in a pattern unrelated to the hash
+    for (int i = 0; i < 920; ++i)
+        int_set_set(&s, i, -i);
+
+    for (int round = 0; round < 50; ++round) {
+        for (int i = round * 7; i < 920; i += 13)
+            int_set_remove(&s, i);
+
+        for (int i = round * 7; i < 920; i += 13)
+            int_set_set(&s, i, -i);
+
+        assert(s.capacity == 1024);
+        assert(int_set_check_internal_sanity(&s));
+    }
+
+    assert(int_set_size(&s) == 920);
+    for (int i = 0; i < 2000; ++i) {
+        IntSet_Item *item = int_set_lookup(&s, i);
+        if (i < 920) {
+            assert(item && item->value == -i);
+        } else {
+            assert(!item);
+        }
+    }
+
+    unsigned histogram[16];
+    assert(int_set_check_internal_sanity_histogram(&s, histogram, 16));
+
+    printf("probe length histogram at %u/%u:\n", int_set_size(&s), s.capacity);
+    unsigned total = 0;
+    for (unsigned i = 0; i < 16; ++i) {
+        printf("%2u%s: %u\n", i + 1, i == 15 ? "+" : " ", histogram[i]);
+        total += histogram[i];
+    }
+    assert(total == 920);
+
+    // delete everything while iterating, backward shifts must not skip items
+    IntSet_Iterator it;
+    int_set_iterator_init(&s, &it);
+    while (!int_set_iterator_at_end(&it)) {
+        if (int_set_iterator_item(&it)->key % 3)
+            int_set_iterator_delete(&it);
+
+        int_set_iterator_next(&it);
+    }
+
+    assert(int_set_size(&s) == 307);
+    assert(int_set_check_internal_sanity(&s));
+
+    int_set_clear(&s);
+}
+
+int main(void)
+{
+    ConstStrDictionary dic;
+    const_str_dictionary_init(&dic);
+
+    const_str_dictionary_set(&dic, "Hello", "World");
+
+    ConstStrDictionary_Item *item = const_str_dictionary_lookup(&dic, "Hello");
+    assert(!strcmp(item->value, "World"));
+
+    const_str_dictionary_set(&dic, "Hello", "Hohoho");
+    item = const_str_dictionary_lookup(&dic, "Hello");
+    assert(!strcmp(item->value, "Hohoho"));
+
+    assert(!const_str_dictionary_lookup(&dic, "World"));
+    const_str_dictionary_remove(&dic, "Hello");
+    assert(!const_str_dictionary_contains(&dic, "Hello"));
+
+    assert(const_str_dictionary_check_internal_sanity(&dic));
+
+    const_str_dictionary_clear(&dic);
+
+    test_high_load();
+
+    test_wordcount();
+}
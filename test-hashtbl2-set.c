@@ -0,0 +1,155 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-set.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+HASHSET_DEFINE(WordSet, word_set,
+               HASHTBL_KEY_SEEDED_FULL(char *, const char *, str_dup, free, str_hash_seeded, str_equal))
+
+HASHSET_DEFINE(IntSet, int_set,
+               HASHTBL_KEY(int, int_hash, int_equal))
+
+static void
+test_words(void)
+{
+    WordSet all, short_words;
+    word_set_init(&all);
+    word_set_init(&short_words);
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    unsigned lines = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        int added = word_set_add(&all, buf);
+        assert(added == 0 || added == 1);
+        if (strlen(buf) < 5)
+            word_set_add(&short_words, buf);
+        ++lines;
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    assert(word_set_size(&all) < lines);
+    assert(word_set_size(&short_words) < word_set_size(&all));
+    assert(word_set_is_subset(&short_words, &all));
+    assert(!word_set_is_subset(&all, &short_words));
+
+    // every set has its own seed, the result sets still come out right
+    WordSet long_words, both, again;
+    word_set_init(&long_words);
+    word_set_init(&both);
+    word_set_init(&again);
+    assert(word_set_difference(&long_words, &all, &short_words));
+    assert(word_set_size(&long_words) == word_set_size(&all) - word_set_size(&short_words));
+    assert(word_set_intersect(&both, &long_words, &short_words));
+    assert(word_set_size(&both) == 0);
+    assert(word_set_union(&again, &short_words, &long_words));
+    assert(word_set_size(&again) == word_set_size(&all));
+    assert(word_set_is_subset(&all, &again) && word_set_is_subset(&again, &all));
+    assert(word_set_check_internal_sanity(&again));
+
+    // an output set which isn't empty keeps its own seed
+    word_set_add(&both, "zzzzzz");
+    assert(word_set_intersect(&both, &all, &short_words));
+    assert(word_set_size(&both) == word_set_size(&short_words) + 1);
+    assert(word_set_contains(&both, "zzzzzz"));
+    assert(word_set_check_internal_sanity(&both));
+
+    printf("words: %u, short: %u\n", word_set_size(&all), word_set_size(&short_words));
+
+    word_set_clear(&again);
+    word_set_clear(&both);
+    word_set_clear(&long_words);
+    word_set_clear(&short_words);
+    word_set_clear(&all);
+}
+
+static void
+test_algebra(void)
+{
+    IntSet even, third, out;
+    int_set_init(&even);
+    int_set_init(&third);
+    int_set_init(&out);
+
+    for (int i = 0; i < 6000; i += 2)
+        assert(int_set_add(&even, i) == 1);
+    for (int i = 0; i < 3000; i += 3)
+        assert(int_set_add(&third, i) == 1);
+    assert(int_set_add(&even, 4) == 0);
+
+    assert(int_set_union(&out, &even, &third));
+    assert(int_set_size(&out) == 3000 + 500);
+    for (int i = -5; i < 6005; ++i)
+        assert(int_set_contains(&out, i) == (i >= 0 && i < 6000 && (i % 2 == 0 || (i < 3000 && i % 3 == 0))));
+    int_set_clear(&out);
+
+    assert(int_set_intersect(&out, &third, &even));
+    assert(int_set_size(&out) == 500);
+    for (int i = 0; i < 6000; ++i)
+        assert(int_set_contains(&out, i) == (i < 3000 && i % 6 == 0));
+    assert(int_set_is_subset(&out, &even) && int_set_is_subset(&out, &third));
+    int_set_clear(&out);
+
+    assert(int_set_difference(&out, &third, &even));
+    assert(int_set_size(&out) == 500);
+    assert(int_set_contains(&out, 3) && !int_set_contains(&out, 6));
+    assert(!int_set_is_subset(&out, &even));
+    int_set_clear(&out);
+
+    // removing while iterating keeps the set dense
+    IntSet_Iterator it;
+    int_set_iterator_init(&even, &it);
+    while (!int_set_iterator_at_end(&it)) {
+        if (int_set_iterator_item(&it)->key % 4)
+            int_set_iterator_delete(&it);
+        int_set_iterator_next(&it);
+    }
+    assert(int_set_size(&even) == 1500);
+    assert(int_set_remove(&even, 0) == 1);
+    assert(int_set_remove(&even, 0) == 0);
+    assert(int_set_check_internal_sanity(&even));
+    for (unsigned i = 0; i < int_set_size(&even); ++i)
+        assert(int_set_item_at(&even, i)->key % 4 == 0);
+
+    // empty sets
+    int_set_clear(&third);
+    assert(int_set_is_subset(&third, &even));
+    assert(int_set_intersect(&out, &even, &third));
+    assert(int_set_size(&out) == 0);
+
+    int_set_clear(&out);
+    int_set_clear(&third);
+    int_set_clear(&even);
+}
+
+int main(void)
+{
+    test_words();
+
+    test_algebra();
+}
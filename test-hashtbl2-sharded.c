@@ -0,0 +1,149 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-sharded.h"
+
+#include "str.h"
+#include "str-list.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+HASHTBL_DEFINE(WordCountDic, word_count_dic,
+               HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+               HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_SHARDED(SharedWordCount, shared_word_count,
+                       HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                       HASHTBL_VALUE(int),
+                       4)
+
+#define NUM_THREADS 4
+
+typedef struct {
+    SharedWordCount *wc;
+    StrList words;
+    size_t begin;
+    size_t end;
+} WorkerArgs;
+
+static void
+increment(int *value, void *ctx)
+{
+    (void)ctx;
+    (*value)++;
+}
+
+static void *
+count_worker(void *arg)
+{
+    WorkerArgs *args = (WorkerArgs *)arg;
+
+    for (size_t i = args->begin; i < args->end; ++i)
+        shared_word_count_lookup_or_insert(args->wc, args->words[i], 0, increment, NULL);
+
+    return NULL;
+}
+
+static void
+test_wordcount(void)
+{
+    StrList words = NULL;
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+        str_list_add(&words, buf);
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    size_t nwords = str_list_length(words);
+
+    // count in parallel
+    SharedWordCount wc;
+    shared_word_count_init(&wc);
+
+    pthread_t threads[NUM_THREADS];
+    WorkerArgs args[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        args[t].wc = &wc;
+        args[t].words = words;
+        args[t].begin = nwords * (size_t)t / NUM_THREADS;
+        args[t].end = nwords * (size_t)(t + 1) / NUM_THREADS;
+        int r = pthread_create(&threads[t], NULL, count_worker, &args[t]);
+        assert(r == 0);
+        (void)r;
+    }
+    for (int t = 0; t < NUM_THREADS; ++t)
+        pthread_join(threads[t], NULL);
+
+    // and compare with a sequential count
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+    for (size_t i = 0; i < nwords; ++i) {
+        WordCountDic_Item *item = word_count_dic_lookup(&dic, words[i]);
+        if (item) {
+            item->value++;
+        } else {
+            word_count_dic_set(&dic, words[i], 1);
+        }
+    }
+
+    assert(shared_word_count_size(&wc) == word_count_dic_size(&dic));
+
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+
+        int count = 0;
+        assert(shared_word_count_lookup(&wc, item->key, &count));
+        assert(count == item->value);
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    for (unsigned i = 0; i < (1u << 4); ++i)
+        assert(shared_word_count_shard_check_internal_sanity(&wc.shards[i].tbl));
+
+    printf("element count: %u\n", shared_word_count_size(&wc));
+
+    word_count_dic_clear(&dic);
+    shared_word_count_clear(&wc);
+    str_list_clear(&words);
+}
+
+int main(void)
+{
+    SharedWordCount wc;
+    shared_word_count_init(&wc);
+
+    assert(shared_word_count_set(&wc, "Hello", 1));
+    assert(shared_word_count_contains(&wc, "Hello"));
+    assert(!shared_word_count_contains(&wc, "World"));
+
+    assert(shared_word_count_lookup_or_insert(&wc, "Hello", 0, increment, NULL) == 0);
+    assert(shared_word_count_lookup_or_insert(&wc, "World", 5, NULL, NULL) == 1);
+
+    int value = 0;
+    assert(shared_word_count_lookup(&wc, "Hello", &value));
+    assert(value == 2);
+    assert(shared_word_count_lookup(&wc, "World", &value));
+    assert(value == 5);
+    assert(shared_word_count_size(&wc) == 2);
+
+    shared_word_count_remove(&wc, "Hello");
+    assert(!shared_word_count_contains(&wc, "Hello"));
+    assert(shared_word_count_size(&wc) == 1);
+
+    shared_word_count_clear(&wc);
+
+    test_wordcount();
+}
@@ -0,0 +1,296 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-snapshot.h"
+
+#include "str.h"
+#include "str-list.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+HASHTBL_DEFINE(WordCountDic, word_count_dic,
+               HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+               HASHTBL_VALUE(int))
+HASHTBL_DEFINE_SNAPSHOT_STR(WordCountDic, word_count_dic)
+
+HASHTBL_DEFINE(SeededDic, seeded_dic,
+               HASHTBL_KEY_SEEDED_FULL(char *, const char *, str_dup, free, str_hash_seeded, str_equal),
+               HASHTBL_VALUE(int))
+HASHTBL_DEFINE_SNAPSHOT_STR(SeededDic, seeded_dic)
+
+HASHTBL_DEFINE(IntMap, int_map,
+               HASHTBL_KEY(int, int_hash, int_equal),
+               HASHTBL_VALUE(double))
+HASHTBL_DEFINE_SNAPSHOT(IntMap, int_map)
+
+static char *
+temp_file(void)
+{
+    char *path = str_dup("/tmp/test-hashtbl2-snapshot-XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    return path;
+}
+
+static void
+test_wordcount(void)
+{
+    StrList words = NULL;
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+        str_list_add(&words, buf);
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+    for (size_t i = 0; words[i]; ++i) {
+        WordCountDic_Item *item = word_count_dic_lookup(&dic, words[i]);
+        if (item) {
+            item->value++;
+        } else {
+            word_count_dic_set(&dic, words[i], 1);
+        }
+    }
+
+    char *path = temp_file();
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    assert(fd >= 0);
+    assert(word_count_dic_save(&dic, fd));
+    close(fd);
+
+    WordCountDic_Snapshot snap;
+    assert(word_count_dic_map(&snap, path));
+    assert(word_count_dic_snapshot_size(&snap) == word_count_dic_size(&dic));
+
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        WordCountDic_Item *item = word_count_dic_iterator_item(&it);
+
+        const int *value = word_count_dic_snapshot_lookup(&snap, item->key);
+        assert(value && *value == item->value);
+
+        word_count_dic_iterator_next(&it);
+    }
+    assert(!word_count_dic_snapshot_contains(&snap, "this is not a word"));
+    assert(!word_count_dic_snapshot_contains(&snap, ""));
+
+    printf("element count: %u, file size: %zu\n", word_count_dic_snapshot_size(&snap), snap.size);
+
+    word_count_dic_unmap(&snap);
+    unlink(path);
+    free(path);
+
+    word_count_dic_clear(&dic);
+    str_list_clear(&words);
+}
+
+static void
+test_seeded(void)
+{
+    SeededDic dic;
+    seeded_dic_init(&dic);
+    seeded_dic_set(&dic, "Hello", 1);
+    seeded_dic_set(&dic, "World", 2);
+    seeded_dic_set(&dic, "Foo", 3);
+    seeded_dic_remove(&dic, "Foo");
+
+    char *path = temp_file();
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    assert(seeded_dic_save(&dic, fd));
+    close(fd);
+    seeded_dic_clear(&dic);
+
+    // the seed is stored in the file, the table it came from is gone
+    SeededDic_Snapshot snap;
+    assert(seeded_dic_map(&snap, path));
+    assert(seeded_dic_snapshot_size(&snap) == 2);
+    assert(*seeded_dic_snapshot_lookup(&snap, "Hello") == 1);
+    assert(*seeded_dic_snapshot_lookup(&snap, "World") == 2);
+    assert(!seeded_dic_snapshot_contains(&snap, "Foo"));
+    seeded_dic_unmap(&snap);
+
+    unlink(path);
+    free(path);
+}
+
+static void
+test_int_keys(void)
+{
+    IntMap map;
+    int_map_init(&map);
+
+    for (int i = 0; i < 10000; ++i)
+        int_map_set(&map, i, i * 0.5);
+    for (int i = 0; i < 10000; i += 3)
+        int_map_remove(&map, i);
+
+    char *path = temp_file();
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    assert(int_map_save(&map, fd));
+    close(fd);
+
+    IntMap_Snapshot snap;
+    assert(int_map_map(&snap, path));
+    assert(int_map_snapshot_size(&snap) == int_map_size(&map));
+    for (int i = -10; i < 10010; ++i) {
+        const double *value = int_map_snapshot_lookup(&snap, i);
+        if (i < 0 || i >= 10000 || i % 3 == 0) {
+            assert(!value);
+        } else {
+            assert(value && *value == i * 0.5);
+        }
+    }
+    int_map_unmap(&snap);
+
+    // a snapshot of a different table type is rejected
+    WordCountDic_Snapshot wrong;
+    assert(!word_count_dic_map(&wrong, path));
+
+    // and so is a truncated file
+    assert(truncate(path, 100) == 0);
+    assert(!int_map_map(&snap, path));
+
+    unlink(path);
+    free(path);
+
+    // empty tables work, too
+    IntMap empty;
+    int_map_init(&empty);
+    path = temp_file();
+    fd = open(path, O_WRONLY | O_TRUNC);
+    assert(int_map_save(&empty, fd));
+    close(fd);
+    assert(int_map_map(&snap, path));
+    assert(int_map_snapshot_size(&snap) == 0);
+    assert(!int_map_snapshot_contains(&snap, 1));
+    int_map_unmap(&snap);
+    unlink(path);
+    free(path);
+
+    int_map_clear(&map);
+}
+
+static void
+save_to(WordCountDic *dic, const char *path)
+{
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    assert(fd >= 0);
+    assert(word_count_dic_save(dic, fd));
+    close(fd);
+}
+
+static void
+patch(const char *path, size_t offset, const void *data, size_t len)
+{
+    int fd = open(path, O_WRONLY);
+    assert(fd >= 0);
+    assert(pwrite(fd, data, len, (off_t)offset) == (ssize_t)len);
+    close(fd);
+}
+
+// mapping a corrupt file succeeds, but verifying it fails and lookups stay safe
+static void
+check_corrupt(const char *path)
+{
+    WordCountDic_Snapshot snap;
+    assert(word_count_dic_map(&snap, path));
+    assert(!word_count_dic_verify(&snap));
+    for (int i = 0; i < 100; ++i) {
+        char *key = str_printf("key %d", i);
+        const int *v = word_count_dic_snapshot_lookup(&snap, key);
+        assert(!v || *v == i);
+        free(key);
+    }
+    assert(!word_count_dic_snapshot_lookup(&snap, "missing"));
+    word_count_dic_unmap(&snap);
+}
+
+static void
+test_corrupt(void)
+{
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+    for (int i = 0; i < 100; ++i) {
+        char *key = str_printf("key %d", i);
+        word_count_dic_set(&dic, key, i);
+        free(key);
+    }
+
+    char *path = temp_file();
+    save_to(&dic, path);
+
+    // find where the first item of a chain is in the file
+    WordCountDic_Snapshot snap;
+    assert(word_count_dic_map(&snap, path));
+    unsigned item_i = (unsigned)-1;
+    for (unsigned b = 0; item_i == (unsigned)-1; ++b)
+        item_i = snap.hashtbl[b];
+    size_t item_offset = (size_t)((const char *)&snap.items[item_i] - (const char *)snap.base);
+    size_t strings_end = (size_t)(snap.strings - (const char *)snap.base) + snap.header->strings_size;
+    word_count_dic_unmap(&snap);
+
+    // a link past the items
+    unsigned next = 100000;
+    patch(path, item_offset + offsetof(WordCountDic_Item, next), &next, sizeof(next));
+    check_corrupt(path);
+
+    // a chain which never ends
+    save_to(&dic, path);
+    patch(path, item_offset + offsetof(WordCountDic_Item, next), &item_i, sizeof(item_i));
+    check_corrupt(path);
+
+    // a string key outside the blob
+    save_to(&dic, path);
+    char *key = (char *)(uintptr_t)100000;
+    patch(path, item_offset + offsetof(WordCountDic_Item, key), &key, sizeof(key));
+    check_corrupt(path);
+
+    // a string which isn't terminated within the blob
+    save_to(&dic, path);
+    patch(path, strings_end - 1, "x", 1);
+    assert(!word_count_dic_map(&snap, path) && errno == EINVAL);
+
+    save_to(&dic, path);
+    assert(word_count_dic_map(&snap, path));
+    assert(word_count_dic_verify(&snap));
+    assert(*word_count_dic_snapshot_lookup(&snap, "key 42") == 42);
+    word_count_dic_unmap(&snap);
+
+    unlink(path);
+    free(path);
+    word_count_dic_clear(&dic);
+}
+
+int main(void)
+{
+    test_int_keys();
+    test_seeded();
+    test_wordcount();
+    test_corrupt();
+}
@@ -0,0 +1,155 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include "hashtbl2-soa.h"
+
+#include "str.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned
+int_hash(int i)
+{
+    return (unsigned)i * 2654435761u;
+}
+
+static int
+int_equal(int a, int b)
+{
+    return a == b;
+}
+
+typedef struct {
+    int id;
+    char payload[60];
+} BigValue;
+
+HASHTBL_DEFINE_SOA(WordCountDic, word_count_dic,
+                   HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                   HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_SOA(InlineWordCountDic, inline_word_count_dic,
+                   HASHTBL_KEY_STR_SEEDED(str_hash_seeded),
+                   HASHTBL_VALUE(int))
+
+HASHTBL_DEFINE_SOA(BigMap, big_map,
+                   HASHTBL_KEY(int, int_hash, int_equal),
+                   HASHTBL_VALUE(BigValue))
+
+static void
+test_wordcount(void)
+{
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+
+    InlineWordCountDic inline_dic;
+    inline_word_count_dic_init(&inline_dic);
+
+    FILE *f = fopen("wordlist.txt", "r");
+
+    char *buf = NULL;
+    size_t n = 0;
+    while (getline(&buf, &n, f) >= 0) {
+        str_trim_inplace(buf);
+
+        word_count_dic_lookup_or_insert_zero(&dic, buf, NULL)[0]++;
+        inline_word_count_dic_lookup_or_insert_zero(&inline_dic, buf, NULL)[0]++;
+    }
+
+    free(buf);
+
+    fclose(f);
+
+    assert(word_count_dic_size(&dic) == inline_word_count_dic_size(&inline_dic));
+
+    // remove all words with low count
+    WordCountDic_Iterator it;
+    word_count_dic_iterator_init(&dic, &it);
+    while (!word_count_dic_iterator_at_end(&it)) {
+        unsigned i = word_count_dic_iterator_index(&it);
+        int *other = inline_word_count_dic_lookup(&inline_dic, *word_count_dic_key_at(&dic, i));
+        assert(other && *other == *word_count_dic_value_at(&dic, i));
+
+        if (*word_count_dic_value_at(&dic, i) < 53) {
+            inline_word_count_dic_remove(&inline_dic, *word_count_dic_key_at(&dic, i));
+            word_count_dic_iterator_delete(&it);
+        }
+
+        word_count_dic_iterator_next(&it);
+    }
+
+    printf("element count: %u\n", word_count_dic_size(&dic));
+    printf("slots used: %u\n", dic.slots_used);
+
+    assert(word_count_dic_size(&dic) == inline_word_count_dic_size(&inline_dic));
+    assert(word_count_dic_check_internal_sanity(&dic));
+    assert(inline_word_count_dic_check_internal_sanity(&inline_dic));
+
+    // removed slots are reused
+    unsigned slots_used = dic.slots_used;
+    word_count_dic_set(&dic, "certainly not in the word list", 1);
+    assert(dic.slots_used == slots_used);
+    assert(*word_count_dic_lookup(&dic, "certainly not in the word list") == 1);
+
+    inline_word_count_dic_clear(&inline_dic);
+    word_count_dic_clear(&dic);
+}
+
+static void
+test_big_values(void)
+{
+    BigMap m;
+    big_map_init_reserve(&m, 1000);
+    assert(m.slots_allocated >= 1000);
+
+    for (int i = 0; i < 100000; ++i) {
+        BigValue v;
+        memset(&v, 0, sizeof(v));
+        v.id = i;
+        snprintf(v.payload, sizeof(v.payload), "value %d", i);
+        big_map_set(&m, i, v);
+    }
+
+    assert(big_map_size(&m) == 100000);
+    assert(big_map_check_internal_sanity(&m));
+
+    for (int i = 0; i < 100000; i += 3)
+        big_map_remove(&m, i);
+
+    for (int i = -10; i < 110000; ++i) {
+        BigValue *v = big_map_lookup(&m, i);
+        if (i >= 0 && i < 100000 && i % 3) {
+            assert(v && v->id == i);
+            char payload[60];
+            snprintf(payload, sizeof(payload), "value %d", i);
+            assert(!strcmp(v->payload, payload));
+            assert(big_map_index(&m, i) == (unsigned)(v - m.values));
+            assert(*big_map_key_at(&m, big_map_index(&m, i)) == i);
+        } else {
+            assert(!v && !big_map_contains(&m, i));
+        }
+    }
+
+    int inserted = -1;
+    BigValue *v = big_map_lookup_or_insert_zero(&m, 3, &inserted);
+    assert(inserted == 1 && v->id == 0 && !v->payload[0]);
+    v = big_map_lookup_or_insert_zero(&m, 4, &inserted);
+    assert(inserted == 0 && v->id == 4);
+    v = big_map_set_zero(&m, 4);
+    assert(v->id == 0);
+
+    assert(big_map_size(&m) == 66667);
+    assert(big_map_check_internal_sanity(&m));
+
+    big_map_clear(&m);
+    assert(!big_map_lookup(&m, 1));
+}
+
+int main(void)
+{
+    test_wordcount();
+
+    test_big_values();
+}
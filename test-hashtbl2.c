@@ -20,6 +20,434 @@ HASHTBL_DEFINE(WordCountDic, word_count_dic,
                HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
                HASHTBL_VALUE(int))
 
+HASHTBL_DEFINE_SIZED(Pow2Dic, pow2_dic,
+                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                     HASHTBL_VALUE(int),
+                     HASHTBL_SIZING_POW2)
+
+static void
+test_pow2_sizing(void)
+{
+    Pow2Dic dic;
+    pow2_dic_init(&dic);
+
+    for (int i = 0; i < 100000; ++i) {
+        char *key = str_printf("key %d", i);
+        pow2_dic_set(&dic, key, i);
+        free(key);
+    }
+
+    assert(pow2_dic_check_internal_sanity(&dic));
+    assert(_hashtbl_pow2_bucket_count(dic.table_size_idx) == 262144);
+
+    for (int i = 0; i < 100000; i += 2) {
+        char *key = str_printf("key %d", i);
+        pow2_dic_remove(&dic, key);
+        free(key);
+    }
+
+    for (int i = 0; i < 100000; ++i) {
+        char *key = str_printf("key %d", i);
+        Pow2Dic_Item *item = pow2_dic_lookup(&dic, key);
+        assert(i % 2 ? item && item->value == i : !item);
+        free(key);
+    }
+
+    assert(pow2_dic_size(&dic) == 50000);
+    assert(pow2_dic_check_internal_sanity(&dic));
+
+    pow2_dic_clear(&dic);
+}
+
+HASHTBL_DEFINE_SIZED(IncrementalDic, incremental_dic,
+                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                     HASHTBL_VALUE(int),
+                     HASHTBL_SIZING_INCREMENTAL(HASHTBL_SIZING_PRIME, 4))
+
+static void
+test_incremental_resize(void)
+{
+    IncrementalDic dic;
+    incremental_dic_init(&dic);
+
+    int saw_migration = 0;
+    for (int i = 0; i < 100000; ++i) {
+        char *key = str_printf("key %d", i);
+        incremental_dic_set(&dic, key, i);
+        free(key);
+
+        // remove some while a migration might be in progress
+        if (i % 3 == 0) {
+            key = str_printf("key %d", i / 3);
+            incremental_dic_remove(&dic, key);
+            free(key);
+        }
+
+        if (dic.old_hashtbl) {
+            saw_migration = 1;
+            if (i % 97 == 0)
+                assert(incremental_dic_check_internal_sanity(&dic));
+        }
+    }
+
+    assert(saw_migration);
+
+    for (int i = 0; i < 100000; ++i) {
+        char *key = str_printf("key %d", i);
+        IncrementalDic_Item *item = incremental_dic_lookup(&dic, key);
+        if (i <= 33333) {
+            assert(!item);
+        } else {
+            assert(item && item->value == i);
+        }
+        free(key);
+    }
+
+    assert(incremental_dic_size(&dic) == 100000 - 33334);
+    assert(incremental_dic_check_internal_sanity(&dic));
+
+    // delete through the iterator, possibly hitting items in the old buckets
+    IncrementalDic_Iterator it;
+    incremental_dic_iterator_init(&dic, &it);
+    while (!incremental_dic_iterator_at_end(&it)) {
+        if (incremental_dic_iterator_item(&it)->value % 2)
+            incremental_dic_iterator_delete(&it);
+
+        incremental_dic_iterator_next(&it);
+    }
+    assert(incremental_dic_check_internal_sanity(&dic));
+
+    while (incremental_dic_rehash_step(&dic, 1000))
+        ;
+    assert(!dic.old_hashtbl);
+    assert(incremental_dic_size(&dic) == 33333);
+    assert(incremental_dic_check_internal_sanity(&dic));
+
+    incremental_dic_clear(&dic);
+}
+
+HASHTBL_DEFINE_SIZED(SlowIncrementalDic, slow_incremental_dic,
+                     HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                     HASHTBL_VALUE(int),
+                     HASHTBL_SIZING_INCREMENTAL(HASHTBL_SIZING_PRIME, 1))
+
+static void
+test_incremental_latency(void)
+{
+    SlowIncrementalDic dic;
+    slow_incremental_dic_init(&dic);
+
+    // even with a single bucket per step, no insert may have to finish a whole migration
+    unsigned max_migrated = 0;
+    for (int i = 0; i < 200000; ++i) {
+        unsigned *old_hashtbl = dic.old_hashtbl;
+        unsigned old_count = old_hashtbl ? _hashtbl_prime_bucket_count(dic.old_table_size_idx) : 0;
+        unsigned pos = dic.migrate_pos;
+
+        char *key = str_printf("key %d", i);
+        slow_incremental_dic_set(&dic, key, i);
+        free(key);
+
+        unsigned migrated = 0;
+        if (old_hashtbl && (dic.old_hashtbl != old_hashtbl || !dic.old_hashtbl))
+            migrated += old_count - pos; // the old migration finished
+        if (dic.old_hashtbl)
+            migrated += dic.old_hashtbl == old_hashtbl ? dic.migrate_pos - pos : dic.migrate_pos;
+        if (migrated > max_migrated)
+            max_migrated = migrated;
+    }
+
+    assert(max_migrated <= 4);
+    assert(slow_incremental_dic_size(&dic) == 200000);
+    assert(slow_incremental_dic_check_internal_sanity(&dic));
+
+    slow_incremental_dic_clear(&dic);
+}
+
+static void
+test_shrink(void)
+{
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+
+    for (int i = 0; i < 10000; ++i) {
+        char *key = str_printf("key %d", i);
+        word_count_dic_set(&dic, key, i);
+        free(key);
+    }
+
+    for (int i = 0; i < 10000; ++i) {
+        if (i % 10 == 0)
+            continue;
+
+        char *key = str_printf("key %d", i);
+        word_count_dic_remove(&dic, key);
+        free(key);
+    }
+
+    assert(dic.item_storage_used > 9000);
+
+    word_count_dic_shrink_to_fit(&dic);
+
+    assert(dic.item_storage_used == 1000);
+    assert(dic.item_storage_allocated == 1000);
+    assert(dic.item_storage_firstfree == (unsigned)-1);
+    assert(_hashtbl_size_map[dic.table_size_idx] == 1543);
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    for (int i = 0; i < 10000; ++i) {
+        char *key = str_printf("key %d", i);
+        WordCountDic_Item *item = word_count_dic_lookup(&dic, key);
+        assert(i % 10 ? !item : item && item->value == i);
+        free(key);
+    }
+
+    // automatic shrinking once more than half of the storage is unused
+    word_count_dic_set_auto_shrink(&dic, 1);
+    for (int i = 0; i < 10000; i += 10) {
+        if (i % 1000 == 0)
+            continue;
+
+        char *key = str_printf("key %d", i);
+        word_count_dic_remove(&dic, key);
+        free(key);
+    }
+
+    assert(word_count_dic_size(&dic) == 10);
+    assert(dic.item_storage_allocated < 64);
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    word_count_dic_shrink_to_fit(&dic);
+    assert(dic.item_storage_allocated == 10);
+    assert(word_count_dic_contains(&dic, "key 5000"));
+
+    word_count_dic_clear(&dic);
+
+    // shrinking an empty table frees everything
+    word_count_dic_init_reserve(&dic, 100);
+    word_count_dic_shrink_to_fit(&dic);
+    assert(!dic.item_storage && dic.item_storage_allocated == 0);
+    word_count_dic_clear(&dic);
+}
+
+static void
+test_lookup_many(void)
+{
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+
+    char *keys[300];
+    for (int i = 0; i < 300; ++i) {
+        keys[i] = str_printf("key %d", i);
+        if (i % 3)
+            word_count_dic_set(&dic, keys[i], i);
+    }
+
+    WordCountDic_Item *items[300];
+    word_count_dic_lookup_many(&dic, (const char * const *)keys, 300, items);
+
+    for (int i = 0; i < 300; ++i) {
+        assert(items[i] == word_count_dic_lookup(&dic, keys[i]));
+        assert(i % 3 ? items[i] && items[i]->value == i : !items[i]);
+    }
+
+    unsigned hashes[300];
+    for (int i = 0; i < 300; ++i)
+        hashes[i] = str_hash(keys[i]);
+
+    word_count_dic_lookup_many_with_hash(&dic, hashes + 1, (const char * const *)keys + 1, 299, items);
+    for (int i = 1; i < 300; ++i)
+        assert(items[i - 1] == word_count_dic_lookup(&dic, keys[i]));
+
+    assert(word_count_dic_set_with_hash(&dic, hashes[0], keys[0], 1000)->value == 1000);
+    assert(word_count_dic_set_with_hash(&dic, hashes[1], keys[1], 1001)->value == 1001);
+    assert(word_count_dic_size(&dic) == 201);
+    word_count_dic_remove_with_hash(&dic, hashes[0], keys[0]);
+    word_count_dic_remove_with_hash(&dic, hashes[3], keys[3]);
+    assert(!word_count_dic_contains(&dic, keys[0]) && word_count_dic_lookup(&dic, keys[1])->value == 1001);
+    assert(word_count_dic_size(&dic) == 200);
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    for (int i = 0; i < 300; ++i)
+        free(keys[i]);
+
+    word_count_dic_clear(&dic);
+}
+
+static void
+combine_sum(int *value, int new_value, void *ctx)
+{
+    *value += new_value;
+    ++*(int *)ctx;
+}
+
+static void
+test_build_from(void)
+{
+    const char *keys[2000];
+    int values[2000];
+    for (int i = 0; i < 2000; ++i) {
+        keys[i] = i < 1000 ? str_printf("key %d", i) : keys[i - 1000];
+        values[i] = i;
+    }
+
+    WordCountDic dic;
+    word_count_dic_init(&dic);
+    word_count_dic_set(&dic, "key 5", -1);
+    word_count_dic_set(&dic, "other", -1);
+
+    // last wins
+    assert(word_count_dic_build_from(&dic, keys, values, 2000));
+    assert(word_count_dic_size(&dic) == 1001);
+    for (int i = 0; i < 1000; ++i)
+        assert(word_count_dic_lookup(&dic, keys[i])->value == i + 1000);
+    assert(word_count_dic_lookup(&dic, "other")->value == -1);
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    word_count_dic_clear(&dic);
+
+    // combine
+    int combined = 0;
+    word_count_dic_init(&dic);
+    word_count_dic_set(&dic, "key 5", 1);
+    assert(word_count_dic_build_from_combine(&dic, keys, values, 2000, combine_sum, &combined));
+    assert(combined == 1001);
+    assert(word_count_dic_size(&dic) == 1000);
+    for (int i = 0; i < 1000; ++i)
+        assert(word_count_dic_lookup(&dic, keys[i])->value == 2 * i + 1000 + (i == 5));
+    assert(word_count_dic_check_internal_sanity(&dic));
+
+    word_count_dic_clear(&dic);
+
+    for (int i = 0; i < 1000; ++i)
+        free((char *)keys[i]);
+}
+
+static void
+test_merge(void)
+{
+    WordCountDic a, b;
+    word_count_dic_init(&a);
+    word_count_dic_init(&b);
+
+    for (int i = 0; i < 1000; ++i) {
+        char *key = str_printf("key %d", i);
+        word_count_dic_set(&a, key, i);
+        if (i % 3 == 0)
+            word_count_dic_remove(&a, key); // leave holes in the item storage
+        free(key);
+    }
+    for (int i = 500; i < 1500; ++i) {
+        char *key = str_printf("key %d", i);
+        word_count_dic_set(&b, key, 1);
+        free(key);
+    }
+
+    int combined = 0;
+    assert(word_count_dic_merge(&a, &b, combine_sum, &combined));
+    assert(word_count_dic_size(&b) == 0);
+    assert(word_count_dic_check_internal_sanity(&a));
+
+    // 500..999 minus the removed multiples of three were in both tables
+    assert(combined == 500 - 167);
+    assert(word_count_dic_size(&a) == 1500 - 167);
+    for (int i = 0; i < 1500; ++i) {
+        char *key = str_printf("key %d", i);
+        WordCountDic_Item *item = word_count_dic_lookup(&a, key);
+        if (i < 1000 && i % 3 == 0) {
+            assert(i >= 500 ? item->value == 1 : !item);
+        } else if (i < 500) {
+            assert(item->value == i);
+        } else if (i < 1000) {
+            assert(item->value == i + 1);
+        } else {
+            assert(item->value == 1);
+        }
+        free(key);
+    }
+
+    // src wins, and the emptied table is still usable
+    word_count_dic_set(&b, "key 1", -1);
+    assert(word_count_dic_merge(&a, &b, NULL, NULL));
+    assert(word_count_dic_lookup(&a, "key 1")->value == -1);
+
+    word_count_dic_clear(&a);
+    word_count_dic_clear(&b);
+}
+
+HASHTBL_DEFINE(SeededDic, seeded_dic,
+               HASHTBL_KEY_SEEDED_FULL(char *, const char *, str_dup, free, str_hash_seeded, str_equal),
+               HASHTBL_VALUE(int))
+
+// a keyed hash which is trivially broken for one known seed
+static unsigned
+weak_seeded_hash(const char *key, uint64_t seed)
+{
+    return seed == 42 ? 7 : str_hash_seeded(key, seed);
+}
+
+HASHTBL_DEFINE(WeakSeededDic, weak_seeded_dic,
+               HASHTBL_KEY_SEEDED_FULL(char *, const char *, str_dup, free, weak_seeded_hash, str_equal),
+               HASHTBL_VALUE(int))
+
+static void
+test_seeded(void)
+{
+    // tables get different seeds
+    SeededDic a, b;
+    seeded_dic_init(&a);
+    seeded_dic_init(&b);
+    assert(a.hash_seed != b.hash_seed);
+    assert(seeded_dic_hash(&a, "key") != seeded_dic_hash(&b, "key"));
+
+    for (int i = 0; i < 1000; ++i) {
+        char *key = str_printf("key %d", i);
+        seeded_dic_set(&a, key, i);
+        seeded_dic_set(&b, key, 1);
+        free(key);
+    }
+
+    // merging rehashes between seeds
+    assert(seeded_dic_merge(&a, &b, NULL, NULL));
+    assert(seeded_dic_size(&a) == 1000);
+    assert(seeded_dic_check_internal_sanity(&a));
+
+    seeded_dic_reseed(&a, 1234);
+    assert(seeded_dic_check_internal_sanity(&a));
+    for (int i = 0; i < 1000; ++i) {
+        char *key = str_printf("key %d", i);
+        assert(seeded_dic_lookup(&a, key)->value == 1);
+        free(key);
+    }
+
+    seeded_dic_clear(&a);
+    seeded_dic_clear(&b);
+
+    // all keys collide with the known seed, the table has to pick another one
+    WeakSeededDic w;
+    weak_seeded_dic_init(&w);
+    weak_seeded_dic_reseed(&w, 42);
+
+    for (int i = 0; i < 2000; ++i) {
+        char *key = str_printf("key %d", i);
+        weak_seeded_dic_set(&w, key, i);
+        free(key);
+    }
+
+    assert(w.hash_seed != 42);
+    assert(weak_seeded_dic_check_internal_sanity(&w));
+    HashtblStats stats;
+    weak_seeded_dic_stats(&w, &stats);
+    assert(stats.longest_chain <= HASHTBL_RESEED_CHAIN_LENGTH);
+    for (int i = 0; i < 2000; ++i) {
+        char *key = str_printf("key %d", i);
+        assert(weak_seeded_dic_lookup(&w, key)->value == i);
+        free(key);
+    }
+
+    weak_seeded_dic_clear(&w);
+}
+
 static void
 test_wordcount(void)
 {
@@ -33,12 +461,9 @@ test_wordcount(void)
     while (getline(&buf, &n, f) >= 0) {
         str_trim_inplace(buf);
 
-        WordCountDic_Item *item = word_count_dic_lookup(&dic, buf);
-        if (item) {
-            item->value++;
-        } else {
-            word_count_dic_set(&dic, buf, 1);
-        }
+        WordCountDic_Item *item = word_count_dic_lookup_or_insert_zero(&dic, buf, NULL);
+        assert(item);
+        item->value++;
     }
 
     free(buf);
@@ -71,23 +496,419 @@ test_wordcount(void)
     printf("element count: %u\n", dic.element_count);
     printf("table size %u: %u\n", dic.table_size_idx, _hashtbl_size_map[dic.table_size_idx]);
 
-    // count collisions
-    size_t collcount = 0;
-    for (size_t i = 0; i < _hashtbl_size_map[dic.table_size_idx]; ++i) {
-        unsigned item_i = dic.hashtbl[i];
-        while (item_i != (unsigned)-1 && dic.item_storage[item_i].next != (unsigned)-1) {
-            collcount++;
-            item_i = dic.item_storage[item_i].next;
-        }
-    }
+    HashtblStats stats;
+    word_count_dic_stats(&dic, &stats);
+    assert(stats.element_count == dic.element_count);
+    assert(stats.bucket_count == _hashtbl_size_map[dic.table_size_idx]);
+    assert(stats.freelist_length > 0); // the low counts were removed
+
+    // every element but the first one in each bucket collides
+    unsigned collcount = stats.element_count - (stats.bucket_count - stats.empty_buckets);
+    unsigned histogram_elements = 0;
+    for (unsigned i = 0; i < HASHTBL_STATS_HISTOGRAM; ++i)
+        histogram_elements += i * stats.chain_histogram[i];
+    assert(stats.longest_chain >= HASHTBL_STATS_HISTOGRAM || histogram_elements == stats.element_count);
 
-    printf("collision count: %zu\n", collcount);
+    printf("collision count: %u\n", collcount);
+    printf("load factor: %.2f, empty buckets: %.2f, longest chain: %u\n",
+           stats.load_factor, stats.empty_bucket_ratio, stats.longest_chain);
+    printf("bucket bytes: %zu, item bytes: %zu, free items: %u\n",
+           stats.bucket_bytes, stats.item_bytes, stats.freelist_length);
 
     assert(word_count_dic_check_internal_sanity(&dic));
 
     word_count_dic_clear(&dic);
 }
 
+HASHTBL_DEFINE(StrDictionary, str_dictionary,
+               HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+               HASHTBL_VALUE_FULL(char *, const char *, str_dup, free))
+
+static void
+add_ctx(int *value, void *ctx)
+{
+    *value += *(int *)ctx;
+}
+
+static void
+test_lookup_or_insert(void)
+{
+    StrDictionary dic;
+    str_dictionary_init(&dic);
+
+    int inserted = -1;
+    StrDictionary_Item *item = str_dictionary_lookup_or_insert(&dic, "Hello", "World", &inserted);
+    assert(item && inserted == 1 && !strcmp(item->value, "World"));
+
+    // an existing value is not replaced
+    item = str_dictionary_lookup_or_insert(&dic, "Hello", "Hohoho", &inserted);
+    assert(item && inserted == 0 && !strcmp(item->value, "World"));
+
+    item = str_dictionary_lookup_or_insert_zero(&dic, "Goodbye", &inserted);
+    assert(item && inserted == 1 && item->value == NULL);
+    item->value = str_dup("Moon");
+    item = str_dictionary_lookup_or_insert_zero(&dic, "Goodbye", NULL);
+    assert(!strcmp(item->value, "Moon"));
+    assert(str_dictionary_size(&dic) == 2);
+
+    str_dictionary_clear(&dic);
+
+    WordCountDic wc;
+    word_count_dic_init(&wc);
+
+    int amount = 3;
+    assert(word_count_dic_upsert(&wc, "a", add_ctx, &amount) == 1);
+    assert(word_count_dic_upsert(&wc, "a", add_ctx, &amount) == 0);
+    amount = 10;
+    assert(word_count_dic_upsert(&wc, "b", add_ctx, &amount) == 1);
+    assert(word_count_dic_lookup(&wc, "a")->value == 6);
+    assert(word_count_dic_lookup(&wc, "b")->value == 10);
+
+    // many inserts through all the table growth steps
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 5000; ++i) {
+            char *key = str_printf("%d", i);
+            WordCountDic_Item *wc_item = word_count_dic_lookup_or_insert(&wc, key, 100, &inserted);
+            assert(wc_item && inserted == !round);
+            wc_item->value++;
+            free(key);
+        }
+    }
+    assert(word_count_dic_size(&wc) == 5002);
+    assert(word_count_dic_lookup(&wc, "4999")->value == 102);
+    assert(word_count_dic_check_internal_sanity(&wc));
+
+    word_count_dic_clear(&wc);
+}
+
+HASHTBL_DEFINE(SliceWordCountDic, slice_word_count_dic,
+               HASHTBL_KEY_ALT(HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                               StrSlice, str_slice_hash, str_slice_equal, str_slice_dup),
+               HASHTBL_VALUE(int))
+
+static void
+test_alt_key(void)
+{
+    const char *text = "  the quick brown fox jumps over the lazy dog and the other fox  ";
+
+    SliceWordCountDic dic;
+    slice_word_count_dic_init(&dic);
+
+    // count the words of the text without copying them
+    int new_words = 0;
+    for (int i = 0; text[i]; ) {
+        if (text[i] == ' ') {
+            ++i;
+            continue;
+        }
+
+        int len = 0;
+        while (text[i + len] && text[i + len] != ' ')
+            ++len;
+
+        int inserted = -1;
+        SliceWordCountDic_Item *item = slice_word_count_dic_lookup_or_insert_alt(&dic, str_slice(text + i, len), 0, &inserted);
+        assert(item && (inserted == 0 || inserted == 1));
+        assert(str_length(item->key) == len && !strncmp(item->key, text + i, (size_t)len));
+        item->value++;
+        new_words += inserted;
+
+        i += len;
+    }
+
+    assert(new_words == 10);
+    assert(slice_word_count_dic_size(&dic) == 10);
+    assert(slice_word_count_dic_lookup(&dic, "the")->value == 3);
+    assert(slice_word_count_dic_lookup(&dic, "fox")->value == 2);
+    assert(slice_word_count_dic_lookup_alt(&dic, str_slice("dogs", 3))->value == 1);
+    assert(!slice_word_count_dic_contains_alt(&dic, str_slice("dogs", 4)));
+    assert(!slice_word_count_dic_contains_alt(&dic, str_slice("", 0)));
+    assert(slice_word_count_dic_hash_alt(&dic, str_slice("other", 5)) == slice_word_count_dic_hash(&dic, "other"));
+    assert(slice_word_count_dic_check_internal_sanity(&dic));
+
+    slice_word_count_dic_clear(&dic);
+}
+
+HASHTBL_DEFINE(ArenaWordCountDic, arena_word_count_dic,
+               HASHTBL_KEY_ARENA(HASHTBL_KEY_ALT(HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                                                 StrSlice, str_slice_hash, str_slice_equal, str_slice_dup)),
+               HASHTBL_VALUE(int))
+
+static void
+test_arena_keys(void)
+{
+    ArenaWordCountDic dic;
+    arena_word_count_dic_init(&dic);
+
+    for (int i = 0; i < 20000; ++i) {
+        char *key = str_printf("key %d", i);
+        int inserted = -1;
+        ArenaWordCountDic_Item *item = arena_word_count_dic_lookup_or_insert(&dic, key, 0, &inserted);
+        assert(inserted == 1 && item->key != key && !strcmp(item->key, key));
+        item->value = i;
+        free(key);
+    }
+
+    // a key far beyond the chunk size, and one from the alt form
+    char *big = (char *)malloc(3 * HASHTBL_ARENA_MAX_CHUNK);
+    memset(big, 'x', 3 * HASHTBL_ARENA_MAX_CHUNK - 1);
+    big[3 * HASHTBL_ARENA_MAX_CHUNK - 1] = 0;
+    arena_word_count_dic_set(&dic, big, -1);
+    int inserted = -1;
+    arena_word_count_dic_lookup_or_insert_alt(&dic, str_slice("alternative", 3), -2, &inserted);
+    assert(inserted == 1);
+    assert(arena_word_count_dic_lookup(&dic, "alt")->value == -2);
+    assert(arena_word_count_dic_lookup(&dic, big)->value == -1);
+
+    HashtblStats stats;
+    arena_word_count_dic_stats(&dic, &stats);
+    assert(stats.key_bytes >= 3 * HASHTBL_ARENA_MAX_CHUNK + 20000 * 6);
+    size_t full_key_bytes = stats.key_bytes;
+
+    // removed keys stay in the arena until compaction
+    arena_word_count_dic_remove(&dic, big);
+    for (int i = 0; i < 20000; i += 2) {
+        char *key = str_printf("key %d", i);
+        arena_word_count_dic_remove(&dic, key);
+        free(key);
+    }
+    arena_word_count_dic_stats(&dic, &stats);
+    assert(stats.key_bytes == full_key_bytes);
+
+    arena_word_count_dic_compact(&dic);
+    arena_word_count_dic_stats(&dic, &stats);
+    assert(stats.key_bytes < full_key_bytes / 8);
+    assert(arena_word_count_dic_size(&dic) == 10001);
+    assert(arena_word_count_dic_check_internal_sanity(&dic));
+
+    for (int i = 0; i < 20000; ++i) {
+        char *key = str_printf("key %d", i);
+        ArenaWordCountDic_Item *item = arena_word_count_dic_lookup(&dic, key);
+        assert(i % 2 ? item && item->value == i : !item);
+        free(key);
+    }
+
+    // merging copies the keys into the arena of the destination
+    ArenaWordCountDic other;
+    arena_word_count_dic_init(&other);
+    arena_word_count_dic_set(&other, "key 1", 100);
+    arena_word_count_dic_set(&other, "key 2", 2);
+    arena_word_count_dic_set(&other, big, -1);
+    assert(arena_word_count_dic_merge(&dic, &other, NULL, NULL));
+    assert(arena_word_count_dic_size(&other) == 0);
+    arena_word_count_dic_stats(&other, &stats);
+    assert(stats.key_bytes == 0);
+    arena_word_count_dic_clear(&other);
+
+    assert(arena_word_count_dic_size(&dic) == 10003);
+    assert(arena_word_count_dic_lookup(&dic, "key 1")->value == 100);
+    assert(arena_word_count_dic_lookup(&dic, "key 2")->value == 2);
+    assert(arena_word_count_dic_lookup(&dic, big)->value == -1);
+    assert(arena_word_count_dic_check_internal_sanity(&dic));
+    free(big);
+
+    arena_word_count_dic_clear(&dic);
+    arena_word_count_dic_stats(&dic, &stats);
+    assert(stats.key_bytes == 0 && stats.element_count == 0);
+
+    // the table is usable again after clearing
+    arena_word_count_dic_set(&dic, "again", 1);
+    assert(arena_word_count_dic_lookup(&dic, "again")->value == 1);
+    arena_word_count_dic_clear(&dic);
+}
+
+// counts the blocks handed out, to see that the arena uses the table's allocator,
+// and can pretend that memory ran out
+static int counted_blocks;
+static int counted_fail;
+
+static void *
+counted_reallocarray(void *p, size_t n, size_t size)
+{
+    if (counted_fail)
+        return NULL;
+
+    void *r = reallocarray(p, n, size);
+    if (!p && r)
+        counted_blocks++;
+    return r;
+}
+
+static void
+counted_free(void *p)
+{
+    if (p)
+        counted_blocks--;
+    free(p);
+}
+
+HASHTBL_DEFINE_FULL(CountedArenaDic, counted_arena_dic,
+                    HASHTBL_KEY_ARENA(HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal)),
+                    HASHTBL_VALUE(int),
+                    counted_reallocarray, counted_free)
+
+static void
+test_arena_allocator(void)
+{
+    CountedArenaDic dic;
+    counted_arena_dic_init(&dic);
+
+    for (int i = 0; i < 2000; ++i) {
+        char *key = str_printf("key %d", i);
+        counted_arena_dic_set(&dic, key, i);
+        free(key);
+    }
+
+    // item storage and buckets, plus the arena chunks for ~14k bytes of keys
+    assert(counted_blocks >= 2 + 2);
+    counted_arena_dic_compact(&dic);
+    assert(counted_arena_dic_lookup(&dic, "key 1999")->value == 1999);
+
+    counted_arena_dic_clear(&dic);
+    assert(counted_blocks == 0);
+}
+
+HASHTBL_DEFINE_FULL(CountedDic, counted_dic,
+                    HASHTBL_KEY_FULL(char *, const char *, str_dup, free, str_hash, str_equal),
+                    HASHTBL_VALUE(int),
+                    counted_reallocarray, counted_free)
+
+static void
+test_out_of_memory(void)
+{
+    CountedDic a, b;
+    counted_dic_init(&a);
+    counted_dic_init(&b);
+    for (int i = 0; i < 1100; ++i) {
+        char *key = str_printf("key %d", i);
+        counted_dic_set(i < 100 ? &a : &b, key, i);
+        free(key);
+    }
+    unsigned size_idx = a.table_size_idx;
+
+    // failing to grow the buckets must keep the old ones
+    counted_fail = 1;
+    assert(!counted_dic_merge(&a, &b, NULL, NULL));
+    assert(a.hashtbl && a.table_size_idx == size_idx);
+
+    const char *keys[1000];
+    int values[1000];
+    char *owned[1000];
+    for (int i = 0; i < 1000; ++i) {
+        owned[i] = str_printf("new %d", i);
+        keys[i] = owned[i];
+        values[i] = -i;
+    }
+    assert(!counted_dic_build_from(&a, keys, values, 1000));
+    assert(a.hashtbl);
+    counted_fail = 0;
+
+    assert(counted_dic_size(&b) == 1000);
+    assert(counted_dic_check_internal_sanity(&a));
+    assert(counted_dic_check_internal_sanity(&b));
+    for (int i = 0; i < 100; ++i) {
+        char *key = str_printf("key %d", i);
+        assert(counted_dic_lookup(&a, key)->value == i);
+        free(key);
+    }
+
+    assert(counted_dic_merge(&a, &b, NULL, NULL));
+    assert(counted_dic_lookup(&a, "key 1099")->value == 1099);
+    assert(counted_dic_build_from(&a, keys, values, 1000));
+    assert(counted_dic_size(&a) == 2100);
+    assert(counted_dic_check_internal_sanity(&a));
+
+    for (int i = 0; i < 1000; ++i)
+        free(owned[i]);
+    counted_dic_clear(&a);
+    counted_dic_clear(&b);
+    assert(counted_blocks == 0);
+}
+
+static HashtblStr
+inline_str_from_slice(StrSlice s)
+{
+    return hashtbl_str_from_buf(s.data, (size_t)s.len);
+}
+
+HASHTBL_DEFINE(InlineStrDic, inline_str_dic,
+               HASHTBL_KEY_ALT(HASHTBL_KEY_STR(str_hash),
+                               StrSlice, str_slice_hash, str_slice_equal, inline_str_from_slice),
+               HASHTBL_VALUE(int))
+
+static void
+test_str_keys(void)
+{
+    InlineStrDic dic;
+    inline_str_dic_init(&dic);
+
+    // lengths around the inline limit, and keys sharing their prefix
+    char buf[64];
+    for (int len = 0; len < 40; ++len) {
+        memset(buf, 'a', (size_t)len);
+        buf[len] = 0;
+        inline_str_dic_set(&dic, buf, len);
+        buf[len] = 'b';
+        buf[len + 1] = 0;
+        inline_str_dic_set(&dic, buf, 100 + len);
+    }
+    assert(inline_str_dic_size(&dic) == 80);
+
+    for (int len = 0; len < 40; ++len) {
+        memset(buf, 'a', (size_t)len);
+        buf[len] = 0;
+        InlineStrDic_Item *item = inline_str_dic_lookup(&dic, buf);
+        assert(item && item->value == len);
+        assert(hashtbl_str_length(&item->key) == (unsigned)len);
+        assert(!strcmp(hashtbl_str_cstr(&item->key), buf));
+        assert((hashtbl_str_cstr(&item->key) == item->key.data) == (len < HASHTBL_STR_INLINE));
+
+        buf[len] = 'b';
+        buf[len + 1] = 0;
+        assert(inline_str_dic_lookup(&dic, buf)->value == 100 + len);
+        buf[len + 1] = 'b';
+        buf[len + 2] = 0;
+        assert(!inline_str_dic_contains(&dic, buf));
+    }
+
+    for (int len = 0; len < 40; len += 2) {
+        memset(buf, 'a', (size_t)len);
+        buf[len] = 0;
+        inline_str_dic_remove(&dic, buf);
+        assert(!inline_str_dic_contains(&dic, buf));
+    }
+    assert(inline_str_dic_size(&dic) == 60);
+    int inserted = -1;
+    inline_str_dic_lookup_or_insert_alt(&dic, str_slice("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", 30), 30, &inserted);
+    assert(inserted == 1);
+    inline_str_dic_lookup_or_insert_alt(&dic, str_slice("aab", 2), 2, &inserted);
+    assert(inserted == 1);
+    inline_str_dic_lookup_or_insert_alt(&dic, str_slice("aa", 2), 2, &inserted);
+    assert(inserted == 0);
+    assert(inline_str_dic_lookup(&dic, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa")->value == 30);
+    assert(inline_str_dic_lookup_alt(&dic, str_slice("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", 23))->value == 23);
+    assert(!inline_str_dic_contains_alt(&dic, str_slice("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", 24)));
+
+    // merging compares and rehashes stored keys
+    InlineStrDic other;
+    inline_str_dic_init(&other);
+    inline_str_dic_set(&other, "a", -1);
+    inline_str_dic_set(&other, "a very long key which is not stored inline", -2);
+    assert(inline_str_dic_merge(&dic, &other, NULL, NULL));
+    inline_str_dic_clear(&other);
+
+    assert(inline_str_dic_size(&dic) == 63);
+    assert(inline_str_dic_lookup(&dic, "a")->value == -1);
+    assert(inline_str_dic_lookup(&dic, "a very long key which is not stored inline")->value == -2);
+    assert(inline_str_dic_check_internal_sanity(&dic));
+
+    inline_str_dic_shrink_to_fit(&dic);
+    assert(inline_str_dic_lookup(&dic, "aaaaaaaaaaaaaaaaaaaaaaaaa")->value == 25);
+    assert(inline_str_dic_check_internal_sanity(&dic));
+
+    inline_str_dic_clear(&dic);
+}
+
 int main(void)
 {
     ConstStrDictionary dic;
@@ -106,5 +927,30 @@ int main(void)
 
     const_str_dictionary_clear(&dic);
 
+    test_pow2_sizing();
+
+    test_incremental_resize();
+    test_incremental_latency();
+
+    test_shrink();
+
+    test_lookup_many();
+
+    test_build_from();
+
+    test_merge();
+
+    test_seeded();
+
+    test_alt_key();
+
+    test_arena_keys();
+    test_arena_allocator();
+    test_out_of_memory();
+
+    test_str_keys();
+
+    test_lookup_or_insert();
+
     test_wordcount();
 }
@@ -421,6 +421,59 @@ test_case(void)
     str_clear(&r);
 }
 
+static void
+test_hash(void)
+{
+    const char *text = "The quick brown fox jumps over the lazy dog, again and again and again.";
+    int text_len = str_length(text);
+
+    // hashing a slice is the same as hashing a copy of it
+    for (int start = 0; start < 8; ++start) {
+        for (int len = 0; start + len <= text_len; ++len) {
+            char *copy = str_substr(text, start, start + len);
+            assert(str_hash64_buf(text + start, len) == str_hash64_buf(copy, len));
+            assert(str_hash_buf(text + start, len) == str_hash_buf(copy, str_length(copy)));
+            str_clear(&copy);
+        }
+    }
+
+    assert(str_hash64_buf(NULL, 0) == str_hash64_buf("", 0));
+
+    // all prefixes are different
+    for (int i = 0; i <= text_len; ++i)
+        for (int j = 0; j < i; ++j)
+            assert(str_hash64_buf(text, i) != str_hash64_buf(text, j));
+
+    // slices hash like str_hash() of a copy
+    for (int start = 0; start < 8; ++start) {
+        for (int len = 0; start + len <= text_len; ++len) {
+            char *copy = str_slice_dup(str_slice(text + start, len));
+            assert(str_slice_hash(str_slice(text + start, len)) == str_hash(copy));
+            assert(str_slice_equal(copy, str_slice(text + start, len)));
+            assert(!str_slice_equal(copy, str_slice(text + start, len + 1)));
+            assert(len == 0 || !str_slice_equal(copy, str_slice(text + start, len - 1)));
+            str_clear(&copy);
+        }
+    }
+    assert(str_slice_equal(NULL, str_slice(text, 0)));
+
+    // keyed hashing
+    assert(str_hash_seeded("Hello", 1) == str_hash_seeded("Hello", 1));
+    assert(str_hash_seeded("Hello", 1) != str_hash_seeded("Hello", 2));
+    assert(str_hash_seeded(NULL, 1) == str_hash_seeded("", 1));
+    assert(str_siphash13_buf(text, 15, 1, 2) != str_siphash13_buf(text, 15, 2, 1));
+
+    // the low bits are good enough for power-of-two tables
+    unsigned buckets[64] = {0};
+    for (int i = 0; i < 64 * 64; ++i) {
+        char *key = str_printf("key %d", i);
+        buckets[str_hash_buf(key, str_length(key)) & 63]++;
+        str_clear(&key);
+    }
+    for (int i = 0; i < 64; ++i)
+        assert(buckets[i] > 32 && buckets[i] < 96);
+}
+
 int main(void)
 {
     test_create();
@@ -433,6 +486,7 @@ int main(void)
     test_left_pad();
     test_trim();
     test_case();
+    test_hash();
 
     return 0;
 }